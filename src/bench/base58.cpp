@@ -0,0 +1,37 @@
+#include "bench.h"
+#include "base58.h"
+
+#include <vector>
+
+using namespace std;
+
+// Payload of an address: version byte, hash160 and checksum
+static void Base58Encode(benchmark::State& state)
+{
+    vector<unsigned char> vch(25);
+    for (size_t i = 0; i < vch.size(); i++)
+        vch[i] = (unsigned char)(i * 37 + 11);
+    while (state.KeepRunning())
+        EncodeBase58(vch);
+}
+
+static void Base58Decode(benchmark::State& state)
+{
+    const char* psz = "4Uk8zuMQSUf2uhmnSjQthBkozfKtGNT7Vh";
+    vector<unsigned char> vch;
+    while (state.KeepRunning())
+        DecodeBase58(psz, vch);
+}
+
+static void Base58CheckEncode(benchmark::State& state)
+{
+    vector<unsigned char> vch(21);
+    for (size_t i = 0; i < vch.size(); i++)
+        vch[i] = (unsigned char)(i * 37 + 11);
+    while (state.KeepRunning())
+        EncodeBase58Check(vch);
+}
+
+BENCHMARK(Base58Encode);
+BENCHMARK(Base58Decode);
+BENCHMARK(Base58CheckEncode);
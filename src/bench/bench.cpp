@@ -0,0 +1,115 @@
+#include "bench.h"
+#include "util.h"
+
+using namespace std;
+
+namespace benchmark {
+
+State::State(const string& name, int64_t nMaxElapsedMicros)
+    : name(name), nMaxElapsedMicros(nMaxElapsedMicros), nBeginMicros(0), nLastMicros(0), nCount(0), nCountMask(0)
+{
+    result.name = name;
+    result.nOps = 0;
+    result.nElapsedMicros = 0;
+}
+
+bool State::KeepRunning()
+{
+    if (nCount & nCountMask)
+    {
+        ++nCount;
+        return true;
+    }
+
+    int64_t nNow = GetTimeMicros();
+    if (nCount == 0)
+        nBeginMicros = nLastMicros = nNow;
+    else
+    {
+        // Check the clock less often for fast operations
+        if (nNow - nLastMicros < 1000 && nCountMask < (1 << 20))
+            nCountMask = nCountMask * 2 + 1;
+        nLastMicros = nNow;
+
+        if (nNow - nBeginMicros > nMaxElapsedMicros)
+        {
+            // The last call didn't start an operation
+            result.nOps = nCount - 1;
+            result.nElapsedMicros = nNow - nBeginMicros;
+            return false;
+        }
+    }
+
+    ++nCount;
+    return true;
+}
+
+static void PrintHeader(OutputFormat format)
+{
+    if (format == OUTPUT_CSV)
+        fprintf(stdout, "name,ops,elapsed_s,ns_per_op,ops_per_s\n");
+    else if (format == OUTPUT_JSON)
+        fprintf(stdout, "{\n  \"version\": \"%s\",\n  \"time\": %" PRId64 ",\n  \"benchmarks\": [", FormatFullVersion().c_str(), GetTime());
+}
+
+static void PrintResult(OutputFormat format, const Result& result, bool fFirst)
+{
+    double dElapsed = result.nElapsedMicros * 1e-6;
+    double dNanosPerOp = result.nOps ? dElapsed * 1e9 / result.nOps : 0;
+    double dOpsPerSecond = dElapsed > 0 ? result.nOps / dElapsed : 0;
+
+    switch (format)
+    {
+    case OUTPUT_TEXT:
+        fprintf(stdout, "%-32s %12" PRIu64 " ops %10.3f s %14.1f ns/op %16.1f ops/s\n",
+            result.name.c_str(), result.nOps, dElapsed, dNanosPerOp, dOpsPerSecond);
+        break;
+    case OUTPUT_CSV:
+        fprintf(stdout, "%s,%" PRIu64 ",%.6f,%.3f,%.3f\n",
+            result.name.c_str(), result.nOps, dElapsed, dNanosPerOp, dOpsPerSecond);
+        break;
+    case OUTPUT_JSON:
+        fprintf(stdout, "%s\n    { \"name\": \"%s\", \"ops\": %" PRIu64 ", \"elapsed_s\": %.6f, \"ns_per_op\": %.3f, \"ops_per_s\": %.3f }",
+            fFirst ? "" : ",", result.name.c_str(), result.nOps, dElapsed, dNanosPerOp, dOpsPerSecond);
+        break;
+    }
+    fflush(stdout);
+}
+
+static void PrintFooter(OutputFormat format)
+{
+    if (format == OUTPUT_JSON)
+        fprintf(stdout, "\n  ]\n}\n");
+}
+
+map<string, BenchFunction>& BenchRunner::benchmarks()
+{
+    static map<string, BenchFunction> benchmarks_map;
+    return benchmarks_map;
+}
+
+BenchRunner::BenchRunner(const string& name, BenchFunction func)
+{
+    benchmarks().insert(make_pair(name, func));
+}
+
+void BenchRunner::RunAll(const string& strFilter, int64_t nMaxElapsedMicros, OutputFormat format)
+{
+    PrintHeader(format);
+
+    bool fFirst = true;
+    for (const auto& item : benchmarks())
+    {
+        if (item.first.find(strFilter) == string::npos)
+            continue;
+
+        State state(item.first, nMaxElapsedMicros);
+        item.second(state);
+        PrintResult(format, state.GetResult(), fFirst);
+        fFirst = false;
+    }
+
+    PrintFooter(format);
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef NOVACOIN_BENCH_BENCH_H
+#define NOVACOIN_BENCH_BENCH_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Simple micro-benchmarking framework
+//
+// Benchmark function gets a State and does one operation per
+// KeepRunning() call, for example:
+//
+// static void CODE_TO_TIME(benchmark::State& state)
+// {
+//     ... do any setup needed...
+//     while (state.KeepRunning()) {
+//        ... do stuff you want to time...
+//     }
+//     ... do any cleanup needed...
+// }
+//
+// BENCHMARK(CODE_TO_TIME);
+//
+// Results are printed as aligned text, CSV or JSON, the latter two are
+// meant for tracking regressions between releases.
+
+namespace benchmark {
+
+enum OutputFormat
+{
+    OUTPUT_TEXT,
+    OUTPUT_CSV,
+    OUTPUT_JSON,
+};
+
+struct Result
+{
+    std::string name;
+    uint64_t nOps;
+    int64_t nElapsedMicros;
+};
+
+class State
+{
+public:
+    State(const std::string& name, int64_t nMaxElapsedMicros);
+
+    // Returns false once enough operations were timed
+    bool KeepRunning();
+
+    const Result& GetResult() const { return result; }
+
+private:
+    std::string name;
+    int64_t nMaxElapsedMicros;
+    int64_t nBeginMicros;
+    int64_t nLastMicros;
+    uint64_t nCount;
+    uint64_t nCountMask;
+    Result result;
+};
+
+typedef void (*BenchFunction)(State&);
+
+class BenchRunner
+{
+    static std::map<std::string, BenchFunction>& benchmarks();
+
+public:
+    BenchRunner(const std::string& name, BenchFunction func);
+
+    // Run benchmarks which names contain the filter string
+    static void RunAll(const std::string& strFilter, int64_t nMaxElapsedMicros, OutputFormat format);
+};
+
+}
+
+// BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_foo("foo", foo);
+#define BENCHMARK(n) \
+    benchmark::BenchRunner bench_##n(#n, n)
+
+#endif // NOVACOIN_BENCH_BENCH_H
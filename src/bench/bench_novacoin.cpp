@@ -0,0 +1,59 @@
+#include "bench.h"
+#include "txdb-leveldb.h"
+#include "scrypt.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("--help"))
+    {
+        fprintf(stdout, "Usage: bench_novacoin [options]\n\n"
+            "  -datadir=<dir>         Directory to create the database benchmark directory in (default: system temporary one)\n"
+            "  -filter=<str>          Run benchmarks which names contain given string\n"
+            "  -format=<fmt>          Output format: text, csv or json (default: text)\n"
+            "  -par=<n>               Number of check queue worker threads (default: one less than CPU cores)\n"
+            "  -scryptimpl=<name>     Use the given scrypt implementation (default: auto)\n"
+            "  -time=<n>              Time to spend on each benchmark, in milliseconds (default: 1000)\n");
+        return 0;
+    }
+
+    if (!SelectScryptImpl(GetArg("-scryptimpl", "auto")))
+    {
+        fprintf(stderr, "Error: unsupported scrypt implementation\n");
+        return 1;
+    }
+
+    string strFormat = GetArg("-format", "text");
+    benchmark::OutputFormat format;
+    if (strFormat == "text")
+        format = benchmark::OUTPUT_TEXT;
+    else if (strFormat == "csv")
+        format = benchmark::OUTPUT_CSV;
+    else if (strFormat == "json")
+        format = benchmark::OUTPUT_JSON;
+    else
+    {
+        fprintf(stderr, "Error: unknown output format '%s'\n", strFormat.c_str());
+        return 1;
+    }
+
+    // Database benchmarks must not touch the data directory of a real node,
+    // so they always run in a new subdirectory of the given one
+    boost::filesystem::path pathBase = mapArgs.count("-datadir") ? boost::filesystem::system_complete(mapArgs["-datadir"]) : boost::filesystem::temp_directory_path();
+    boost::filesystem::path pathTemp = pathBase / boost::filesystem::unique_path("bench_novacoin-%%%%-%%%%");
+    boost::filesystem::create_directories(pathTemp);
+    mapArgs["-datadir"] = pathTemp.string();
+
+    benchmark::BenchRunner::RunAll(GetArg("-filter", ""), GetArg("-time", 1000) * 1000, format);
+
+    CTxDB("cr").Close();
+    boost::filesystem::remove_all(pathTemp);
+
+    return 0;
+}
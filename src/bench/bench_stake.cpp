@@ -0,0 +1,245 @@
+#include "bignum.h"
+#include "kernel.h"
+#include "kernel_worker.h"
+#include "main.h"
+#include "midstatemap.h"
+#include "miner.h"
+#include "net.h"
+#include "util.h"
+
+#include <random>
+#include <vector>
+
+using namespace std;
+
+// Offline stake miner simulator
+//
+// Generates a reproducible set of synthetic stake inputs and runs the kernel
+// search code paths over them, without wallet, block chain or network.
+
+extern uint256 nPoWBase;
+
+struct StakeInput
+{
+    MidstateMap::key_type key;
+    unsigned char kernel[24];
+    uint32_t nTime;
+    int64_t nValue;
+};
+
+struct StakeBenchParams
+{
+    uint32_t nBits;
+    uint32_t nSearchTime;
+    uint32_t nInterval;
+    uint32_t nStep;
+    uint32_t nForwardInputs;
+    uint32_t nForwardDays;
+};
+
+static vector<StakeInput> GenerateInputs(size_t nInputs, uint32_t nSearchTime, uint32_t nMaxAgeDays, int64_t nAverageValue, uint64_t nSeed)
+{
+    mt19937_64 rng(nSeed);
+    vector<StakeInput> vInputs(nInputs);
+
+    for (size_t i = 0; i < nInputs; i++)
+    {
+        StakeInput& input = vInputs[i];
+
+        uint256 hashTx;
+        for (unsigned char* p = hashTx.begin(); p != hashTx.end(); p += sizeof(uint64_t))
+        {
+            uint64_t n = rng();
+            memcpy(p, &n, sizeof(n));
+        }
+
+        uint64_t nStakeModifier = rng();
+        uint32_t nAge = nStakeMinAge + rng() % (nMaxAgeDays * nOneDay + 1);
+        uint32_t nTimeTx = nSearchTime - nAge;
+        uint32_t nTimeBlockFrom = nTimeTx + rng() % 600;
+        uint32_t nTxOffset = 81 + rng() % 100000;
+        uint32_t nOut = rng() % 4;
+
+        CDataStream ssKernel(SER_GETHASH, 0);
+        ssKernel << nStakeModifier;
+        ssKernel << nTimeBlockFrom << nTxOffset << nTimeTx << nOut;
+        memcpy(input.kernel, &ssKernel.begin()[0], sizeof(input.kernel));
+
+        input.key = { hashTx, nOut };
+        input.nTime = nTimeTx;
+        input.nValue = COIN + rng() % (2 * nAverageValue);
+    }
+
+    return vInputs;
+}
+
+static void Report(const char* pszMode, int nThreads, uint64_t nKernels, int64_t nElapsedMicros, size_t nSolutions)
+{
+    double dElapsed = max<int64_t>(nElapsedMicros, 1) * 1e-6;
+    fprintf(stdout, "%-10s %3d threads %14" PRIu64 " kernels %10.3f s %16.1f kernels/s %8" PRIszu " solutions\n",
+        pszMode, nThreads, nKernels, dElapsed, nKernels / dElapsed, nSolutions);
+}
+
+// Every input is scanned backward over the whole interval, one input per task
+static void RunBackward(const vector<StakeInput>& vInputs, const StakeBenchParams& params, int nThreads)
+{
+    vector<size_t> vSolutions(vInputs.size(), 0);
+
+    int64_t nStart = GetTimeMicros();
+    RunKernelSearch(vInputs.size(), [&](size_t n) {
+        unsigned char kernel[24];
+        memcpy(kernel, vInputs[n].kernel, sizeof(kernel));
+
+        // Continue below every solution, to get the exact amount of hashing
+        std::pair<uint32_t, uint32_t> interval(params.nSearchTime, params.nSearchTime - params.nInterval);
+        std::pair<uint256, uint32_t> solution;
+        while (interval.first > interval.second && ScanKernelBackward(kernel, params.nBits, vInputs[n].nTime, vInputs[n].nValue, interval, solution))
+        {
+            vSolutions[n]++;
+            interval.first = solution.second - 1;
+        }
+
+        return true;
+    });
+    int64_t nElapsed = GetTimeMicros() - nStart;
+
+    size_t nSolutions = 0;
+    for (size_t n : vSolutions)
+        nSolutions += n;
+
+    Report("backward", nThreads, (uint64_t)vInputs.size() * params.nInterval, nElapsed, nSolutions);
+}
+
+// Inputs are scanned forward one by one, each scan is split between threads
+static void RunForward(const vector<StakeInput>& vInputs, const StakeBenchParams& params, int nThreads)
+{
+    size_t nInputs = min<size_t>(vInputs.size(), params.nForwardInputs);
+    uint32_t nLength = params.nForwardDays * nOneDay;
+    size_t nSolutions = 0;
+
+    int64_t nStart = GetTimeMicros();
+    for (size_t n = 0; n < nInputs; n++)
+    {
+        unsigned char kernel[24];
+        memcpy(kernel, vInputs[n].kernel, sizeof(kernel));
+
+        std::pair<uint32_t, uint32_t> interval(params.nSearchTime, params.nSearchTime + nLength);
+        std::vector<std::pair<uint256, uint32_t> > solutions;
+        if (ScanKernelForward(kernel, params.nBits, vInputs[n].nTime, vInputs[n].nValue, interval, solutions))
+            nSolutions += solutions.size();
+    }
+    int64_t nElapsed = GetTimeMicros() - nStart;
+
+    Report("forward", nThreads, (uint64_t)nInputs * nLength, nElapsed, nSolutions);
+}
+
+// Stake miner passes over the inputs map, a found solution is counted and the next pass goes on
+static void RunMap(MidstateMap& inputsMap, const StakeBenchParams& params, int nThreads)
+{
+    size_t nSolutions = 0;
+    uint64_t nKernels = 0;
+
+    int64_t nStart = GetTimeMicros();
+    for (uint32_t nOffset = 0; nOffset < params.nInterval; nOffset += params.nStep)
+    {
+        uint32_t nCount = min(params.nInterval - nOffset, params.nStep);
+
+        MidstateMap::key_type LuckyInput;
+        std::pair<uint256, uint32_t> solution;
+        bool fComplete;
+        if (ScanMapInterval(inputsMap, params.nSearchTime - nOffset, nCount, pindexBest, LuckyInput, solution, fComplete))
+            nSolutions++;
+        nKernels += (uint64_t)inputsMap.size() * nCount;
+    }
+    int64_t nElapsed = GetTimeMicros() - nStart;
+
+    Report("map", nThreads, nKernels, nElapsed, nSolutions);
+}
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("--help"))
+    {
+        fprintf(stdout, "Usage: bench_stake [options]\n\n"
+            "  -inputs=<n>            Number of synthetic stake inputs (default: 1000)\n"
+            "  -value=<n>             Average input value, in coins (default: 1000)\n"
+            "  -maxage=<n>            Maximum input age above the minimum, in days (default: 60)\n"
+            "  -difficulty=<n>        Proof-of-stake difficulty (default: 10)\n"
+            "  -interval=<n>          Seconds to scan backward for every input (default: 3600)\n"
+            "  -step=<n>              Seconds scanned by one stake miner pass over the map (default: 60)\n"
+            "  -forwardinputs=<n>     Number of inputs to scan forward (default: 4)\n"
+            "  -forwarddays=<n>       Days to scan forward for every input (default: 1)\n"
+            "  -threads=<n>           Maximum number of kernel search threads, 0=auto (default: 0)\n"
+            "  -mode=<str>            Run only backward, forward or map scans\n"
+            "  -seed=<n>              Seed of input generator (default: 1)\n");
+        return 0;
+    }
+
+    size_t nInputs = max<int64_t>(GetArg("-inputs", 1000), 1);
+    double dDiff = atof(GetArg("-difficulty", "10").c_str());
+    if (dDiff <= 0)
+    {
+        fprintf(stderr, "Error: difficulty must be greater than zero\n");
+        return 1;
+    }
+
+    StakeBenchParams params;
+    CBigNum bnTarget(nPoWBase);
+    bnTarget *= 1000;
+    bnTarget /= (int) (dDiff * 1000);
+    params.nBits = bnTarget.GetCompact();
+    params.nSearchTime = 1700000000;
+    params.nInterval = max<int64_t>(GetArg("-interval", 3600), 1);
+    params.nStep = max<int64_t>(GetArg("-step", 60), 1);
+    params.nForwardInputs = max<int64_t>(GetArg("-forwardinputs", 4), 0);
+    params.nForwardDays = max<int64_t>(GetArg("-forwarddays", 1), 1);
+
+    int nMaxThreads = GetArgInt("-threads", 0);
+    if (nMaxThreads <= 0)
+        nMaxThreads = boost::thread::hardware_concurrency();
+    nMaxThreads = max(1, min(nMaxThreads, MAX_KERNEL_THREADS));
+
+    string strMode = GetArg("-mode", "");
+
+    vector<StakeInput> vInputs = GenerateInputs(nInputs, params.nSearchTime, GetArg("-maxage", 60), GetArg("-value", 1000) * COIN, GetArg("-seed", 1));
+
+    MidstateMap inputsMap;
+    for (const StakeInput& input : vInputs)
+        inputsMap.insert(input.key, input.kernel, input.nTime, input.nValue);
+    inputsMap.SetBits(params.nBits);
+
+    fprintf(stdout, "Kernel engine %s, %" PRIszu " inputs, difficulty %.4f (nBits %08x)\n", GetKernelEngineName(), nInputs, dDiff, params.nBits);
+
+    // Thread counts are doubled up to the maximum, the calling thread is counted too
+    int nStarted = 0;
+    for (int nThreads = 1; ; nThreads = min(nThreads * 2, nMaxThreads))
+    {
+        while (nStarted < nThreads - 1)
+        {
+            if (!NewThread(ThreadKernelSearch, NULL))
+            {
+                fprintf(stderr, "Error: NewThread(ThreadKernelSearch) failed\n");
+                return 1;
+            }
+            nStarted++;
+        }
+        while (vnThreadsRunning[THREAD_KERNELSEARCH] < nStarted)
+            Sleep(1);
+
+        if (strMode == "" || strMode == "backward")
+            RunBackward(vInputs, params, nThreads);
+        if (strMode == "" || strMode == "forward")
+            RunForward(vInputs, params, nThreads);
+        if (strMode == "" || strMode == "map")
+            RunMap(inputsMap, params, nThreads);
+
+        if (nThreads == nMaxThreads)
+            break;
+    }
+
+    ThreadKernelSearchQuit();
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "bench.h"
+#include "checkqueue.h"
+#include "crypto/sha256/sha256.h"
+#include "util.h"
+
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Check with a small amount of work, to measure the queue itself
+struct CBenchCheck
+{
+    unsigned char data[64];
+
+    bool operator()()
+    {
+        SHA256D64(data, data, 1);
+        return true;
+    }
+
+    void swap(CBenchCheck& check)
+    {
+        std::swap(data, check.data);
+    }
+};
+
+// One operation is one check, blocks of 1024 checks are verified with
+// nThreads workers besides the master
+static void RunCheckQueue(benchmark::State& state, int nThreads)
+{
+    const size_t nBatch = 1024;
+    CCheckQueue<CBenchCheck> queue(128);
+
+    vector<thread> vThreads;
+    for (int i = 0; i < nThreads; i++)
+        vThreads.emplace_back([&queue] { queue.Thread(); });
+
+    size_t i = 0;
+    while (state.KeepRunning())
+    {
+        if (i++ % nBatch == 0)
+        {
+            CCheckQueueControl<CBenchCheck> control(&queue);
+            vector<CBenchCheck> vChecks(nBatch);
+            control.Add(vChecks);
+            control.Wait();
+        }
+    }
+
+    queue.Quit();
+    for (thread& t : vThreads)
+        t.join();
+}
+
+// -par sets the number of worker threads
+static void CheckQueueThroughput(benchmark::State& state)
+{
+    RunCheckQueue(state, GetArgInt("-par", max((int)thread::hardware_concurrency() - 1, 0)));
+}
+
+static void CheckQueueThroughput1Thread(benchmark::State& state) { RunCheckQueue(state, 1); }
+static void CheckQueueThroughput3Threads(benchmark::State& state) { RunCheckQueue(state, 3); }
+static void CheckQueueThroughput7Threads(benchmark::State& state) { RunCheckQueue(state, 7); }
+static void CheckQueueThroughput15Threads(benchmark::State& state) { RunCheckQueue(state, 15); }
+static void CheckQueueThroughput31Threads(benchmark::State& state) { RunCheckQueue(state, 31); }
+
+BENCHMARK(CheckQueueThroughput);
+BENCHMARK(CheckQueueThroughput1Thread);
+BENCHMARK(CheckQueueThroughput3Threads);
+BENCHMARK(CheckQueueThroughput7Threads);
+BENCHMARK(CheckQueueThroughput15Threads);
+BENCHMARK(CheckQueueThroughput31Threads);
@@ -0,0 +1,90 @@
+#include "bench.h"
+#include "key.h"
+#include "sigcache.h"
+
+#include <vector>
+
+using namespace std;
+
+static void ECDSASign(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    uint256 hash = 1;
+    vector<unsigned char> vchSig;
+    while (state.KeepRunning())
+    {
+        key.Sign(hash, vchSig);
+        ++hash;
+    }
+}
+
+static void ECDSAVerify(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    uint256 hash = 1;
+    vector<unsigned char> vchSig;
+    key.Sign(hash, vchSig);
+
+    bool fOk = true;
+    while (state.KeepRunning())
+        fOk &= pubkey.Verify(hash, vchSig);
+    if (!fOk)
+        fprintf(stderr, "ECDSAVerify: signature check failed\n");
+}
+
+// Block-style verification as seen during -reindex: every input has its own
+// key and signature, so pubkey parsing is paid on each check as well
+static void ECDSAVerifyBlock(benchmark::State& state)
+{
+    const int nInputs = 64;
+    vector<CPubKey> vPubKeys;
+    vector<uint256> vHashes;
+    vector<vector<unsigned char> > vSigs;
+    for (int i = 0; i < nInputs; i++)
+    {
+        CKey key;
+        key.MakeNewKey(i % 4 != 0);
+        vPubKeys.push_back(key.GetPubKey());
+        vHashes.push_back(i + 1);
+        vSigs.push_back(vector<unsigned char>());
+        key.Sign(vHashes.back(), vSigs.back());
+    }
+
+    bool fOk = true;
+    while (state.KeepRunning())
+        for (int i = 0; i < nInputs; i++)
+            fOk &= vPubKeys[i].Verify(vHashes[i], vSigs[i]);
+    if (!fOk)
+        fprintf(stderr, "ECDSAVerifyBlock: signature check failed\n");
+}
+
+// Cached signature, the cost of a hit instead of ECDSAVerify
+static void SignatureCacheHit(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    uint256 hash = 1;
+    vector<unsigned char> vchSig;
+    key.Sign(hash, vchSig);
+
+    CSignatureCache cache(1 << 20);
+    cache.Set(hash, vchSig, pubkey);
+
+    bool fOk = true;
+    while (state.KeepRunning())
+        fOk &= cache.Get(hash, vchSig, pubkey);
+    if (!fOk)
+        fprintf(stderr, "SignatureCacheHit: cache miss\n");
+}
+
+BENCHMARK(ECDSASign);
+BENCHMARK(ECDSAVerify);
+BENCHMARK(ECDSAVerifyBlock);
+BENCHMARK(SignatureCacheHit);
@@ -0,0 +1,55 @@
+#include "bench.h"
+#include "kernel_worker.h"
+#include "main.h"
+
+#include <vector>
+
+using namespace std;
+
+// Kernel hashes which passed the pre-filter, checked against the exact target
+static const uint32_t nBenchBits = 0x1d0137f2;
+static const uint32_t nBenchInputTxTime = 1600000000;
+static const int64_t nBenchValueIn = 1500 * COIN;
+
+static vector<uint256> GetCandidates(const KernelTarget& target)
+{
+    vector<uint256> vCandidates(4096);
+    for (size_t i = 0; i < vCandidates.size(); i++)
+        vCandidates[i] = (target.GetMaxTarget() >> (i % 8)) ^ uint256(i * 0x9e3779b97f4a7c15ULL);
+    return vCandidates;
+}
+
+static void KernelTargetBigNum(benchmark::State& state)
+{
+    KernelTarget target(nBenchBits, nBenchInputTxTime, nBenchValueIn);
+    vector<uint256> vCandidates = GetCandidates(target);
+    uint32_t nTimeTx = nBenchInputTxTime + nStakeMinAge + 40 * nOneDay;
+
+    size_t i = 0, nSolutions = 0;
+    while (state.KeepRunning())
+    {
+        nSolutions += target.CheckBigNum(vCandidates[i % vCandidates.size()], nTimeTx + i);
+        i++;
+    }
+    if (nSolutions > i)
+        fprintf(stderr, "Unexpected number of solutions\n");
+}
+
+static void KernelTargetFixed(benchmark::State& state)
+{
+    KernelTarget target(nBenchBits, nBenchInputTxTime, nBenchValueIn);
+    vector<uint256> vCandidates = GetCandidates(target);
+    uint32_t nTimeTx = nBenchInputTxTime + nStakeMinAge + 40 * nOneDay;
+
+    size_t i = 0, nSolutions = 0;
+    while (state.KeepRunning())
+    {
+        nSolutions += target.Check(vCandidates[i % vCandidates.size()], nTimeTx + i);
+        i++;
+    }
+    if (nSolutions > i)
+        fprintf(stderr, "Unexpected number of solutions\n");
+}
+
+BENCHMARK(KernelTargetBigNum);
+BENCHMARK(KernelTargetFixed);
@@ -0,0 +1,42 @@
+#include "bench.h"
+#include "main.h"
+#include "merkle.h"
+
+#include <vector>
+
+using namespace std;
+
+// Root of a large block, one operation is one tree
+static void MerkleRoot(benchmark::State& state)
+{
+    vector<uint256> vLeaves(9001);
+    for (size_t i = 0; i < vLeaves.size(); i++)
+        vLeaves[i] = i;
+
+    uint256 hashRoot;
+    while (state.KeepRunning())
+    {
+        hashRoot = ComputeMerkleRoot(vLeaves);
+        vLeaves[0] = hashRoot;
+    }
+}
+
+// Full tree of a block with 1000 transactions, txids are cached
+static void BuildMerkleTree(benchmark::State& state)
+{
+    CBlock block;
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        CTransaction tx;
+        tx.vin.push_back(CTxIn(uint256(i + 1), 0));
+        tx.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+        tx.UpdateHash();
+        block.vtx.push_back(tx);
+    }
+
+    while (state.KeepRunning())
+        block.BuildMerkleTree();
+}
+
+BENCHMARK(MerkleRoot);
+BENCHMARK(BuildMerkleTree);
@@ -0,0 +1,201 @@
+#include "bench.h"
+#include "key.h"
+#include "main.h"
+
+#include <vector>
+
+using namespace std;
+
+// Spending transaction with one input, evaluated by VerifyScript().
+// Signatures are made by hand, since SignSignature() would put them into
+// the signature cache. With fCached the signature cache is used, so only
+// the first run checks signatures.
+static void EvalSpend(benchmark::State& state, const CScript& scriptPubKey, vector<CKey>& vKeys, bool fPushPubKey, bool fCached = false)
+{
+    CTransaction txFrom;
+    txFrom.vout.push_back(CTxOut(COIN, scriptPubKey));
+
+    CTransaction txTo;
+    txTo.vin.push_back(CTxIn(txFrom.GetHash(), 0));
+    txTo.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+
+    uint256 hash = SignatureHash(scriptPubKey, txTo, 0, SIGHASH_ALL);
+    CScript scriptSig;
+    if (vKeys.size() > 1)
+        scriptSig << OP_0;
+    for (CKey& key : vKeys)
+    {
+        vector<unsigned char> vchSig;
+        key.Sign(hash, vchSig);
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        scriptSig << vchSig;
+    }
+    if (fPushPubKey)
+        scriptSig << vKeys[0].GetPubKey();
+    txTo.vin[0].scriptSig = scriptSig;
+
+    const unsigned int flags = fCached ? STRICT_FLAGS : STRICT_FLAGS | SCRIPT_VERIFY_NOCACHE;
+
+    bool fOk = true;
+    while (state.KeepRunning())
+        fOk &= VerifyScript(scriptSig, scriptPubKey, txTo, 0, flags, 0);
+    if (!fOk)
+        fprintf(stderr, "%s: script evaluation failed\n", __func__);
+}
+
+static vector<CKey> MakeKeys(int nKeys)
+{
+    vector<CKey> vKeys(nKeys);
+    for (CKey& key : vKeys)
+        key.MakeNewKey(true);
+    return vKeys;
+}
+
+static void EvalScriptPubKey(benchmark::State& state)
+{
+    vector<CKey> vKeys = MakeKeys(1);
+    EvalSpend(state, CScript() << vKeys[0].GetPubKey() << OP_CHECKSIG, vKeys, false);
+}
+
+static void EvalScriptPubKeyHash(benchmark::State& state)
+{
+    vector<CKey> vKeys = MakeKeys(1);
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(vKeys[0].GetPubKey().GetID());
+    EvalSpend(state, scriptPubKey, vKeys, true);
+}
+
+// Signed by the first two keys
+static void EvalScriptMultisig2of3(benchmark::State& state)
+{
+    vector<CKey> vKeys = MakeKeys(3);
+    vector<CPubKey> vPubKeys;
+    for (const CKey& key : vKeys)
+        vPubKeys.push_back(key.GetPubKey());
+    CScript scriptPubKey;
+    scriptPubKey.SetMultisig(2, vPubKeys);
+
+    vKeys.pop_back();
+    EvalSpend(state, scriptPubKey, vKeys, false);
+}
+
+static void EvalScriptPubKeyHashCached(benchmark::State& state)
+{
+    vector<CKey> vKeys = MakeKeys(1);
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(vKeys[0].GetPubKey().GetID());
+    EvalSpend(state, scriptPubKey, vKeys, true, true);
+}
+
+static void EvalScriptMultisig2of3Cached(benchmark::State& state)
+{
+    vector<CKey> vKeys = MakeKeys(3);
+    vector<CPubKey> vPubKeys;
+    for (const CKey& key : vKeys)
+        vPubKeys.push_back(key.GetPubKey());
+    CScript scriptPubKey;
+    scriptPubKey.SetMultisig(2, vPubKeys);
+
+    vKeys.pop_back();
+    EvalSpend(state, scriptPubKey, vKeys, false, true);
+}
+
+// Pay-to-pubkey-hash shaped spend with the signature check left out, the
+// interpreter overhead alone
+static void EvalScriptNoSig(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    CTransaction txTo;
+    txTo.vin.push_back(CTxIn(uint256(1), 0));
+    txTo.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+
+    CScript scriptSig = CScript() << vector<unsigned char>(72, 0x30) << pubkey;
+    CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << pubkey.GetID() << OP_EQUALVERIFY
+        << OP_2DUP << OP_2DROP << OP_DROP << OP_SIZE << OP_NIP;
+
+    bool fOk = true;
+    while (state.KeepRunning())
+        fOk &= VerifyScript(scriptSig, scriptPubKey, txTo, 0, STRICT_FLAGS, 0);
+    if (!fOk)
+        fprintf(stderr, "%s: script evaluation failed\n", __func__);
+}
+
+// Classification of the common output types, one operation is all of them
+static void SolverStandard(benchmark::State& state)
+{
+    vector<CKey> vKeys = MakeKeys(3);
+    vector<CPubKey> vPubKeys;
+    for (const CKey& key : vKeys)
+        vPubKeys.push_back(key.GetPubKey());
+
+    vector<CScript> vScripts(4);
+    vScripts[0] << vPubKeys[0] << OP_CHECKSIG;
+    vScripts[1].SetDestination(vPubKeys[0].GetID());
+    vScripts[2].SetDestination(CScriptID(uint160(1)));
+    vScripts[3].SetMultisig(2, vPubKeys);
+
+    int nSolved = 0;
+    while (state.KeepRunning())
+    {
+        for (const CScript& script : vScripts)
+        {
+            CTxDestination address;
+            nSolved += ExtractDestination(script, address);
+            txnouttype whichType;
+            nSolved += IsStandard(script, whichType);
+        }
+    }
+    if (nSolved == 0)
+        fprintf(stderr, "%s: no scripts solved\n", __func__);
+}
+
+// Consolidation of 500 P2PKH coins, one operation is hashing of all inputs
+static CTransaction MakeConsolidation(CScript& scriptCode)
+{
+    scriptCode.SetDestination(CKeyID(uint160(1)));
+
+    CTransaction tx;
+    for (uint32_t i = 0; i < 500; i++)
+    {
+        tx.vin.push_back(CTxIn(uint256(i + 1), 0));
+        tx.vin.back().scriptSig = CScript() << vector<unsigned char>(72, 0x30) << vector<unsigned char>(33, 0x02);
+    }
+    tx.vout.push_back(CTxOut(500 * COIN, scriptCode));
+    return tx;
+}
+
+static void SignatureHashLegacy(benchmark::State& state)
+{
+    CScript scriptCode;
+    CTransaction tx = MakeConsolidation(scriptCode);
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+            SignatureHash(scriptCode, tx, i, SIGHASH_ALL);
+    }
+}
+
+static void SignatureHashContext(benchmark::State& state)
+{
+    CScript scriptCode;
+    CTransaction tx = MakeConsolidation(scriptCode);
+    while (state.KeepRunning())
+    {
+        CSignatureHashContext sighashContext(tx);
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+            SignatureHash(scriptCode, tx, i, SIGHASH_ALL, &sighashContext);
+    }
+}
+
+BENCHMARK(EvalScriptPubKey);
+BENCHMARK(EvalScriptPubKeyHash);
+BENCHMARK(EvalScriptMultisig2of3);
+BENCHMARK(EvalScriptPubKeyHashCached);
+BENCHMARK(EvalScriptMultisig2of3Cached);
+BENCHMARK(EvalScriptNoSig);
+BENCHMARK(SolverStandard);
+BENCHMARK(SignatureHashLegacy);
+BENCHMARK(SignatureHashContext);
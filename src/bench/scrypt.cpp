@@ -0,0 +1,45 @@
+#include "bench.h"
+#include "scrypt.h"
+
+#include <vector>
+
+using namespace std;
+
+// Distinct 80-byte headers, one operation is one hashed header
+static vector<uint8_t> GetHeaders(size_t nCount)
+{
+    vector<uint8_t> vHeaders(nCount * 80);
+    for (size_t i = 0; i < vHeaders.size(); i++)
+        vHeaders[i] = i * 0x9e3779b1 >> 24;
+    return vHeaders;
+}
+
+static void ScryptBlockHash(benchmark::State& state)
+{
+    vector<uint8_t> vHeaders = GetHeaders(16);
+
+    size_t i = 0;
+    uint256 hash;
+    while (state.KeepRunning())
+        hash = scrypt_blockhash(&vHeaders[(i++ % 16) * 80]);
+}
+
+static void ScryptBlockHashBatch(benchmark::State& state)
+{
+    const size_t nBatch = 16;
+    vector<uint8_t> vHeaders = GetHeaders(nBatch);
+    vector<const uint8_t*> vInputs;
+    for (size_t i = 0; i < nBatch; i++)
+        vInputs.push_back(&vHeaders[i * 80]);
+    vector<uint256> vHashes(nBatch);
+
+    size_t i = 0;
+    while (state.KeepRunning())
+    {
+        if (i++ % nBatch == 0)
+            scrypt_blockhash_n(vInputs.data(), vHashes.data(), nBatch);
+    }
+}
+
+BENCHMARK(ScryptBlockHash);
+BENCHMARK(ScryptBlockHashBatch);
@@ -0,0 +1,83 @@
+#include "bench.h"
+#include "main.h"
+
+#include <vector>
+
+using namespace std;
+
+// Typical payment: two inputs, two outputs
+static CTransaction MakeTransaction(uint32_t n)
+{
+    CTransaction tx;
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        tx.vin.push_back(CTxIn(uint256(n * 2 + i + 1), i));
+        tx.vin.back().scriptSig = CScript() << vector<unsigned char>(72, 0x30) << vector<unsigned char>(33, 0x02);
+    }
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        CScript scriptPubKey;
+        scriptPubKey.SetDestination(CKeyID(uint160(n + i)));
+        tx.vout.push_back(CTxOut(COIN + n, scriptPubKey));
+    }
+    return tx;
+}
+
+static CBlock MakeBlock(size_t nTx)
+{
+    CBlock block;
+    for (size_t i = 0; i < nTx; i++)
+        block.vtx.push_back(MakeTransaction(i));
+    block.hashMerkleRoot = block.BuildMerkleRoot();
+    return block;
+}
+
+static void SerializeTransaction(benchmark::State& state)
+{
+    CTransaction tx = MakeTransaction(1);
+    while (state.KeepRunning())
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << tx;
+    }
+}
+
+static void DeserializeTransaction(benchmark::State& state)
+{
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << MakeTransaction(1);
+    while (state.KeepRunning())
+    {
+        CDataStream ss(ssTx);
+        CTransaction tx;
+        ss >> tx;
+    }
+}
+
+// One operation is a block of 1000 transactions
+static void SerializeBlock(benchmark::State& state)
+{
+    CBlock block = MakeBlock(1000);
+    while (state.KeepRunning())
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+    }
+}
+
+static void DeserializeBlock(benchmark::State& state)
+{
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << MakeBlock(1000);
+    while (state.KeepRunning())
+    {
+        CDataStream ss(ssBlock);
+        CBlock block;
+        ss >> block;
+    }
+}
+
+BENCHMARK(SerializeTransaction);
+BENCHMARK(DeserializeTransaction);
+BENCHMARK(SerializeBlock);
+BENCHMARK(DeserializeBlock);
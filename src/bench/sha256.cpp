@@ -0,0 +1,45 @@
+#include "bench.h"
+#include "hash.h"
+#include "util.h"
+
+#include <vector>
+
+using namespace std;
+
+// Double hash of 1 KiB, like a transaction
+static void SHA256D_1024(benchmark::State& state)
+{
+    vector<unsigned char> vData(1024, 0x5a);
+    uint256 hash;
+    while (state.KeepRunning())
+    {
+        hash = Hash(vData.begin(), vData.end());
+        vData[0] = hash.Get32(0);
+    }
+}
+
+// Merkle node, one at a time
+static void SHA256D_64(benchmark::State& state)
+{
+    uint256 hashes[2] = { 1, 2 };
+    while (state.KeepRunning())
+        hashes[0] = Hash(BEGIN(hashes[0]), END(hashes[0]), BEGIN(hashes[1]), END(hashes[1]));
+}
+
+// Merkle nodes of one tree level, one operation is one node
+static void SHA256D64_Batch(benchmark::State& state)
+{
+    const size_t nBatch = 256;
+    vector<unsigned char> vIn(64 * nBatch, 0x5a), vOut(32 * nBatch);
+
+    size_t i = 0;
+    while (state.KeepRunning())
+    {
+        if (i++ % nBatch == 0)
+            SHA256D64(&vOut[0], &vIn[0], nBatch);
+    }
+}
+
+BENCHMARK(SHA256D_1024);
+BENCHMARK(SHA256D_64);
+BENCHMARK(SHA256D64_Batch);
@@ -0,0 +1,79 @@
+#include "bench.h"
+#include "kernel.h"
+#include "main.h"
+
+#include <random>
+#include <vector>
+
+using namespace std;
+
+extern unsigned int nStakeTargetSpacing;
+
+// Long synthetic chain of proof-of-work and proof-of-stake blocks with
+// generated stake modifiers. Blocks are owned by mapBlockIndex, like
+// the ones loaded from disk.
+class StakeModifierChain
+{
+public:
+    vector<CBlockIndex*> vBlocks;
+    vector<const CBlockIndex*> vModifierBlocks;
+
+    explicit StakeModifierChain(int nBlocks)
+    {
+        mt19937_64 rng(nBlocks);
+        uint32_t nTime = 1500000000;
+
+        for (int nHeight = 0; nHeight < nBlocks; nHeight++)
+        {
+            uint256 hashBlock;
+            for (unsigned char* p = hashBlock.begin(); p != hashBlock.end(); p++)
+                *p = rng();
+
+            CBlockIndex* pindex = new CBlockIndex();
+            pindex->phashBlock = &(mapBlockIndex.insert(make_pair(hashBlock, pindex)).first->first);
+            pindex->pprev = nHeight ? vBlocks.back() : NULL;
+            pindex->nHeight = nHeight;
+            pindex->nTime = nTime;
+            if (rng() % 2)
+            {
+                pindex->SetProofOfStake();
+                for (unsigned char* p = pindex->hashProofOfStake.begin(); p != pindex->hashProofOfStake.end(); p++)
+                    *p = rng();
+            }
+            pindex->SetStakeEntropyBit(rng() % 2);
+            vBlocks.push_back(pindex);
+
+            uint64_t nStakeModifier;
+            bool fGeneratedStakeModifier;
+            if (!ComputeNextStakeModifier(pindex, nStakeModifier, fGeneratedStakeModifier))
+                throw runtime_error("StakeModifierChain() : ComputeNextStakeModifier failed");
+            pindex->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
+            if (fGeneratedStakeModifier && nHeight > 0)
+                vModifierBlocks.push_back(pindex);
+
+            nTime += 1 + rng() % (nStakeTargetSpacing * 2);
+        }
+    }
+};
+
+// Replay computation of every generated modifier of the chain
+static void ComputeStakeModifier(benchmark::State& state)
+{
+    static StakeModifierChain chain(20000);
+
+    size_t i = 0;
+    uint64_t nChecksum = 0;
+    while (state.KeepRunning())
+    {
+        const CBlockIndex* pindex = chain.vModifierBlocks[i++ % chain.vModifierBlocks.size()];
+
+        uint64_t nStakeModifier;
+        bool fGeneratedStakeModifier;
+        ComputeNextStakeModifier(pindex, nStakeModifier, fGeneratedStakeModifier);
+        nChecksum ^= nStakeModifier;
+    }
+    if (nChecksum == 1)
+        fprintf(stderr, "Unexpected checksum\n");
+}
+
+BENCHMARK(ComputeStakeModifier);
@@ -0,0 +1,35 @@
+#include "bench.h"
+#include "main.h"
+#include "txdb-leveldb.h"
+
+using namespace std;
+
+// Transaction index records, in the data directory chosen by bench_novacoin
+static void TxDBWriteIndex(benchmark::State& state)
+{
+    CTxDB txdb("cr+");
+    CTxIndex txindex(CDiskTxPos(1, 1000, 80), 2);
+
+    uint64_t n = 0;
+    while (state.KeepRunning())
+        txdb.UpdateTxIndex(uint256(++n * 0x9e3779b97f4a7c15ULL), txindex);
+}
+
+static void TxDBReadIndex(benchmark::State& state)
+{
+    const uint64_t nRecords = 10000;
+    CTxDB txdb("cr+");
+    CTxIndex txindex(CDiskTxPos(1, 1000, 80), 2);
+    for (uint64_t n = 1; n <= nRecords; n++)
+        txdb.UpdateTxIndex(uint256(n * 0x9e3779b97f4a7c15ULL), txindex);
+
+    uint64_t n = 0;
+    bool fOk = true;
+    while (state.KeepRunning())
+        fOk &= txdb.ReadTxIndex(uint256((n++ % nRecords + 1) * 0x9e3779b97f4a7c15ULL), txindex);
+    if (!fOk)
+        fprintf(stderr, "TxDBReadIndex: missing record\n");
+}
+
+BENCHMARK(TxDBWriteIndex);
+BENCHMARK(TxDBReadIndex);
@@ -255,8 +255,18 @@ std::vector<uint8_t> CBigNum::getBytes() const {
 }
 
 void CBigNum::setvch(const std::vector<uint8_t> &vch) {
-    std::vector<uint8_t> vch2(vch.size() + 4);
-    uint32_t nSize = (uint32_t) vch.size();
+    setvch(vch.data(), vch.size());
+}
+
+void CBigNum::setvch(const uint8_t* pch, size_t nSize) {
+    // Script numbers are tiny, only larger values need a heap buffer
+    uint8_t vchSmall[4 + 32];
+    std::vector<uint8_t> vchLarge;
+    uint8_t* vch2 = vchSmall;
+    if (nSize > sizeof(vchSmall) - 4) {
+        vchLarge.resize(nSize + 4);
+        vch2 = &vchLarge[0];
+    }
     // BIGNUM's byte stream format expects 4 bytes of
     // big endian size data info at the front
     vch2[0] = (nSize >> 24) & 0xff;
@@ -264,8 +274,27 @@ void CBigNum::setvch(const std::vector<uint8_t> &vch) {
     vch2[2] = (nSize >> 8) & 0xff;
     vch2[3] = (nSize >> 0) & 0xff;
     // swap data to big endian
-    std::reverse_copy(vch.begin(), vch.end(), vch2.begin() + 4);
-    BN_mpi2bn(&vch2[0], (int) vch2.size(), bn);
+    std::reverse_copy(pch, pch + nSize, vch2 + 4);
+    BN_mpi2bn(vch2, (int) (nSize + 4), bn);
+}
+
+bool CBigNum::getvch(uint8_t* pch, size_t nMaxSize, size_t& nSize) const {
+    unsigned int nMpiSize = BN_bn2mpi(bn, nullptr);
+    nSize = nMpiSize <= 4 ? 0 : nMpiSize - 4;
+    if (nSize > nMaxSize)
+        return false;
+    if (nSize == 0)
+        return true;
+    uint8_t vchSmall[4 + 32];
+    std::vector<uint8_t> vchLarge;
+    uint8_t* vch = vchSmall;
+    if (nMpiSize > sizeof(vchSmall)) {
+        vchLarge.resize(nMpiSize);
+        vch = &vchLarge[0];
+    }
+    BN_bn2mpi(bn, vch);
+    std::reverse_copy(vch + 4, vch + nMpiSize, pch);
+    return true;
 }
 
 std::vector<uint8_t> CBigNum::getvch() const {
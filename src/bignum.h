@@ -90,6 +90,9 @@ public:
     std::vector<uint8_t> getBytes() const;
     void setvch(const std::vector<uint8_t>& vch);
     std::vector<uint8_t> getvch() const;
+    // Same encoding without a temporary vector, getvch fails if the result is longer than nMaxSize
+    void setvch(const uint8_t* pch, size_t nSize);
+    bool getvch(uint8_t* pch, size_t nMaxSize, size_t& nSize) const;
     CBigNum& SetCompact(uint32_t nCompact);
     uint32_t GetCompact() const;
     void SetHex(const std::string& str);
@@ -744,7 +744,21 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
     if (strMethod == "getblocktemplate"       && n > 0) ConvertTo<Object>(params[0]);
     if (strMethod == "listsinceblock"         && n > 1) ConvertTo<int64_t>(params[1]);
 
-    if (strMethod == "scaninput"              && n > 0) ConvertTo<Object>(params[0]);
+    if (strMethod == "scaninput"              && n > 0)
+    {
+        std::string strCommand = params[0].get_str();
+        if (strCommand == "start")
+        {
+            if (n > 1) ConvertTo<Object>(params[1]);
+        }
+        else if (strCommand == "status" || strCommand == "cancel")
+        {
+            if (n > 1) ConvertTo<int64_t>(params[1]);
+            if (n > 2) ConvertTo<int64_t>(params[2]);
+        }
+        else
+            ConvertTo<Object>(params[0]);
+    }
 
     if (strMethod == "sendalert"              && n > 2) ConvertTo<int64_t>(params[2]);
     if (strMethod == "sendalert"              && n > 3) ConvertTo<int64_t>(params[3]);
@@ -6,6 +6,9 @@
 #define CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <mutex>
 #include <condition_variable>
@@ -18,141 +21,232 @@ template<typename T> class CCheckQueueControl;
 
 /** Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
-  * operator(), returning a bool.
+  * operator(), returning a bool, and swap().
   *
   * One thread (the master) is assumed to push batches of verifications
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has a queue of its own, which the master fills round-robin
+  * without locking. Workers take batches from their own queue first and
+  * steal from the others when it runs dry. Once a verification fails, the
+  * remaining ones are dropped without being evaluated.
   */
 template<typename T> class CCheckQueue {
 private:
-    // Mutex to protect the inner state
+    // Workers beyond this number share queues
+    static constexpr unsigned int nMaxQueues = 64;
+
+    // Checks are kept in chunks, allocated on first use and then reused.
+    // Anything beyond the capacity of a queue is checked by the master
+    // right away.
+    static constexpr uint32_t nChunkSize = 256;
+    static constexpr uint32_t nMaxChunks = 256;
+
+    // Queue of one worker. The master is the only one to push checks,
+    // while the owner and thieves claim them. Pushed and claimed counts
+    // share a word, so claims are a single compare-and-swap which fails
+    // if anything changed meanwhile, including the reset in Wait().
+    struct alignas(64) WorkerQueue {
+        std::atomic<uint64_t> nState{0}; // pushed << 32 | claimed
+        std::unique_ptr<T[]> vpChunks[nMaxChunks];
+
+        T& At(uint32_t n) { return vpChunks[n / nChunkSize][n % nChunkSize]; }
+    };
+
+    std::unique_ptr<WorkerQueue[]> pQueues;
+
+    // Number of worker threads that ever registered, queues go in that order
+    std::atomic<unsigned int> nWorkers;
+
+    // Next queue to push to, only used by the master
+    unsigned int nNextQueue;
+
+    // Number of verifications that were added but haven't completed yet
+    std::atomic<unsigned int> nTodo;
+
+    // The temporary evaluation result
+    std::atomic<bool> fAllOk;
+
+    // Number of workers sleeping on condWorker
+    std::atomic<int> nIdle;
+
+    // Mutex for sleeping and waking up, and to protect the fields below
     std::mutex mutex;
 
     // Worker threads block on this when out of work
     std::condition_variable condWorker;
 
-    // Master thread blocks on this when out of work
+    // Master thread blocks on this until the last checks are done
     std::condition_variable condMaster;
 
     // Quit method blocks on this until all workers are gone
     std::condition_variable condQuit;
 
-    // The queue of elements to be processed.
-    // As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
-
-    // The number of workers (including the master) that are idle.
-    int nIdle;
-
-    // The total number of workers (including the master).
+    // The number of worker threads
     int nTotal;
 
-    // The temporary evaluation result.
-    bool fAllOk;
-
-    // Number of verifications that haven't completed yet.
-    // This includes elements that are not anymore in queue, but still in
-    // worker's own batches.
-    unsigned int nTodo;
-
     // Whether we're shutting down.
     bool fQuit;
 
     // The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
-    // Internal function that does bulk of the verification work.
-    bool Loop(bool fMaster = false) {
-        std::condition_variable &cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                std::unique_lock<std::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        if (nTotal==0)
-                            condQuit.notify_one();
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                     // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                     // queue to the local batch vector instead of copying.
-                     vChecks[i].swap(queue.back());
-                     queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+    unsigned int GetQueueCount() const {
+        return std::max(1U, std::min(nWorkers.load(), nMaxQueues));
+    }
+
+    bool HasWork() const {
+        for (unsigned int i = 0, nQueues = GetQueueCount(); i < nQueues; i++) {
+            uint64_t nState = pQueues[i].nState.load();
+            if ((uint32_t)nState < (uint32_t)(nState >> 32))
+                return true;
+        }
+        return false;
+    }
+
+    // Claim a batch of checks from a queue, smaller ones as it drains so
+    // all workers finish approximately simultaneously
+    bool Claim(WorkerQueue& queue, uint32_t& nBegin, uint32_t& nCount) {
+        uint64_t nState = queue.nState.load(std::memory_order_acquire);
+        while (true) {
+            uint32_t nPushed = nState >> 32, nClaimed = (uint32_t)nState;
+            if (nClaimed >= nPushed)
+                return false;
+            nCount = std::max(1U, std::min(nBatchSize, (nPushed - nClaimed) / 2));
+            if (queue.nState.compare_exchange_weak(nState, nState + nCount, std::memory_order_acquire)) {
+                nBegin = nClaimed;
+                return true;
+            }
+        }
+    }
+
+    // Run one batch, from the given queue if it has any work, or stolen
+    // from another one
+    bool RunBatch(unsigned int nOwn) {
+        unsigned int nQueues = GetQueueCount();
+        for (unsigned int i = 0; i < nQueues; i++) {
+            WorkerQueue& queue = pQueues[(nOwn + i) % nQueues];
+            uint32_t nBegin, nCount;
+            if (!Claim(queue, nBegin, nCount))
+                continue;
+
+            for (uint32_t n = nBegin; n < nBegin + nCount; n++) {
+                // Move the check out, so whatever it holds is released now
+                T check;
+                check.swap(queue.At(n));
+                if (fAllOk.load(std::memory_order_relaxed) && !check())
+                    fAllOk.store(false, std::memory_order_relaxed);
             }
-            // execute work
-            for (T &check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
-        } while(true && !fShutdown); // HACK: force queue to shut down
+
+            if (nTodo.fetch_sub(nCount) == nCount) {
+                // We processed the last element; inform the master it can return the result
+                std::lock_guard<std::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
+            return true;
+        }
         return false;
     }
 
 public:
     // Create a new check queue
     CCheckQueue(unsigned int nBatchSizeIn) :
-        nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+        pQueues(new WorkerQueue[nMaxQueues]), nWorkers(0), nNextQueue(0), nTodo(0), fAllOk(true), nIdle(0),
+        nTotal(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
 
     // Worker thread
     void Thread() {
-        Loop();
+        unsigned int nOwn = nWorkers++ % nMaxQueues;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            nTotal++;
+        }
+
+        while (!fShutdown) { // HACK: force queue to shut down
+            if (RunBatch(nOwn))
+                continue;
+
+            std::unique_lock<std::mutex> lock(mutex);
+            if (fQuit)
+                break;
+            // The master checks nIdle after publishing work, so either it
+            // wakes us up or we see the work here
+            nIdle++;
+            while (!fQuit && !HasWork())
+                condWorker.wait(lock);
+            nIdle--;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--nTotal == 0)
+            condQuit.notify_all();
     }
 
     // Wait until execution finishes, and return whether all evaluations where succesful.
     bool Wait() {
-        return Loop(true);
+        while (RunBatch(nNextQueue % GetQueueCount()))
+            ;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condMaster.wait(lock, [this] { return nTodo.load() == 0; });
+        }
+
+        // Every check was claimed and processed, start over for new work
+        for (unsigned int i = 0, nQueues = GetQueueCount(); i < nQueues; i++)
+            pQueues[i].nState.store(0);
+
+        // reset the status for new work later, and return the current one
+        return fAllOk.exchange(true);
     }
 
     // Add a batch of checks to the queue
     void Add(std::vector<T> &vChecks) {
-        std::unique_lock<std::mutex> lock(mutex);
+        // The result is known already
+        if (vChecks.empty() || !fAllOk.load(std::memory_order_relaxed))
+            return;
+
+        // Count the checks before they become visible, so that workers
+        // can't finish them all while the rest is still being added
+        nTodo += vChecks.size();
+
+        unsigned int nQueues = GetQueueCount();
+        uint32_t vnAdded[nMaxQueues] = {};
         for (T &check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+            unsigned int nQueue = nNextQueue++ % nQueues;
+            WorkerQueue& queue = pQueues[nQueue];
+            uint32_t nIndex = (uint32_t)(queue.nState.load(std::memory_order_relaxed) >> 32) + vnAdded[nQueue];
+            if (nIndex >= nChunkSize * nMaxChunks) {
+                if (!check())
+                    fAllOk.store(false, std::memory_order_relaxed);
+                nTodo--;
+                continue;
+            }
+
+            std::unique_ptr<T[]>& pChunk = queue.vpChunks[nIndex / nChunkSize];
+            if (!pChunk)
+                pChunk.reset(new T[nChunkSize]);
+            check.swap(queue.At(nIndex));
+            vnAdded[nQueue]++;
+        }
+
+        uint32_t nAdded = 0;
+        for (unsigned int i = 0; i < nQueues; i++) {
+            if (vnAdded[i])
+                pQueues[i].nState.fetch_add((uint64_t)vnAdded[i] << 32);
+            nAdded += vnAdded[i];
+        }
+
+        if (nAdded && nIdle.load() > 0) {
+            // Sleeping workers either wait already or haven't checked for work yet
+            { std::lock_guard<std::mutex> lock(mutex); }
+            if (nAdded == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
         }
-        nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
     }
 
     // Shut the queue down
@@ -161,7 +255,7 @@ public:
         fQuit = true;
         // No need to wake the master, as he will quit automatically when all jobs are
         // done.
-        condWorker.notify_all(); 
+        condWorker.notify_all();
 
         while (nTotal > 0)
             condQuit.wait(lock);
@@ -173,8 +267,7 @@ public:
 
     bool IsIdle()
     {
-        std::unique_lock<std::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return nTodo.load() == 0 && fAllOk.load() && !HasWork();
     }
 };
 
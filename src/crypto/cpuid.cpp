@@ -0,0 +1,78 @@
+#include "cpuid.h"
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HAVE_X86_CPUID
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef HAVE_X86_CPUID
+static void CPUID(uint32_t nLeaf, uint32_t nSubLeaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuidex(regs, nLeaf, nSubLeaf);
+    a = regs[0]; b = regs[1]; c = regs[2]; d = regs[3];
+#else
+    __cpuid_count(nLeaf, nSubLeaf, a, b, c, d);
+#endif
+}
+
+static uint64_t XGETBV()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t a, d;
+    __asm__ volatile ("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return ((uint64_t)d << 32) | a;
+#endif
+}
+#endif
+
+static CPUFeatures DetectCPUFeatures()
+{
+    CPUFeatures features = { false, false, false, false, false, false, false };
+
+#ifdef HAVE_X86_CPUID
+    uint32_t a, b, c, d;
+    CPUID(0, 0, a, b, c, d);
+    uint32_t nMaxLeaf = a;
+    if (nMaxLeaf < 1)
+        return features;
+
+    CPUID(1, 0, a, b, c, d);
+    features.fSSE2 = (d >> 26) & 1;
+    features.fSSSE3 = (c >> 9) & 1;
+    features.fSSE41 = (c >> 19) & 1;
+
+    // OS must save and restore YMM (and ZMM) registers
+    bool fOSXSAVE = (c >> 27) & 1;
+    uint64_t nXCR0 = fOSXSAVE ? XGETBV() : 0;
+    bool fAVXState = (nXCR0 & 0x06) == 0x06;
+    bool fAVX512State = (nXCR0 & 0xe6) == 0xe6;
+
+    if (nMaxLeaf >= 7)
+    {
+        CPUID(7, 0, a, b, c, d);
+        features.fAVX2 = fAVXState && ((b >> 5) & 1);
+        features.fAVX512F = fAVX512State && ((b >> 16) & 1);
+        features.fSHA = (b >> 29) & 1;
+    }
+#elif defined(__ARM_NEON)
+    features.fNEON = true;
+#endif
+
+    return features;
+}
+
+const CPUFeatures& GetCPUFeatures()
+{
+    static const CPUFeatures features = DetectCPUFeatures();
+    return features;
+}
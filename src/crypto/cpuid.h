@@ -0,0 +1,23 @@
+#ifndef NOVACOIN_CPUID_H
+#define NOVACOIN_CPUID_H
+
+// Instruction set extensions available at runtime.
+//
+// Both CPU and OS support are required: AVX state must be enabled
+// by the operating system through XCR0 before AVX2 and AVX-512
+// instructions can be used.
+struct CPUFeatures
+{
+    bool fSSE2;
+    bool fSSSE3;
+    bool fSSE41;
+    bool fAVX2;
+    bool fAVX512F;
+    bool fSHA;
+    bool fNEON;
+};
+
+// Detect CPU features once and return cached result
+const CPUFeatures& GetCPUFeatures();
+
+#endif // NOVACOIN_CPUID_H
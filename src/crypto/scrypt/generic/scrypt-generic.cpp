@@ -30,6 +30,7 @@
 #include "scrypt.h"
 
 #include <openssl/evp.h>
+#include <string.h>
 
 #ifdef _MSC_VER
 #define INLINE __inline
@@ -111,7 +112,7 @@ static INLINE void xor_salsa8(uint32_t B[16], const uint32_t Bx[16])
    scratchpad size needs to be at least 63 + (128 * r * p) + (256 * r + 64) + (128 * r * N) bytes
    r = 1, p = 1, N = 1024
  */
-uint256 scrypt_blockhash(const uint8_t* input)
+uint256 scrypt_blockhash_generic(const uint8_t* input)
 {
     uint8_t scratchpad[SCRYPT_BUFFER_SIZE];
     uint32_t X[32];
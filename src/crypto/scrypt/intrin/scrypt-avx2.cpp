@@ -0,0 +1,37 @@
+#include <immintrin.h>
+
+#include "scrypt-lanes-impl.h"
+
+namespace {
+
+struct AVX2
+{
+    typedef __m256i V;
+    static const int S = 2;
+
+    static inline V Add(V a, V b) { return _mm256_add_epi32(a, b); }
+    static inline V Xor(V a, V b) { return _mm256_xor_si256(a, b); }
+    template<int n> static inline V Rol(V x) { return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n)); }
+    template<int imm> static inline V Shuffle(V x) { return _mm256_shuffle_epi32(x, imm); }
+
+    static inline V Load(const uint32_t *const *p)
+    {
+        __m128i lo = _mm_load_si128((const __m128i *)p[0]);
+        __m128i hi = _mm_load_si128((const __m128i *)p[1]);
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    }
+
+    static inline void Store(uint32_t *const *p, V x)
+    {
+        _mm_store_si128((__m128i *)p[0], _mm256_castsi256_si128(x));
+        _mm_store_si128((__m128i *)p[1], _mm256_extracti128_si256(x, 1));
+    }
+};
+
+} // namespace
+
+// Two vectors of two states each, like the SSE2 back end
+void scrypt_blockhash_lanes_avx2(const uint8_t *const *inputs, uint256 *outputs, void *scratchpad)
+{
+    ScryptLanes<AVX2, 2>::Hash(inputs, outputs, scratchpad);
+}
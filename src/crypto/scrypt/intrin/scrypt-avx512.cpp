@@ -0,0 +1,39 @@
+#include <immintrin.h>
+
+#include "scrypt-lanes-impl.h"
+
+namespace {
+
+struct AVX512
+{
+    typedef __m512i V;
+    static const int S = 4;
+
+    static inline V Add(V a, V b) { return _mm512_add_epi32(a, b); }
+    static inline V Xor(V a, V b) { return _mm512_xor_si512(a, b); }
+    template<int n> static inline V Rol(V x) { return _mm512_rol_epi32(x, n); }
+    template<int imm> static inline V Shuffle(V x) { return _mm512_shuffle_epi32(x, (_MM_PERM_ENUM)imm); }
+
+    static inline V Load(const uint32_t *const *p)
+    {
+        V x = _mm512_castsi128_si512(_mm_load_si128((const __m128i *)p[0]));
+        x = _mm512_inserti32x4(x, _mm_load_si128((const __m128i *)p[1]), 1);
+        x = _mm512_inserti32x4(x, _mm_load_si128((const __m128i *)p[2]), 2);
+        return _mm512_inserti32x4(x, _mm_load_si128((const __m128i *)p[3]), 3);
+    }
+
+    static inline void Store(uint32_t *const *p, V x)
+    {
+        _mm_store_si128((__m128i *)p[0], _mm512_castsi512_si128(x));
+        _mm_store_si128((__m128i *)p[1], _mm512_extracti32x4_epi32(x, 1));
+        _mm_store_si128((__m128i *)p[2], _mm512_extracti32x4_epi32(x, 2));
+        _mm_store_si128((__m128i *)p[3], _mm512_extracti32x4_epi32(x, 3));
+    }
+};
+
+} // namespace
+
+void scrypt_blockhash_lanes_avx512(const uint8_t *const *inputs, uint256 *outputs, void *scratchpad)
+{
+    ScryptLanes<AVX512, 2>::Hash(inputs, outputs, scratchpad);
+}
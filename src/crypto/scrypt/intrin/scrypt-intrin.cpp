@@ -33,25 +33,7 @@
 #include <emmintrin.h>
 #endif
 
-#include "scrypt.h"
-
-#include <openssl/evp.h>
-
-static inline uint32_t le32dec(const void *pp)
-{
-    const uint8_t *p = (uint8_t const *)pp;
-    return ((uint32_t)(p[0]) + ((uint32_t)(p[1]) << 8) +
-    ((uint32_t)(p[2]) << 16) + ((uint32_t)(p[3]) << 24));
-}
-
-static inline void le32enc(void *pp, uint32_t x)
-{
-    uint8_t *p = (uint8_t *)pp;
-    p[0] = x & 0xff;
-    p[1] = (x >> 8) & 0xff;
-    p[2] = (x >> 16) & 0xff;
-    p[3] = (x >> 24) & 0xff;
-}
+#include "scrypt-lanes-impl.h"
 
 static inline void xor_salsa8_sse2(__m128i B[4], const __m128i Bx[4])
 {
@@ -106,7 +88,7 @@ static inline void xor_salsa8_sse2(__m128i B[4], const __m128i Bx[4])
     B[3] = _mm_add_epi32(B[3], X3);
 }
 
-uint256 scrypt_blockhash(const uint8_t* input)
+uint256 scrypt_blockhash_sse2(const uint8_t* input)
 {
     uint8_t scratchpad[SCRYPT_BUFFER_SIZE];
     __m128i *V = (__m128i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
@@ -151,3 +133,26 @@ uint256 scrypt_blockhash(const uint8_t* input)
 
     return result;
 }
+
+namespace {
+
+struct SSE2
+{
+    typedef __m128i V;
+    static const int S = 1;
+
+    static inline V Add(V a, V b) { return _mm_add_epi32(a, b); }
+    static inline V Xor(V a, V b) { return _mm_xor_si128(a, b); }
+    template<int n> static inline V Rol(V x) { return _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n)); }
+    template<int imm> static inline V Shuffle(V x) { return _mm_shuffle_epi32(x, imm); }
+    static inline V Load(const uint32_t *const *p) { return _mm_load_si128((const __m128i *)p[0]); }
+    static inline void Store(uint32_t *const *p, V x) { _mm_store_si128((__m128i *)p[0], x); }
+};
+
+} // namespace
+
+/* Two interleaved states fit into 16 SSE registers, more of them are slower */
+void scrypt_blockhash_lanes_sse2(const uint8_t *const *inputs, uint256 *outputs, void *scratchpad)
+{
+    ScryptLanes<SSE2, 2>::Hash(inputs, outputs, scratchpad);
+}
@@ -0,0 +1,194 @@
+// Shared body of the multi-buffer scrypt back ends.
+//
+// This file is included by translation units built with different
+// instruction set flags. Everything here must have internal linkage,
+// otherwise the linker is free to pick e.g. AVX2 version of an inline
+// function for a caller which runs on a CPU without AVX2.
+//
+// Including translation unit defines the instruction set traits class
+// with vector type V and primitive operations. Every vector holds S
+// independent salsa20/8 rows of 128 bits, one in each 128-bit part,
+// so the row shuffles of salsa20/8 never cross the parts.
+
+#ifndef NOVACOIN_SCRYPT_LANES_IMPL_H
+#define NOVACOIN_SCRYPT_LANES_IMPL_H
+
+#include "scrypt.h"
+
+#include <openssl/evp.h>
+
+namespace {
+
+inline uint32_t le32dec(const void *pp)
+{
+    const uint8_t *p = (uint8_t const *)pp;
+    return ((uint32_t)(p[0]) + ((uint32_t)(p[1]) << 8) +
+    ((uint32_t)(p[2]) << 16) + ((uint32_t)(p[3]) << 24));
+}
+
+inline void le32enc(void *pp, uint32_t x)
+{
+    uint8_t *p = (uint8_t *)pp;
+    p[0] = x & 0xff;
+    p[1] = (x >> 8) & 0xff;
+    p[2] = (x >> 16) & 0xff;
+    p[3] = (x >> 24) & 0xff;
+}
+
+// N vectors of T::S states each, instructions of all vectors are
+// interleaved to hide latencies of dependent salsa operations
+template<typename T, int N>
+struct ScryptLanes
+{
+    typedef typename T::V V;
+
+    // Number of headers hashed at once
+    static const int H = N * T::S;
+
+    // Scratchpad size, without alignment
+    static const size_t SCRATCHPAD_SIZE = (size_t)H * 1024 * 128;
+
+    // xor_salsa8 of B = X[n][b..b+3] and Bx = X[n][bx..bx+3]
+    static inline void XorSalsa8(V X[N][8], int b, int bx)
+    {
+        V X0[N], X1[N], X2[N], X3[N], Y[N];
+        int n;
+
+        for (n = 0; n < N; n++) {
+            X0[n] = X[n][b + 0] = T::Xor(X[n][b + 0], X[n][bx + 0]);
+            X1[n] = X[n][b + 1] = T::Xor(X[n][b + 1], X[n][bx + 1]);
+            X2[n] = X[n][b + 2] = T::Xor(X[n][b + 2], X[n][bx + 2]);
+            X3[n] = X[n][b + 3] = T::Xor(X[n][b + 3], X[n][bx + 3]);
+        }
+
+        for (uint32_t i = 0; i < 8; i += 2) {
+            /* Operate on "columns". */
+            for (n = 0; n < N; n++) Y[n] = T::Add(X0[n], X3[n]);
+            for (n = 0; n < N; n++) X1[n] = T::Xor(X1[n], T::template Rol<7>(Y[n]));
+            for (n = 0; n < N; n++) Y[n] = T::Add(X1[n], X0[n]);
+            for (n = 0; n < N; n++) X2[n] = T::Xor(X2[n], T::template Rol<9>(Y[n]));
+            for (n = 0; n < N; n++) Y[n] = T::Add(X2[n], X1[n]);
+            for (n = 0; n < N; n++) X3[n] = T::Xor(X3[n], T::template Rol<13>(Y[n]));
+            for (n = 0; n < N; n++) Y[n] = T::Add(X3[n], X2[n]);
+            for (n = 0; n < N; n++) X0[n] = T::Xor(X0[n], T::template Rol<18>(Y[n]));
+
+            /* Rearrange data. */
+            for (n = 0; n < N; n++) {
+                X1[n] = T::template Shuffle<0x93>(X1[n]);
+                X2[n] = T::template Shuffle<0x4E>(X2[n]);
+                X3[n] = T::template Shuffle<0x39>(X3[n]);
+            }
+
+            /* Operate on "rows". */
+            for (n = 0; n < N; n++) Y[n] = T::Add(X0[n], X1[n]);
+            for (n = 0; n < N; n++) X3[n] = T::Xor(X3[n], T::template Rol<7>(Y[n]));
+            for (n = 0; n < N; n++) Y[n] = T::Add(X3[n], X0[n]);
+            for (n = 0; n < N; n++) X2[n] = T::Xor(X2[n], T::template Rol<9>(Y[n]));
+            for (n = 0; n < N; n++) Y[n] = T::Add(X2[n], X3[n]);
+            for (n = 0; n < N; n++) X1[n] = T::Xor(X1[n], T::template Rol<13>(Y[n]));
+            for (n = 0; n < N; n++) Y[n] = T::Add(X1[n], X2[n]);
+            for (n = 0; n < N; n++) X0[n] = T::Xor(X0[n], T::template Rol<18>(Y[n]));
+
+            /* Rearrange data. */
+            for (n = 0; n < N; n++) {
+                X1[n] = T::template Shuffle<0x39>(X1[n]);
+                X2[n] = T::template Shuffle<0x4E>(X2[n]);
+                X3[n] = T::template Shuffle<0x93>(X3[n]);
+            }
+        }
+
+        for (n = 0; n < N; n++) {
+            X[n][b + 0] = T::Add(X[n][b + 0], X0[n]);
+            X[n][b + 1] = T::Add(X[n][b + 1], X1[n]);
+            X[n][b + 2] = T::Add(X[n][b + 2], X2[n]);
+            X[n][b + 3] = T::Add(X[n][b + 3], X3[n]);
+        }
+    }
+
+    // Hash H headers, scratchpad must be 64-byte aligned and SCRATCHPAD_SIZE bytes long.
+    //
+    // Row i of vector n occupies 8 vectors at V[(n * 1024 + i) * 8], so the
+    // first loop stores whole vectors, and the second one gathers 128-bit
+    // parts of different rows for each packed state.
+    static void Hash(const uint8_t *const *inputs, uint256 *outputs, void *scratchpad)
+    {
+        V *Vp = (V *)scratchpad;
+        alignas(64) uint32_t W[H][32];
+        uint8_t B[128];
+        V X[N][8];
+        uint32_t i, k;
+        int n, s;
+
+        for (n = 0; n < H; n++) {
+            void *const tmp = const_cast<uint8_t*>(inputs[n]);
+            PKCS5_PBKDF2_HMAC(static_cast<const char*>(tmp), 80, inputs[n], 80, 1, EVP_sha256(), 128, B);
+            for (k = 0; k < 2; k++) {
+                for (i = 0; i < 16; i++) {
+                    W[n][k * 16 + i] = le32dec(&B[(k * 16 + (i * 5 % 16)) * 4]);
+                }
+            }
+        }
+
+        for (n = 0; n < N; n++) {
+            for (k = 0; k < 8; k++) {
+                const uint32_t *p[T::S];
+                for (s = 0; s < T::S; s++)
+                    p[s] = &W[n * T::S + s][k * 4];
+                X[n][k] = T::Load(p);
+            }
+        }
+
+        for (i = 0; i < 1024; i++) {
+            for (n = 0; n < N; n++)
+                for (k = 0; k < 8; k++)
+                    Vp[(n * 1024 + i) * 8 + k] = X[n][k];
+            XorSalsa8(X, 0, 4);
+            XorSalsa8(X, 4, 0);
+        }
+        for (i = 0; i < 1024; i++) {
+            for (n = 0; n < N; n++) {
+                alignas(64) uint32_t x16[T::S * 4];
+                uint32_t *q[T::S];
+                for (s = 0; s < T::S; s++)
+                    q[s] = &x16[s * 4];
+                T::Store(q, X[n][4]);
+
+                const uint32_t *p[T::S];
+                for (s = 0; s < T::S; s++)
+                    p[s] = (const uint32_t *)&Vp[(n * 1024 + (x16[s * 4] & 1023)) * 8] + s * 4;
+                for (k = 0; k < 8; k++) {
+                    X[n][k] = T::Xor(X[n][k], T::Load(p));
+                    for (s = 0; s < T::S; s++)
+                        p[s] += T::S * 4;
+                }
+            }
+            XorSalsa8(X, 0, 4);
+            XorSalsa8(X, 4, 0);
+        }
+
+        for (n = 0; n < N; n++) {
+            for (k = 0; k < 8; k++) {
+                uint32_t *q[T::S];
+                for (s = 0; s < T::S; s++)
+                    q[s] = &W[n * T::S + s][k * 4];
+                T::Store(q, X[n][k]);
+            }
+        }
+
+        for (n = 0; n < H; n++) {
+            for (k = 0; k < 2; k++) {
+                for (i = 0; i < 16; i++) {
+                    le32enc(&B[(k * 16 + (i * 5 % 16)) * 4], W[n][k * 16 + i]);
+                }
+            }
+
+            void *const tmp = const_cast<uint8_t*>(inputs[n]);
+            outputs[n] = 0;
+            PKCS5_PBKDF2_HMAC(static_cast<const char*>(tmp), 80, B, 128, 1, EVP_sha256(), 32, (unsigned char*)&outputs[n]);
+        }
+    }
+};
+
+} // namespace
+
+#endif // NOVACOIN_SCRYPT_LANES_IMPL_H
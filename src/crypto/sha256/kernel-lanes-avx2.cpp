@@ -0,0 +1,33 @@
+#include <immintrin.h>
+
+#include "kernel-lanes-impl.h"
+
+namespace {
+
+struct AVX2
+{
+    typedef __m256i V;
+    static const int N = 8;
+
+    static inline V Add(V a, V b) { return _mm256_add_epi32(a, b); }
+    static inline V Xor(V a, V b) { return _mm256_xor_si256(a, b); }
+    template<int n> static inline V Shr(V x) { return _mm256_srli_epi32(x, n); }
+    template<int n> static inline V Ror(V x) { return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n)); }
+    static inline V Ch(V e, V f, V g) { return _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g))); }
+    static inline V Maj(V a, V b, V c) { return _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b))); }
+    static inline V Set1(uint32_t x) { return _mm256_set1_epi32((int)x); }
+    static inline V Load(const uint32_t* p) { return _mm256_load_si256((const __m256i*)p); }
+    static inline void Store(uint32_t* p, V x) { _mm256_storeu_si256((__m256i*)p, x); }
+};
+
+} // namespace
+
+void KernelHash_avx2(const KernelMidstate& midstate, uint32_t nTimeTx, int32_t nStep, uint32_t* pOut)
+{
+    KernelLanes<AVX2>::Hash(midstate, nTimeTx, nStep, pOut);
+}
+
+void SHA256D64_avx2(unsigned char* pOut, const unsigned char* pIn)
+{
+    KernelLanes<AVX2>::HashD64(pOut, pIn);
+}
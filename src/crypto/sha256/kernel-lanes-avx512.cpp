@@ -0,0 +1,33 @@
+#include <immintrin.h>
+
+#include "kernel-lanes-impl.h"
+
+namespace {
+
+struct AVX512
+{
+    typedef __m512i V;
+    static const int N = 16;
+
+    static inline V Add(V a, V b) { return _mm512_add_epi32(a, b); }
+    static inline V Xor(V a, V b) { return _mm512_xor_si512(a, b); }
+    template<int n> static inline V Shr(V x) { return _mm512_srli_epi32(x, n); }
+    template<int n> static inline V Ror(V x) { return _mm512_ror_epi32(x, n); }
+    static inline V Ch(V e, V f, V g) { return _mm512_ternarylogic_epi32(e, f, g, 0xca); }
+    static inline V Maj(V a, V b, V c) { return _mm512_ternarylogic_epi32(a, b, c, 0xe8); }
+    static inline V Set1(uint32_t x) { return _mm512_set1_epi32((int)x); }
+    static inline V Load(const uint32_t* p) { return _mm512_load_si512((const void*)p); }
+    static inline void Store(uint32_t* p, V x) { _mm512_storeu_si512((void*)p, x); }
+};
+
+} // namespace
+
+void KernelHash_avx512(const KernelMidstate& midstate, uint32_t nTimeTx, int32_t nStep, uint32_t* pOut)
+{
+    KernelLanes<AVX512>::Hash(midstate, nTimeTx, nStep, pOut);
+}
+
+void SHA256D64_avx512(unsigned char* pOut, const unsigned char* pIn)
+{
+    KernelLanes<AVX512>::HashD64(pOut, pIn);
+}
@@ -0,0 +1,268 @@
+// Shared body of the multi-lane kernel engines, which also do double
+// hashing of 64-byte inputs for merkle trees.
+//
+// This file is included by translation units built with different
+// instruction set flags. Everything here must have internal linkage,
+// otherwise the linker is free to pick e.g. AVX2 version of an inline
+// function for a caller which runs on a CPU without AVX2.
+//
+// Including translation unit defines the instruction set traits class
+// with vector type V, lane count N and primitive operations.
+
+#ifndef NOVACOIN_KERNEL_LANES_IMPL_H
+#define NOVACOIN_KERNEL_LANES_IMPL_H
+
+#include "kernel-lanes.h"
+
+namespace {
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+inline uint32_t ReadBE32(const unsigned char* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+inline void WriteBE32(unsigned char* p, uint32_t x)
+{
+    p[0] = x >> 24; p[1] = x >> 16; p[2] = x >> 8; p[3] = x;
+}
+
+inline uint32_t Ror32(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+// Message of the second block of 64-byte input is the padding only,
+// so round constants and message schedule can be added once
+struct Padding64Schedule
+{
+    uint32_t KW[64];
+
+    Padding64Schedule()
+    {
+        uint32_t w[64] = { 0x80000000, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 64 * 8 };
+        for (int i = 16; i < 64; i++)
+            w[i] = (Ror32(w[i - 2], 17) ^ Ror32(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7] +
+                   (Ror32(w[i - 15], 7) ^ Ror32(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+        for (int i = 0; i < 64; i++)
+            KW[i] = K[i] + w[i];
+    }
+};
+
+template<typename T>
+struct KernelLanes
+{
+    typedef typename T::V V;
+
+    static inline V Add(V a, V b) { return T::Add(a, b); }
+    static inline V Add(V a, V b, V c) { return T::Add(T::Add(a, b), c); }
+    static inline V Add(V a, V b, V c, V d) { return T::Add(T::Add(a, b), T::Add(c, d)); }
+
+    static inline V Sigma0(V x) { return T::Xor(T::Xor(T::template Ror<2>(x), T::template Ror<13>(x)), T::template Ror<22>(x)); }
+    static inline V Sigma1(V x) { return T::Xor(T::Xor(T::template Ror<6>(x), T::template Ror<11>(x)), T::template Ror<25>(x)); }
+    static inline V sigma0(V x) { return T::Xor(T::Xor(T::template Ror<7>(x), T::template Ror<18>(x)), T::template Shr<3>(x)); }
+    static inline V sigma1(V x) { return T::Xor(T::Xor(T::template Ror<17>(x), T::template Ror<19>(x)), T::template Shr<10>(x)); }
+
+    // One round, kw is a sum of round constant and message word
+    static inline void Round(V a, V b, V c, V& d, V e, V f, V g, V& h, V kw)
+    {
+        V t1 = Add(h, Sigma1(e), T::Ch(e, f, g), kw);
+        V t2 = Add(Sigma0(a), T::Maj(a, b, c));
+        d = Add(d, t1);
+        h = Add(t1, t2);
+    }
+
+    // Message schedule for the word i of the current 16-word window
+    static inline V Expand(V* w, int i)
+    {
+        return w[i & 15] = Add(sigma1(w[(i + 14) & 15]), w[(i + 9) & 15], sigma0(w[(i + 1) & 15]), w[i & 15]);
+    }
+
+    // Rounds 16..63 of compression
+    static inline void Rounds16to63(V& a, V& b, V& c, V& d, V& e, V& f, V& g, V& h, V* w)
+    {
+        for (int i = 16; i < 64; i += 16)
+        {
+            Round(a, b, c, d, e, f, g, h, Add(T::Set1(K[i + 0]), Expand(w, 0)));
+            Round(h, a, b, c, d, e, f, g, Add(T::Set1(K[i + 1]), Expand(w, 1)));
+            Round(g, h, a, b, c, d, e, f, Add(T::Set1(K[i + 2]), Expand(w, 2)));
+            Round(f, g, h, a, b, c, d, e, Add(T::Set1(K[i + 3]), Expand(w, 3)));
+            Round(e, f, g, h, a, b, c, d, Add(T::Set1(K[i + 4]), Expand(w, 4)));
+            Round(d, e, f, g, h, a, b, c, Add(T::Set1(K[i + 5]), Expand(w, 5)));
+            Round(c, d, e, f, g, h, a, b, Add(T::Set1(K[i + 6]), Expand(w, 6)));
+            Round(b, c, d, e, f, g, h, a, Add(T::Set1(K[i + 7]), Expand(w, 7)));
+            Round(a, b, c, d, e, f, g, h, Add(T::Set1(K[i + 8]), Expand(w, 8)));
+            Round(h, a, b, c, d, e, f, g, Add(T::Set1(K[i + 9]), Expand(w, 9)));
+            Round(g, h, a, b, c, d, e, f, Add(T::Set1(K[i + 10]), Expand(w, 10)));
+            Round(f, g, h, a, b, c, d, e, Add(T::Set1(K[i + 11]), Expand(w, 11)));
+            Round(e, f, g, h, a, b, c, d, Add(T::Set1(K[i + 12]), Expand(w, 12)));
+            Round(d, e, f, g, h, a, b, c, Add(T::Set1(K[i + 13]), Expand(w, 13)));
+            Round(c, d, e, f, g, h, a, b, Add(T::Set1(K[i + 14]), Expand(w, 14)));
+            Round(b, c, d, e, f, g, h, a, Add(T::Set1(K[i + 15]), Expand(w, 15)));
+        }
+    }
+
+    static void Hash(const KernelMidstate& midstate, uint32_t nTimeTx, int32_t nStep, uint32_t* pOut)
+    {
+        // Per-lane timestamps as big-endian message word
+        alignas(64) uint32_t times[T::N];
+        for (int i = 0; i < T::N; i++)
+        {
+            uint32_t t = nTimeTx + (uint32_t)(nStep * i);
+            times[i] = (t >> 24) | ((t >> 8) & 0x0000ff00) | ((t << 8) & 0x00ff0000) | (t << 24);
+        }
+
+        V w[16];
+        for (int i = 0; i < 6; i++)
+            w[i] = T::Set1(midstate.W[i]);
+        w[6] = T::Load(times);
+        w[7] = T::Set1(0x80000000);
+        for (int i = 8; i < 15; i++)
+            w[i] = T::Set1(0);
+        w[15] = T::Set1(28 * 8);
+
+        // First compression, resume after the shared rounds
+        V a = T::Set1(midstate.state[0]), b = T::Set1(midstate.state[1]);
+        V c = T::Set1(midstate.state[2]), d = T::Set1(midstate.state[3]);
+        V e = T::Set1(midstate.state[4]), f = T::Set1(midstate.state[5]);
+        V g = T::Set1(midstate.state[6]), h = T::Set1(midstate.state[7]);
+
+        Round(c, d, e, f, g, h, a, b, Add(T::Set1(K[6]), w[6]));
+        Round(b, c, d, e, f, g, h, a, T::Set1(K[7] + 0x80000000));
+        Round(a, b, c, d, e, f, g, h, T::Set1(K[8]));
+        Round(h, a, b, c, d, e, f, g, T::Set1(K[9]));
+        Round(g, h, a, b, c, d, e, f, T::Set1(K[10]));
+        Round(f, g, h, a, b, c, d, e, T::Set1(K[11]));
+        Round(e, f, g, h, a, b, c, d, T::Set1(K[12]));
+        Round(d, e, f, g, h, a, b, c, T::Set1(K[13]));
+        Round(c, d, e, f, g, h, a, b, T::Set1(K[14]));
+        Round(b, c, d, e, f, g, h, a, T::Set1(K[15] + 28 * 8));
+        Rounds16to63(a, b, c, d, e, f, g, h, w);
+
+        // Intermediate hash becomes the message of second compression
+        w[0] = Add(a, T::Set1(IV[0])); w[1] = Add(b, T::Set1(IV[1]));
+        w[2] = Add(c, T::Set1(IV[2])); w[3] = Add(d, T::Set1(IV[3]));
+        w[4] = Add(e, T::Set1(IV[4])); w[5] = Add(f, T::Set1(IV[5]));
+        w[6] = Add(g, T::Set1(IV[6])); w[7] = Add(h, T::Set1(IV[7]));
+        Hash32(w);
+
+        for (int i = 0; i < 8; i++)
+            T::Store(pOut + i * T::N, w[i]);
+    }
+
+    // Hash of 32-byte message w[0..7], the result replaces w[0..7]
+    static inline void Hash32(V* w)
+    {
+        w[8] = T::Set1(0x80000000);
+        for (int i = 9; i < 15; i++)
+            w[i] = T::Set1(0);
+        w[15] = T::Set1(32 * 8);
+
+        V a = T::Set1(IV[0]), b = T::Set1(IV[1]), c = T::Set1(IV[2]), d = T::Set1(IV[3]);
+        V e = T::Set1(IV[4]), f = T::Set1(IV[5]), g = T::Set1(IV[6]), h = T::Set1(IV[7]);
+
+        Round(a, b, c, d, e, f, g, h, Add(T::Set1(K[0]), w[0]));
+        Round(h, a, b, c, d, e, f, g, Add(T::Set1(K[1]), w[1]));
+        Round(g, h, a, b, c, d, e, f, Add(T::Set1(K[2]), w[2]));
+        Round(f, g, h, a, b, c, d, e, Add(T::Set1(K[3]), w[3]));
+        Round(e, f, g, h, a, b, c, d, Add(T::Set1(K[4]), w[4]));
+        Round(d, e, f, g, h, a, b, c, Add(T::Set1(K[5]), w[5]));
+        Round(c, d, e, f, g, h, a, b, Add(T::Set1(K[6]), w[6]));
+        Round(b, c, d, e, f, g, h, a, Add(T::Set1(K[7]), w[7]));
+        Round(a, b, c, d, e, f, g, h, T::Set1(K[8] + 0x80000000));
+        Round(h, a, b, c, d, e, f, g, T::Set1(K[9]));
+        Round(g, h, a, b, c, d, e, f, T::Set1(K[10]));
+        Round(f, g, h, a, b, c, d, e, T::Set1(K[11]));
+        Round(e, f, g, h, a, b, c, d, T::Set1(K[12]));
+        Round(d, e, f, g, h, a, b, c, T::Set1(K[13]));
+        Round(c, d, e, f, g, h, a, b, T::Set1(K[14]));
+        Round(b, c, d, e, f, g, h, a, T::Set1(K[15] + 32 * 8));
+        Rounds16to63(a, b, c, d, e, f, g, h, w);
+
+        w[0] = Add(a, T::Set1(IV[0])); w[1] = Add(b, T::Set1(IV[1]));
+        w[2] = Add(c, T::Set1(IV[2])); w[3] = Add(d, T::Set1(IV[3]));
+        w[4] = Add(e, T::Set1(IV[4])); w[5] = Add(f, T::Set1(IV[5]));
+        w[6] = Add(g, T::Set1(IV[6])); w[7] = Add(h, T::Set1(IV[7]));
+    }
+
+    // SHA256(SHA256(x)) of N 64-byte inputs, pOut gets 32 bytes for each
+    static void HashD64(unsigned char* pOut, const unsigned char* pIn)
+    {
+        static const Padding64Schedule padding;
+
+        alignas(64) uint32_t words[16][T::N];
+        for (int j = 0; j < T::N; j++)
+            for (int i = 0; i < 16; i++)
+                words[i][j] = ReadBE32(pIn + 64 * j + 4 * i);
+
+        V w[16];
+        for (int i = 0; i < 16; i++)
+            w[i] = T::Load(words[i]);
+
+        V a = T::Set1(IV[0]), b = T::Set1(IV[1]), c = T::Set1(IV[2]), d = T::Set1(IV[3]);
+        V e = T::Set1(IV[4]), f = T::Set1(IV[5]), g = T::Set1(IV[6]), h = T::Set1(IV[7]);
+
+        Round(a, b, c, d, e, f, g, h, Add(T::Set1(K[0]), w[0]));
+        Round(h, a, b, c, d, e, f, g, Add(T::Set1(K[1]), w[1]));
+        Round(g, h, a, b, c, d, e, f, Add(T::Set1(K[2]), w[2]));
+        Round(f, g, h, a, b, c, d, e, Add(T::Set1(K[3]), w[3]));
+        Round(e, f, g, h, a, b, c, d, Add(T::Set1(K[4]), w[4]));
+        Round(d, e, f, g, h, a, b, c, Add(T::Set1(K[5]), w[5]));
+        Round(c, d, e, f, g, h, a, b, Add(T::Set1(K[6]), w[6]));
+        Round(b, c, d, e, f, g, h, a, Add(T::Set1(K[7]), w[7]));
+        Round(a, b, c, d, e, f, g, h, Add(T::Set1(K[8]), w[8]));
+        Round(h, a, b, c, d, e, f, g, Add(T::Set1(K[9]), w[9]));
+        Round(g, h, a, b, c, d, e, f, Add(T::Set1(K[10]), w[10]));
+        Round(f, g, h, a, b, c, d, e, Add(T::Set1(K[11]), w[11]));
+        Round(e, f, g, h, a, b, c, d, Add(T::Set1(K[12]), w[12]));
+        Round(d, e, f, g, h, a, b, c, Add(T::Set1(K[13]), w[13]));
+        Round(c, d, e, f, g, h, a, b, Add(T::Set1(K[14]), w[14]));
+        Round(b, c, d, e, f, g, h, a, Add(T::Set1(K[15]), w[15]));
+        Rounds16to63(a, b, c, d, e, f, g, h, w);
+
+        V s[8];
+        s[0] = Add(a, T::Set1(IV[0])); s[1] = Add(b, T::Set1(IV[1]));
+        s[2] = Add(c, T::Set1(IV[2])); s[3] = Add(d, T::Set1(IV[3]));
+        s[4] = Add(e, T::Set1(IV[4])); s[5] = Add(f, T::Set1(IV[5]));
+        s[6] = Add(g, T::Set1(IV[6])); s[7] = Add(h, T::Set1(IV[7]));
+
+        // Padding block
+        a = s[0]; b = s[1]; c = s[2]; d = s[3]; e = s[4]; f = s[5]; g = s[6]; h = s[7];
+        for (int i = 0; i < 64; i += 8)
+        {
+            Round(a, b, c, d, e, f, g, h, T::Set1(padding.KW[i + 0]));
+            Round(h, a, b, c, d, e, f, g, T::Set1(padding.KW[i + 1]));
+            Round(g, h, a, b, c, d, e, f, T::Set1(padding.KW[i + 2]));
+            Round(f, g, h, a, b, c, d, e, T::Set1(padding.KW[i + 3]));
+            Round(e, f, g, h, a, b, c, d, T::Set1(padding.KW[i + 4]));
+            Round(d, e, f, g, h, a, b, c, T::Set1(padding.KW[i + 5]));
+            Round(c, d, e, f, g, h, a, b, T::Set1(padding.KW[i + 6]));
+            Round(b, c, d, e, f, g, h, a, T::Set1(padding.KW[i + 7]));
+        }
+        w[0] = Add(s[0], a); w[1] = Add(s[1], b); w[2] = Add(s[2], c); w[3] = Add(s[3], d);
+        w[4] = Add(s[4], e); w[5] = Add(s[5], f); w[6] = Add(s[6], g); w[7] = Add(s[7], h);
+
+        Hash32(w);
+
+        for (int i = 0; i < 8; i++)
+            T::Store(words[i], w[i]);
+        for (int j = 0; j < T::N; j++)
+            for (int i = 0; i < 8; i++)
+                WriteBE32(pOut + 32 * j + 4 * i, words[i][j]);
+    }
+};
+
+} // namespace
+
+#endif // NOVACOIN_KERNEL_LANES_IMPL_H
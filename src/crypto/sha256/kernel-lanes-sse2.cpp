@@ -0,0 +1,37 @@
+#ifdef __ARM_NEON
+#include <sse2neon.h>
+#else
+#include <emmintrin.h>
+#endif
+
+#include "kernel-lanes-impl.h"
+
+namespace {
+
+struct SSE2
+{
+    typedef __m128i V;
+    static const int N = 4;
+
+    static inline V Add(V a, V b) { return _mm_add_epi32(a, b); }
+    static inline V Xor(V a, V b) { return _mm_xor_si128(a, b); }
+    template<int n> static inline V Shr(V x) { return _mm_srli_epi32(x, n); }
+    template<int n> static inline V Ror(V x) { return _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n)); }
+    static inline V Ch(V e, V f, V g) { return _mm_xor_si128(g, _mm_and_si128(e, _mm_xor_si128(f, g))); }
+    static inline V Maj(V a, V b, V c) { return _mm_or_si128(_mm_and_si128(a, b), _mm_and_si128(c, _mm_or_si128(a, b))); }
+    static inline V Set1(uint32_t x) { return _mm_set1_epi32((int)x); }
+    static inline V Load(const uint32_t* p) { return _mm_load_si128((const __m128i*)p); }
+    static inline void Store(uint32_t* p, V x) { _mm_storeu_si128((__m128i*)p, x); }
+};
+
+} // namespace
+
+void KernelHash_sse2(const KernelMidstate& midstate, uint32_t nTimeTx, int32_t nStep, uint32_t* pOut)
+{
+    KernelLanes<SSE2>::Hash(midstate, nTimeTx, nStep, pOut);
+}
+
+void SHA256D64_sse2(unsigned char* pOut, const unsigned char* pIn)
+{
+    KernelLanes<SSE2>::HashD64(pOut, pIn);
+}
@@ -0,0 +1,88 @@
+#include "kernel-lanes.h"
+#include "crypto/cpuid.h"
+
+#ifdef USE_INTRIN
+void KernelHash_sse2(const KernelMidstate& midstate, uint32_t nTimeTx, int32_t nStep, uint32_t* pOut);
+void SHA256D64_sse2(unsigned char* pOut, const unsigned char* pIn);
+#endif
+#ifdef USE_AVX2
+void KernelHash_avx2(const KernelMidstate& midstate, uint32_t nTimeTx, int32_t nStep, uint32_t* pOut);
+void SHA256D64_avx2(unsigned char* pOut, const unsigned char* pIn);
+#endif
+#ifdef USE_AVX512
+void KernelHash_avx512(const KernelMidstate& midstate, uint32_t nTimeTx, int32_t nStep, uint32_t* pOut);
+void SHA256D64_avx512(unsigned char* pOut, const unsigned char* pIn);
+#endif
+
+static inline uint32_t ReadBE32(const unsigned char* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline uint32_t Ror(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+void KernelMidstateInit(KernelMidstate& midstate, const unsigned char* pKernelPrefix)
+{
+    static const uint32_t K[6] = { 0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1 };
+    uint32_t s[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+    for (int i = 0; i < 6; i++)
+        midstate.W[i] = ReadBE32(pKernelPrefix + 4 * i);
+
+    // Variables are not renamed between rounds, round i uses
+    // s[-i mod 8] as "a", s[1 - i mod 8] as "b" and so on.
+    for (int i = 0; i < 6; i++)
+    {
+        uint32_t& a = s[(8 - i) & 7], & b = s[(9 - i) & 7], & c = s[(10 - i) & 7], & d = s[(11 - i) & 7];
+        uint32_t& e = s[(12 - i) & 7], & f = s[(13 - i) & 7], & g = s[(14 - i) & 7], & h = s[(15 - i) & 7];
+        uint32_t t1 = h + (Ror(e, 6) ^ Ror(e, 11) ^ Ror(e, 25)) + (g ^ (e & (f ^ g))) + K[i] + midstate.W[i];
+        uint32_t t2 = (Ror(a, 2) ^ Ror(a, 13) ^ Ror(a, 22)) + ((a & b) | (c & (a | b)));
+        d += t1;
+        h = t1 + t2;
+    }
+
+    for (int i = 0; i < 8; i++)
+        midstate.state[i] = s[i];
+}
+
+void GetKernelLaneHash(const uint32_t* pOut, int nLanes, int nLane, unsigned char* pHash)
+{
+    for (int j = 0; j < 8; j++)
+    {
+        uint32_t w = pOut[j * nLanes + nLane];
+        pHash[4 * j + 0] = w >> 24;
+        pHash[4 * j + 1] = w >> 16;
+        pHash[4 * j + 2] = w >> 8;
+        pHash[4 * j + 3] = w;
+    }
+}
+
+static int SelectKernelLanesEngines(KernelLanesEngine* pEngines)
+{
+    int nEngines = 0;
+    const CPUFeatures& cpu = GetCPUFeatures();
+    (void)cpu;
+
+#ifdef USE_AVX512
+    if (cpu.fAVX512F)
+        pEngines[nEngines++] = { "avx512", 16, KernelHash_avx512, SHA256D64_avx512 };
+#endif
+#ifdef USE_AVX2
+    if (cpu.fAVX2)
+        pEngines[nEngines++] = { "avx2", 8, KernelHash_avx2, SHA256D64_avx2 };
+#endif
+#ifdef USE_INTRIN
+    if (cpu.fSSE2 || cpu.fNEON)
+        pEngines[nEngines++] = { cpu.fNEON ? "neon" : "sse2", 4, KernelHash_sse2, SHA256D64_sse2 };
+#endif
+
+    return nEngines;
+}
+
+int GetKernelLanesEngines(const KernelLanesEngine** ppEngines)
+{
+    static KernelLanesEngine engines[3];
+    static const int nEngines = SelectKernelLanesEngines(engines);
+    *ppEngines = engines;
+    return nEngines;
+}
@@ -0,0 +1,51 @@
+#ifndef NOVACOIN_KERNEL_LANES_H
+#define NOVACOIN_KERNEL_LANES_H
+
+#include <cstdint>
+
+// Multi-lane SHA256d engine for stake kernels.
+//
+// Kernel is 28 bytes long: 24 bytes of static prefix (stake modifier,
+// block time, tx offset, tx time and vout) followed by nTimeTx. Both
+// hashing steps fit into a single SHA256 block, so every timestamp
+// costs exactly two compressions. The first six rounds depend on the
+// prefix only and are computed once per kernel.
+
+// Maximum number of lanes among all engines
+static const int MAX_KERNEL_LANES = 16;
+
+// Kernel prefix compressed up to the 6th round
+struct KernelMidstate
+{
+    uint32_t state[8]; // working variables a..h
+    uint32_t W[6];     // big-endian message words of prefix
+};
+
+// Hash nLanes timestamps nTimeTx, nTimeTx + nStep, nTimeTx + 2 * nStep ...
+//
+// Result words are stored in structure-of-arrays order, pOut[j * nLanes + i]
+// is the word j of resulting SHA256 state for lane i. Use GetKernelLaneHash()
+// to convert them into uint256 byte order.
+typedef void (*KernelLanesFn)(const KernelMidstate& midstate, uint32_t nTimeTx, int32_t nStep, uint32_t* pOut);
+
+// SHA256(SHA256(x)) of nLanes 64-byte inputs, 32 bytes of output for each
+typedef void (*SHA256D64LanesFn)(unsigned char* pOut, const unsigned char* pIn);
+
+struct KernelLanesEngine
+{
+    const char *pszName;
+    int nLanes;
+    KernelLanesFn fn;
+    SHA256D64LanesFn fnD64;
+};
+
+// Precompute the first rounds for 24 bytes of kernel prefix
+void KernelMidstateInit(KernelMidstate& midstate, const unsigned char* pKernelPrefix);
+
+// Extract 32 bytes of hash for the given lane
+void GetKernelLaneHash(const uint32_t* pOut, int nLanes, int nLane, unsigned char* pHash);
+
+// Engines supported by this CPU, ordered from widest to narrowest
+int GetKernelLanesEngines(const KernelLanesEngine** ppEngines);
+
+#endif // NOVACOIN_KERNEL_LANES_H
@@ -0,0 +1,82 @@
+#include <immintrin.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// SHA-256 compression with Intel SHA extensions.
+//
+// State is kept in the order expected by sha256rnds2: ABEF in one
+// register and CDGH in the other one.
+
+namespace {
+
+alignas(16) const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Four rounds with message words m of rounds i..i+3
+inline void QuadRound(__m128i& abef, __m128i& cdgh, __m128i m, int i)
+{
+    __m128i kw = _mm_add_epi32(m, _mm_load_si128((const __m128i*)&K[i]));
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, kw);
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(kw, 0x0e));
+}
+
+// Message words of the next four rounds from the last sixteen ones
+inline __m128i Expand(__m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+    __m128i t = _mm_add_epi32(_mm_sha256msg1_epu32(m0, m1), _mm_alignr_epi8(m3, m2, 4));
+    return _mm_sha256msg2_epu32(t, m3);
+}
+
+inline __m128i LoadBE(const unsigned char* p)
+{
+    const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)p), mask);
+}
+
+} // namespace
+
+void SHA256Compress_shani(uint32_t* pState, const unsigned char* pBlocks, size_t nBlocks)
+{
+    // a b c d, e f g h -> a b e f, c d g h
+    __m128i abcd = _mm_loadu_si128((const __m128i*)pState);
+    __m128i efgh = _mm_loadu_si128((const __m128i*)(pState + 4));
+    __m128i badc = _mm_shuffle_epi32(abcd, 0xb1);
+    __m128i hgfe = _mm_shuffle_epi32(efgh, 0x1b);
+    __m128i abef = _mm_alignr_epi8(badc, hgfe, 8);
+    __m128i cdgh = _mm_blend_epi16(hgfe, badc, 0xf0);
+
+    for (; nBlocks > 0; nBlocks--, pBlocks += 64)
+    {
+        __m128i abefSaved = abef, cdghSaved = cdgh;
+
+        __m128i m[4];
+        for (int i = 0; i < 4; i++)
+        {
+            m[i] = LoadBE(pBlocks + 16 * i);
+            QuadRound(abef, cdgh, m[i], 4 * i);
+        }
+        for (int i = 4; i < 16; i++)
+        {
+            m[i & 3] = Expand(m[i & 3], m[(i + 1) & 3], m[(i + 2) & 3], m[(i + 3) & 3]);
+            QuadRound(abef, cdgh, m[i & 3], 4 * i);
+        }
+
+        abef = _mm_add_epi32(abef, abefSaved);
+        cdgh = _mm_add_epi32(cdgh, cdghSaved);
+    }
+
+    // a b e f, c d g h -> a b c d, e f g h
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128((__m128i*)pState, _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128((__m128i*)(pState + 4), _mm_alignr_epi8(dchg, feba, 8));
+}
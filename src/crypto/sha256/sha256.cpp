@@ -0,0 +1,295 @@
+#include "sha256.h"
+#include "kernel-lanes.h"
+#include "crypto/cpuid.h"
+
+#include <cstring>
+#include <string>
+
+#ifdef USE_SHANI
+void SHA256Compress_shani(uint32_t* pState, const unsigned char* pBlocks, size_t nBlocks);
+#endif
+
+namespace {
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// Padding blocks of 64-byte and 32-byte messages
+const unsigned char pad64[64] = { 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02, 0x00 };
+const unsigned char pad32[32] = { 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x00 };
+
+inline uint32_t ReadBE32(const unsigned char* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+inline void WriteBE32(unsigned char* p, uint32_t x)
+{
+    p[0] = x >> 24; p[1] = x >> 16; p[2] = x >> 8; p[3] = x;
+}
+
+inline uint32_t Ror(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+void SHA256Compress_generic(uint32_t* pState, const unsigned char* pBlocks, size_t nBlocks)
+{
+    for (; nBlocks > 0; nBlocks--, pBlocks += 64)
+    {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++)
+            w[i] = ReadBE32(pBlocks + 4 * i);
+        for (int i = 16; i < 64; i++)
+            w[i] = (Ror(w[i - 2], 17) ^ Ror(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7] +
+                   (Ror(w[i - 15], 7) ^ Ror(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+
+        uint32_t a = pState[0], b = pState[1], c = pState[2], d = pState[3];
+        uint32_t e = pState[4], f = pState[5], g = pState[6], h = pState[7];
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t t1 = h + (Ror(e, 6) ^ Ror(e, 11) ^ Ror(e, 25)) + (g ^ (e & (f ^ g))) + K[i] + w[i];
+            uint32_t t2 = (Ror(a, 2) ^ Ror(a, 13) ^ Ror(a, 22)) + ((a & b) | (c & (a | b)));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        pState[0] += a; pState[1] += b; pState[2] += c; pState[3] += d;
+        pState[4] += e; pState[5] += f; pState[6] += g; pState[7] += h;
+    }
+}
+
+typedef void (*SHA256CompressFn)(uint32_t* pState, const unsigned char* pBlocks, size_t nBlocks);
+
+struct SHA256Engine
+{
+    SHA256CompressFn fnCompress;
+    const KernelLanesEngine* pLanes;
+    std::string strName;
+};
+
+// Single-block double hashing on compression function only
+void SHA256D64_compress(SHA256CompressFn fnCompress, unsigned char* pOut, const unsigned char* pIn)
+{
+    uint32_t s[8];
+    memcpy(s, IV, sizeof(s));
+    fnCompress(s, pIn, 1);
+    fnCompress(s, pad64, 1);
+
+    unsigned char block[64];
+    for (int i = 0; i < 8; i++)
+        WriteBE32(block + 4 * i, s[i]);
+    memcpy(block + 32, pad32, 32);
+
+    memcpy(s, IV, sizeof(s));
+    fnCompress(s, block, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(pOut + 4 * i, s[i]);
+}
+
+// Known hashes of "abc" and of 1000 bytes of 0x61, and double hash of 64 bytes 0..63
+bool SHA256SelfTest(SHA256CompressFn fnCompress)
+{
+    static const unsigned char hashABC[32] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad };
+    static const unsigned char hashLong[32] = {
+        0x41, 0xed, 0xec, 0xe4, 0x2d, 0x63, 0xe8, 0xd9, 0xbf, 0x51, 0x5a, 0x9b, 0xa6, 0x93, 0x2e, 0x1c,
+        0x20, 0xcb, 0xc9, 0xf5, 0xa5, 0xd1, 0x34, 0x64, 0x5a, 0xdb, 0x5d, 0xb1, 0xb9, 0x73, 0x7e, 0xa3 };
+    static const unsigned char hashD64[32] = {
+        0x01, 0xc9, 0xf4, 0x64, 0x78, 0x0a, 0x1b, 0x6a, 0xf4, 0xeb, 0x40, 0x0f, 0xe2, 0xf2, 0x89, 0x6c,
+        0xfb, 0x21, 0x69, 0xf5, 0xa6, 0x57, 0x01, 0x43, 0x9e, 0x4c, 0x2c, 0x4e, 0x21, 0x39, 0x03, 0xef };
+
+    unsigned char block[64] = { 'a', 'b', 'c', 0x80 };
+    block[63] = 3 * 8;
+    uint32_t s[8];
+    memcpy(s, IV, sizeof(s));
+    fnCompress(s, block, 1);
+    for (int i = 0; i < 8; i++)
+        if (s[i] != ReadBE32(hashABC + 4 * i))
+            return false;
+
+    // 15 full blocks and the last one with 40 bytes of message and padding
+    unsigned char blocks[16 * 64];
+    memset(blocks, 'a', 1000);
+    memset(blocks + 1000, 0, sizeof(blocks) - 1000);
+    blocks[1000] = 0x80;
+    WriteBE32(blocks + sizeof(blocks) - 4, 1000 * 8);
+    memcpy(s, IV, sizeof(s));
+    fnCompress(s, blocks, 16);
+    for (int i = 0; i < 8; i++)
+        if (s[i] != ReadBE32(hashLong + 4 * i))
+            return false;
+
+    // Padding blocks and byte order of the single-block double hash
+    unsigned char out[32];
+    for (int i = 0; i < 64; i++)
+        block[i] = i;
+    SHA256D64_compress(fnCompress, out, block);
+    if (memcmp(out, hashD64, 32) != 0)
+        return false;
+
+    return true;
+}
+
+// Lanes engine is checked against compression function which passed the self-test
+bool SHA256D64SelfTest(const KernelLanesEngine& lanes, SHA256CompressFn fnCompress)
+{
+    unsigned char in[64 * MAX_KERNEL_LANES], out[32 * MAX_KERNEL_LANES], expected[32];
+    for (size_t i = 0; i < sizeof(in); i++)
+        in[i] = (unsigned char)(i * 0x3b + 0x11);
+
+    lanes.fnD64(out, in);
+    for (int i = 0; i < lanes.nLanes; i++)
+    {
+        SHA256D64_compress(fnCompress, expected, in + 64 * i);
+        if (memcmp(expected, out + 32 * i, 32) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+SHA256Engine SelectSHA256Engine()
+{
+    SHA256Engine engine = { SHA256Compress_generic, nullptr, "generic" };
+
+#ifdef USE_SHANI
+    const CPUFeatures& cpu = GetCPUFeatures();
+    if (cpu.fSHA && cpu.fSSE41 && SHA256SelfTest(SHA256Compress_shani))
+        engine = { SHA256Compress_shani, nullptr, "shani" };
+#endif
+
+    // The generic code is the reference, it can't be replaced by anything
+    if (!SHA256SelfTest(engine.fnCompress))
+        return engine;
+
+    // Widest lanes engine for multi-buffer double hashing
+    const KernelLanesEngine* pEngines;
+    int nEngines = GetKernelLanesEngines(&pEngines);
+    for (int i = 0; i < nEngines; i++)
+    {
+        if (SHA256D64SelfTest(pEngines[i], engine.fnCompress))
+        {
+            engine.pLanes = &pEngines[i];
+            engine.strName += std::string(", ") + pEngines[i].pszName + " x" + std::to_string(pEngines[i].nLanes);
+            break;
+        }
+    }
+
+    return engine;
+}
+
+const SHA256Engine& GetSHA256Engine()
+{
+    static const SHA256Engine engine = SelectSHA256Engine();
+    return engine;
+}
+
+} // namespace
+
+void SHA256Compress(uint32_t* pState, const unsigned char* pBlocks, size_t nBlocks)
+{
+    GetSHA256Engine().fnCompress(pState, pBlocks, nBlocks);
+}
+
+void SHA256D64(unsigned char* pOut, const unsigned char* pIn, size_t nBlocks)
+{
+    const SHA256Engine& engine = GetSHA256Engine();
+    if (engine.pLanes)
+    {
+        const size_t nLanes = engine.pLanes->nLanes;
+        for (; nBlocks >= nLanes; nBlocks -= nLanes, pIn += 64 * nLanes, pOut += 32 * nLanes)
+            engine.pLanes->fnD64(pOut, pIn);
+    }
+    for (; nBlocks > 0; nBlocks--, pIn += 64, pOut += 32)
+        SHA256D64_compress(engine.fnCompress, pOut, pIn);
+}
+
+void SHA256_32(unsigned char* pOut, const unsigned char* pIn)
+{
+    unsigned char block[64];
+    memcpy(block, pIn, 32);
+    memcpy(block + 32, pad32, 32);
+
+    uint32_t s[8];
+    memcpy(s, IV, sizeof(s));
+    SHA256Compress(s, block, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(pOut + 4 * i, s[i]);
+}
+
+const char* GetSHA256EngineName()
+{
+    return GetSHA256Engine().strName.c_str();
+}
+
+CSHA256::CSHA256()
+{
+    Reset();
+}
+
+CSHA256& CSHA256::Reset()
+{
+    memcpy(s, IV, sizeof(s));
+    nBytes = 0;
+    return *this;
+}
+
+CSHA256& CSHA256::Write(const unsigned char* pData, size_t nLen)
+{
+    const SHA256CompressFn fnCompress = GetSHA256Engine().fnCompress;
+
+    size_t nBufSize = nBytes % 64;
+    nBytes += nLen;
+
+    // Fill up the buffer first
+    if (nBufSize && nBufSize + nLen >= 64)
+    {
+        memcpy(buf + nBufSize, pData, 64 - nBufSize);
+        pData += 64 - nBufSize;
+        nLen -= 64 - nBufSize;
+        fnCompress(s, buf, 1);
+        nBufSize = 0;
+    }
+
+    // Full blocks are compressed in place
+    if (nLen >= 64)
+    {
+        size_t nBlocks = nLen / 64;
+        fnCompress(s, pData, nBlocks);
+        pData += 64 * nBlocks;
+        nLen -= 64 * nBlocks;
+    }
+
+    if (nLen > 0)
+        memcpy(buf + nBufSize, pData, nLen);
+
+    return *this;
+}
+
+void CSHA256::Finalize(unsigned char pHash[OUTPUT_SIZE])
+{
+    static const unsigned char pad[64] = { 0x80 };
+    unsigned char sizedesc[8];
+    uint64_t nBits = nBytes << 3;
+    WriteBE32(sizedesc, nBits >> 32);
+    WriteBE32(sizedesc + 4, nBits);
+
+    Write(pad, 1 + ((119 - (nBytes % 64)) % 64));
+    Write(sizedesc, 8);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(pHash + 4 * i, s[i]);
+}
@@ -0,0 +1,42 @@
+#ifndef NOVACOIN_SHA256_H
+#define NOVACOIN_SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+
+// SHA-256 with compression function chosen at runtime.
+//
+// SHA-NI is used when the CPU has it, generic code otherwise. Double
+// hashing of 64-byte inputs (merkle nodes) also runs on the multi-lane
+// engines of crypto/sha256/kernel-lanes.h, several inputs at once.
+// Every engine is checked against known hashes before it is used.
+
+class CSHA256
+{
+private:
+    uint32_t s[8];
+    unsigned char buf[64];
+    uint64_t nBytes;
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    CSHA256();
+    CSHA256& Write(const unsigned char* pData, size_t nLen);
+    void Finalize(unsigned char pHash[OUTPUT_SIZE]);
+    CSHA256& Reset();
+};
+
+// Compress nBlocks 64-byte blocks into state, pState holds words a..h
+void SHA256Compress(uint32_t* pState, const unsigned char* pBlocks, size_t nBlocks);
+
+// SHA256(SHA256(x)) of nBlocks 64-byte inputs, 32 bytes of output for each
+void SHA256D64(unsigned char* pOut, const unsigned char* pIn, size_t nBlocks);
+
+// SHA256 of 32-byte input, the second half of double hashing
+void SHA256_32(unsigned char* pOut, const unsigned char* pIn);
+
+// Names of the engines in use, e.g. "shani, avx2 x8"
+const char* GetSHA256EngineName();
+
+#endif // NOVACOIN_SHA256_H
@@ -9,7 +9,9 @@
 #include "serialize.h"
 #include "uint256.h"
 #include "version.h"
+#include "crypto/sha256/sha256.h"
 
+#include <cstring>
 #include <vector>
 
 #include <openssl/ripemd.h>
@@ -19,24 +21,31 @@ template<typename T1>
 inline uint256 Hash(const T1 pbegin, const T1 pend)
 {
     static unsigned char pblank[1];
-    uint256 hash1;
-    SHA256((pbegin == pend ? pblank : (unsigned char*)&pbegin[0]), (pend - pbegin) * sizeof(pbegin[0]), (unsigned char*)&hash1);
+    const unsigned char* pdata = (pbegin == pend ? pblank : (unsigned char*)&pbegin[0]);
+    size_t nSize = (pend - pbegin) * sizeof(pbegin[0]);
     uint256 hash2;
-    SHA256((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash2);
+    if (nSize == 64)
+    {
+        SHA256D64((unsigned char*)&hash2, pdata, 1);
+        return hash2;
+    }
+    uint256 hash1;
+    CSHA256().Write(pdata, nSize).Finalize((unsigned char*)&hash1);
+    SHA256_32((unsigned char*)&hash2, (unsigned char*)&hash1);
     return hash2;
 }
 
 class CHashWriter
 {
 private:
-    SHA256_CTX ctx;
+    CSHA256 ctx;
 
 public:
     int nType;
     int nVersion;
 
     void Init() {
-        SHA256_Init(&ctx);
+        ctx.Reset();
     }
 
     CHashWriter(int nTypeIn, int nVersionIn) : nType(nTypeIn), nVersion(nVersionIn) {
@@ -44,16 +53,16 @@ public:
     }
 
     CHashWriter& write(const char *pch, size_t size) {
-        SHA256_Update(&ctx, pch, size);
+        ctx.Write((const unsigned char*)pch, size);
         return (*this);
     }
 
     // invalidates the object
     uint256 GetHash() {
         uint256 hash1;
-        SHA256_Final((unsigned char*)&hash1, &ctx);
+        ctx.Finalize((unsigned char*)&hash1);
         uint256 hash2;
-        SHA256((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash2);
+        SHA256_32((unsigned char*)&hash2, (unsigned char*)&hash1);
         return hash2;
     }
 
@@ -71,14 +80,25 @@ inline uint256 Hash(const T1 p1begin, const T1 p1end,
                     const T2 p2begin, const T2 p2end)
 {
     static unsigned char pblank[1];
-    uint256 hash1;
-    SHA256_CTX ctx;
-    SHA256_Init(&ctx);
-    SHA256_Update(&ctx, (p1begin == p1end ? pblank : (unsigned char*)&p1begin[0]), (p1end - p1begin) * sizeof(p1begin[0]));
-    SHA256_Update(&ctx, (p2begin == p2end ? pblank : (unsigned char*)&p2begin[0]), (p2end - p2begin) * sizeof(p2begin[0]));
-    SHA256_Final((unsigned char*)&hash1, &ctx);
+    const unsigned char* p1 = (p1begin == p1end ? pblank : (unsigned char*)&p1begin[0]);
+    const unsigned char* p2 = (p2begin == p2end ? pblank : (unsigned char*)&p2begin[0]);
+    size_t nSize1 = (p1end - p1begin) * sizeof(p1begin[0]);
+    size_t nSize2 = (p2end - p2begin) * sizeof(p2begin[0]);
     uint256 hash2;
-    SHA256((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash2);
+
+    // Merkle tree nodes
+    if (nSize1 + nSize2 == 64)
+    {
+        unsigned char buf[64];
+        memcpy(buf, p1, nSize1);
+        memcpy(buf + nSize1, p2, nSize2);
+        SHA256D64((unsigned char*)&hash2, buf, 1);
+        return hash2;
+    }
+
+    uint256 hash1;
+    CSHA256().Write(p1, nSize1).Write(p2, nSize2).Finalize((unsigned char*)&hash1);
+    SHA256_32((unsigned char*)&hash2, (unsigned char*)&hash1);
     return hash2;
 }
 
@@ -89,14 +109,13 @@ inline uint256 Hash(const T1 p1begin, const T1 p1end,
 {
     static unsigned char pblank[1];
     uint256 hash1;
-    SHA256_CTX ctx;
-    SHA256_Init(&ctx);
-    SHA256_Update(&ctx, (p1begin == p1end ? pblank : (unsigned char*)&p1begin[0]), (p1end - p1begin) * sizeof(p1begin[0]));
-    SHA256_Update(&ctx, (p2begin == p2end ? pblank : (unsigned char*)&p2begin[0]), (p2end - p2begin) * sizeof(p2begin[0]));
-    SHA256_Update(&ctx, (p3begin == p3end ? pblank : (unsigned char*)&p3begin[0]), (p3end - p3begin) * sizeof(p3begin[0]));
-    SHA256_Final((unsigned char*)&hash1, &ctx);
+    CSHA256()
+        .Write((p1begin == p1end ? pblank : (unsigned char*)&p1begin[0]), (p1end - p1begin) * sizeof(p1begin[0]))
+        .Write((p2begin == p2end ? pblank : (unsigned char*)&p2begin[0]), (p2end - p2begin) * sizeof(p2begin[0]))
+        .Write((p3begin == p3end ? pblank : (unsigned char*)&p3begin[0]), (p3end - p3begin) * sizeof(p3begin[0]))
+        .Finalize((unsigned char*)&hash1);
     uint256 hash2;
-    SHA256((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash2);
+    SHA256_32((unsigned char*)&hash2, (unsigned char*)&hash1);
     return hash2;
 }
 
@@ -113,7 +132,7 @@ inline uint160 Hash160(const T1 pbegin, const T1 pend)
 {
     static unsigned char pblank[1];
     uint256 hash1;
-    SHA256((pbegin == pend ? pblank : (unsigned char*)&pbegin[0]), (pend - pbegin) * sizeof(pbegin[0]), (unsigned char*)&hash1);
+    CSHA256().Write((pbegin == pend ? pblank : (unsigned char*)&pbegin[0]), (pend - pbegin) * sizeof(pbegin[0])).Finalize((unsigned char*)&hash1);
     uint160 hash2;
     RIPEMD160((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash2);
     return hash2;
@@ -14,6 +14,11 @@
 #include "ipcollector.h"
 #include "interface.h"
 #include "checkpoints.h"
+#include "kernel_worker.h"
+#include "kernel_scan.h"
+#include "scrypt.h"
+#include "sigcache.h"
+#include "crypto/sha256/sha256.h"
 
 #include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/convenience.hpp>
@@ -130,7 +135,7 @@ void HandleSIGHUP(int)
 //
 // Start
 //
-#if !defined(QT_GUI)
+#if !defined(QT_GUI) && !defined(NOVACOIN_BENCH)
 bool AppInit(int argc, char* argv[])
 {
     bool fRet = false;
@@ -239,6 +244,8 @@ std::string HelpMessage()
         "  -wallet=<file>         " + _("Specify wallet file (within data directory)") + "\n" +
         "  -dbcache=<n>           " + _("Set database cache size in megabytes (default: 25)") + "\n" +
         "  -dblogsize=<n>         " + _("Set database disk log size in megabytes (default: 100)") + "\n" +
+        "  -sigcachemb=<n>        " + strprintf(_("Set signature cache size in megabytes (default: %u, maximum: %u)"), DEFAULT_MAX_SIG_CACHE_SIZE, MAX_MAX_SIG_CACHE_SIZE) + "\n" +
+        "  -maxscriptcachesize=<n> " + strprintf(_("Set script execution cache size in megabytes (default: %u, maximum: %u)"), DEFAULT_MAX_SCRIPT_CACHE_SIZE, MAX_MAX_SIG_CACHE_SIZE) + "\n" +
         "  -timeout=<n>           " + _("Specify connection timeout in milliseconds (default: 5000)") + "\n" +
         "  -proxy=<ip:port>       " + _("Connect through socks proxy") + "\n" +
         "  -socks=<n>             " + _("Select the version of socks proxy to use (4-5, default: 5)") + "\n" +
@@ -300,7 +307,10 @@ std::string HelpMessage()
         "  -salvagewallet         " + _("Attempt to recover private keys from a corrupt wallet.dat") + "\n" +
         "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 2500, 0 = all)") + "\n" +
         "  -checklevel=<n>        " + _("How thorough the block verification is (0-6, default: 1)") + "\n" +
+        "  -checkscripttemplates  " + _("Verify standard scripts with the interpreter too and log any mismatch (use with -reindex or -loadblock)") + "\n" +
         "  -par=N                 " + _("Set the number of script verification threads (1-16, 0=auto, default: 0)") + "\n" +
+        "  -kernelthreads=N       " + _("Set the number of kernel search threads (1-64, 0=auto, default: 0)") + "\n" +
+        "  -scryptimpl=<name>     " + _("Use the given scrypt implementation (auto, avx512, avx2, sse2, neon, generic, default: auto)") + "\n" +
         "  -loadblock=<file>      " + _("Imports blocks from external blk000?.dat file") + "\n" +
 
         "\n" + _("Block creation options:") + "\n" +
@@ -444,6 +454,15 @@ bool AppInit2()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // -kernelthreads=0 means autodetect, thread which runs the search is counted too
+    nKernelThreads = GetArgInt("-kernelthreads", 0);
+    if (nKernelThreads <= 0)
+        nKernelThreads = boost::thread::hardware_concurrency();
+    if (nKernelThreads <= 0)
+        nKernelThreads = 1;
+    else if (nKernelThreads > MAX_KERNEL_THREADS)
+        nKernelThreads = MAX_KERNEL_THREADS;
+
     fDebug = GetBoolArg("-debug");
 
     // -debug implies fDebug*
@@ -489,7 +508,13 @@ bool AppInit2()
             InitWarning(_("Warning: -paytxfee is set very high! This is the transaction fee you will pay if you send a transaction."));
     }
 
+    // The signature cache is sized in megabytes by -sigcachemb now, the old
+    // option counted entries and can't be carried over
+    if (mapArgs.count("-maxsigcachesize"))
+        InitWarning(strprintf(_("Warning: -maxsigcachesize is no longer supported, use -sigcachemb=<n> to set the signature cache size in megabytes (default: %u)."), DEFAULT_MAX_SIG_CACHE_SIZE));
+
     fConfChange = GetBoolArg("-confchange", false);
+    fCheckScriptTemplates = GetBoolArg("-checkscripttemplates", false);
 
     if (mapArgs.count("-mininput"))
     {
@@ -545,6 +570,26 @@ bool AppInit2()
         printf("Startup time: %s\n", DateTimeStrFormat("%x %H:%M:%S", GetTime()).c_str());
     printf("Default data directory %s\n", GetDefaultDataDir().string().c_str());
     printf("Used data directory %s\n", strDataDir.c_str());
+
+    // Every implementation is checked against known hashes first
+    std::string strScryptImpl = GetArg("-scryptimpl", "auto");
+    if (!SelectScryptImpl(strScryptImpl))
+    {
+        std::vector<std::string> vNames = GetScryptImplNames();
+        std::string strNames;
+        for (const std::string& strName : vNames)
+            strNames += (strNames.empty() ? "" : ", ") + strName;
+        return InitError(strprintf(_("Unsupported -scryptimpl '%s', this CPU supports: %s"), strScryptImpl.c_str(), strNames.c_str()));
+    }
+    printf("Using %s scrypt implementation\n", GetScryptImplName());
+    printf("Using %s SHA-256 engine\n", GetSHA256EngineName());
+
+    // A libcrypto or libsecp256k1 build that parses these differently would split the chain
+    if (!ECDSASelfTest())
+        return InitError(_("ECDSA signature parsing failed self-test, see debug.log"));
+
+    printf("Using signature cache with %" PRIszu " entries\n", GetSignatureCache().GetCapacity());
+    printf("Using script execution cache with %" PRIszu " entries\n", GetScriptExecutionCache().GetCapacity());
     std::ostringstream strErrors;
 
     if (fDaemon)
@@ -556,6 +601,14 @@ bool AppInit2()
             NewThread(ThreadScriptCheck, NULL);
     }
 
+    printf("Using %d threads for kernel search\n", nKernelThreads);
+    for (int i=0; i<nKernelThreads-1; i++)
+        NewThread(ThreadKernelSearch, NULL);
+
+    // Background scans of kernels, requested by RPC
+    if (!NewThread(ThreadKernelScan, NULL))
+        printf("Error: NewThread(ThreadKernelScan) failed\n");
+
     int64_t nStart;
 
     // ********************************************************* Step 5: verify database integrity
@@ -9,6 +9,7 @@
 #include "kernel_worker.h"
 #include "txdb-leveldb.h"
 #include "main.h"
+#include "random.h"
 
 extern unsigned int nStakeTargetSpacing;
 
@@ -132,50 +133,64 @@ static int64_t GetStakeModifierSelectionInterval()
     return nSelectionInterval;
 }
 
-// select a block from the candidate blocks in vSortedByTimestamp, excluding
-// already selected blocks in vSelectedBlocks, and with timestamp up to
-// nSelectionIntervalStop.
-static bool SelectBlockFromCandidates(vector<pair<int64_t, uint256> >& vSortedByTimestamp, map<uint256, const CBlockIndex*>& mapSelectedBlocks,
-    int64_t nSelectionIntervalStop, uint64_t nStakeModifierPrev, const CBlockIndex** pindexSelected)
+// Candidate block for stake modifier selection
+struct StakeModifierCandidate
 {
-    bool fSelected = false;
-    uint256 hashBest = 0;
+    int64_t nTime;
+    const CBlockIndex* pindex;
+    uint256 hashSelection;
+    bool fSelected;
+
+    // Candidates are sorted by timestamp, then by block hash
+    bool operator<(const StakeModifierCandidate& other) const
+    {
+        if (nTime != other.nTime)
+            return nTime < other.nTime;
+        return pindex->GetBlockHash() < other.pindex->GetBlockHash();
+    }
+};
+
+// Compute the selection hash by hashing block's proof-hash and the
+// previous proof-of-stake modifier
+static uint256 GetSelectionHash(const CBlockIndex* pindex, uint64_t nStakeModifierPrev)
+{
+    // Same as serialization of (hashProof, nStakeModifierPrev)
+    unsigned char data[32 + 8];
+    const uint256& hashProof = pindex->IsProofOfStake()? pindex->hashProofOfStake : pindex->GetBlockHash();
+    memcpy(data, hashProof.begin(), 32);
+    memcpy(data + 32, &nStakeModifierPrev, 8);
+    uint256 hashSelection = Hash(data, data + sizeof(data));
+    // the selection hash is divided by 2**32 so that proof-of-stake block
+    // is always favored over proof-of-work block. this is to preserve
+    // the energy efficiency property
+    if (pindex->IsProofOfStake())
+        hashSelection >>= 32;
+    return hashSelection;
+}
+
+// select a block from the candidate blocks in vCandidates, excluding
+// already selected blocks, and with timestamp up to nSelectionIntervalStop.
+// The selected block is marked as such.
+static bool SelectBlockFromCandidates(vector<StakeModifierCandidate>& vCandidates, int64_t nSelectionIntervalStop, const CBlockIndex** pindexSelected)
+{
+    StakeModifierCandidate* pcandidateBest = NULL;
     *pindexSelected = (const CBlockIndex*) 0;
-    for (const auto& item : vSortedByTimestamp)
+    for (auto& candidate : vCandidates)
     {
-        if (!mapBlockIndex.count(item.second))
-            return error("SelectBlockFromCandidates: failed to find block index for candidate block %s", item.second.ToString().c_str());
-        const CBlockIndex* pindex = mapBlockIndex[item.second];
-        if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop)
+        if (pcandidateBest && candidate.nTime > nSelectionIntervalStop)
             break;
-        if (mapSelectedBlocks.count(pindex->GetBlockHash()) > 0)
+        if (candidate.fSelected)
             continue;
-        // compute the selection hash by hashing its proof-hash and the
-        // previous proof-of-stake modifier
-        uint256 hashProof = pindex->IsProofOfStake()? pindex->hashProofOfStake : pindex->GetBlockHash();
-        CDataStream ss(SER_GETHASH, 0);
-        ss << hashProof << nStakeModifierPrev;
-        uint256 hashSelection = Hash(ss.begin(), ss.end());
-        // the selection hash is divided by 2**32 so that proof-of-stake block
-        // is always favored over proof-of-work block. this is to preserve
-        // the energy efficiency property
-        if (pindex->IsProofOfStake())
-            hashSelection >>= 32;
-        if (fSelected && hashSelection < hashBest)
-        {
-            hashBest = hashSelection;
-            *pindexSelected = pindex;
-        }
-        else if (!fSelected)
-        {
-            fSelected = true;
-            hashBest = hashSelection;
-            *pindexSelected = pindex;
-        }
+        if (!pcandidateBest || candidate.hashSelection < pcandidateBest->hashSelection)
+            pcandidateBest = &candidate;
     }
+    if (!pcandidateBest)
+        return false;
     if (fDebug && GetBoolArg("-printstakemodifier"))
-        printf("SelectBlockFromCandidates: selection hash=%s\n", hashBest.ToString().c_str());
-    return fSelected;
+        printf("SelectBlockFromCandidates: selection hash=%s\n", pcandidateBest->hashSelection.ToString().c_str());
+    pcandidateBest->fSelected = true;
+    *pindexSelected = pcandidateBest->pindex;
+    return true;
 }
 
 // Stake Modifier (hash modifier of proof-of-stake):
@@ -239,36 +254,34 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64_t& nStake
         }
     }
 
-    // Sort candidate blocks by timestamp
-    vector<pair<int64_t, uint256> > vSortedByTimestamp;
-    vSortedByTimestamp.reserve(64 * nModifierInterval / nStakeTargetSpacing);
+    // Sort candidate blocks by timestamp, the buffer is reused by the next calls
+    static thread_local vector<StakeModifierCandidate> vCandidates;
+    vCandidates.clear();
     int64_t nSelectionInterval = GetStakeModifierSelectionInterval();
     int64_t nSelectionIntervalStart = (pindexPrev->GetBlockTime() / nModifierInterval) * nModifierInterval - nSelectionInterval;
     const CBlockIndex* pindex = pindexPrev;
     while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart)
     {
-        vSortedByTimestamp.push_back(make_pair(pindex->GetBlockTime(), pindex->GetBlockHash()));
+        // Selection hash of a candidate is the same for all rounds
+        vCandidates.push_back({ pindex->GetBlockTime(), pindex, GetSelectionHash(pindex, nStakeModifier), false });
         pindex = pindex->pprev;
     }
     int nHeightFirstCandidate = pindex ? (pindex->nHeight + 1) : 0;
-    reverse(vSortedByTimestamp.begin(), vSortedByTimestamp.end());
-    sort(vSortedByTimestamp.begin(), vSortedByTimestamp.end());
+    reverse(vCandidates.begin(), vCandidates.end());
+    sort(vCandidates.begin(), vCandidates.end());
 
     // Select 64 blocks from candidate blocks to generate stake modifier
     uint64_t nStakeModifierNew = 0;
     int64_t nSelectionIntervalStop = nSelectionIntervalStart;
-    map<uint256, const CBlockIndex*> mapSelectedBlocks;
-    for (int nRound=0; nRound<min(64, (int)vSortedByTimestamp.size()); nRound++)
+    for (int nRound=0; nRound<min(64, (int)vCandidates.size()); nRound++)
     {
         // add an interval section to the current selection round
         nSelectionIntervalStop += GetStakeModifierSelectionIntervalSection(nRound);
         // select a block from the candidates of current round
-        if (!SelectBlockFromCandidates(vSortedByTimestamp, mapSelectedBlocks, nSelectionIntervalStop, nStakeModifier, &pindex))
+        if (!SelectBlockFromCandidates(vCandidates, nSelectionIntervalStop, &pindex))
             return error("ComputeNextStakeModifier: unable to select block at round %d", nRound);
         // write the entropy bit of the selected block
         nStakeModifierNew |= (((uint64_t)pindex->GetStakeEntropyBit()) << nRound);
-        // add the selected block from candidates to selected list
-        mapSelectedBlocks.insert(make_pair(pindex->GetBlockHash(), pindex));
         if (fDebug && GetBoolArg("-printstakemodifier"))
             printf("ComputeNextStakeModifier: selected round %d stop=%s height=%d bit=%d\n", nRound, DateTimeStrFormat(nSelectionIntervalStop).c_str(), pindex->nHeight, pindex->GetStakeEntropyBit());
     }
@@ -287,11 +300,13 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64_t& nStake
                 strSelectionMap.replace(pindex->nHeight - nHeightFirstCandidate, 1, "=");
             pindex = pindex->pprev;
         }
-        for (const auto& item : mapSelectedBlocks)
+        for (const auto& candidate : vCandidates)
         {
+            if (!candidate.fSelected)
+                continue;
             // 'S' indicates selected proof-of-stake blocks
             // 'W' indicates selected proof-of-work blocks
-            strSelectionMap.replace(item.second->nHeight - nHeightFirstCandidate, 1, item.second->IsProofOfStake()? "S" : "W");
+            strSelectionMap.replace(candidate.pindex->nHeight - nHeightFirstCandidate, 1, candidate.pindex->IsProofOfStake()? "S" : "W");
         }
         printf("ComputeNextStakeModifier: selection height [%d, %d] map %s\n", nHeightFirstCandidate, pindexPrev->nHeight, strSelectionMap.c_str());
     }
@@ -309,10 +324,25 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64_t& nStake
 // modifier about a selection interval later than the coin generating the kernel
 static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake)
 {
+    // The result is memoized in the block index
+    LOCK(cs_main);
+
     nStakeModifier = 0;
-    if (!mapBlockIndex.count(hashBlockFrom))
+    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlockFrom);
+    if (mi == mapBlockIndex.end())
         return error("GetKernelStakeModifier() : block not indexed");
-    const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
+    CBlockIndex* pindexFrom = mi->second;
+
+    // The search only walks through the ancestors of the block where it
+    // stopped, so a reorganization which keeps that block doesn't change it
+    if (pindexFrom->pindexKernelStakeModifierEnd && pindexFrom->pindexKernelStakeModifierEnd->IsInMainChain())
+    {
+        nStakeModifier = pindexFrom->nKernelStakeModifier;
+        nStakeModifierHeight = pindexFrom->nKernelStakeModifierHeight;
+        nStakeModifierTime = pindexFrom->nKernelStakeModifierTime;
+        return true;
+    }
+
     nStakeModifierHeight = pindexFrom->nHeight;
     nStakeModifierTime = pindexFrom->GetBlockTime();
     int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
@@ -336,6 +366,12 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifi
         }
     }
     nStakeModifier = pindex->nStakeModifier;
+
+    pindexFrom->nKernelStakeModifier = nStakeModifier;
+    pindexFrom->nKernelStakeModifierHeight = nStakeModifierHeight;
+    pindexFrom->nKernelStakeModifierTime = nStakeModifierTime;
+    pindexFrom->pindexKernelStakeModifierEnd = pindex;
+
     return true;
 }
 
@@ -433,38 +469,26 @@ bool CheckStakeKernelHash(uint32_t nBits, const CBlock& blockFrom, uint32_t nTxP
 // Scan given kernel for solution
 bool ScanKernelForward(unsigned char *kernel, uint32_t nBits, uint32_t nInputTxTime, int64_t nValueIn, std::pair<uint32_t, uint32_t> &SearchInterval, std::vector<std::pair<uint256, uint32_t> > &solutions)
 {
-    // TODO: custom threads amount
+    // Interval is split into chunks, small enough to keep all kernel search threads busy until the end
+    const uint32_t nChunk = 16384;
+    const uint32_t nLength = SearchInterval.second > SearchInterval.first ? SearchInterval.second - SearchInterval.first : 0;
+    const size_t nTasks = nLength / nChunk + (nLength % nChunk != 0);
 
-    uint32_t nThreads = boost::thread::hardware_concurrency();
-    if (nThreads == 0)
-    {
-       nThreads = 1;
-       printf("Warning: hardware_concurrency() failed in %s:%d\n", __FILE__, __LINE__);
-    }
-    uint32_t nPart = (SearchInterval.second - SearchInterval.first) / nThreads;
+    std::vector<std::vector<std::pair<uint256, uint32_t> > > vChunkSolutions(nTasks);
+    RunKernelSearch(nTasks, [&](size_t nTask) {
+        uint32_t nBegin = SearchInterval.first + nChunk * nTask;
+        uint32_t nEnd = (nTask + 1 == nTasks) ? SearchInterval.second : nBegin + nChunk;
 
-    KernelWorker *workers = new KernelWorker[nThreads];
+        KernelWorker worker(kernel, nBits, nInputTxTime, nValueIn, nBegin, nEnd);
+        worker.Do();
+        vChunkSolutions[nTask].swap(worker.GetSolutions());
 
-    boost::thread_group group;
-    for(size_t i = 0; i < nThreads; i++)
-    {
-        uint32_t nBegin = SearchInterval.first + nPart * i;
-        uint32_t nEnd = SearchInterval.first + nPart * (i + 1);
-        workers[i] = KernelWorker(kernel, nBits, nInputTxTime, nValueIn, nBegin, nEnd);
-        boost::function<void()> workerFnc = boost::bind(&KernelWorker::Do, &workers[i]);
-        group.create_thread(workerFnc);
-    }
+        return true;
+    });
 
-    group.join_all();
     solutions.clear();
-
-    for(size_t i = 0; i < nThreads; i++)
-    {
-        std::vector<std::pair<uint256, uint32_t> > ws = workers[i].GetSolutions();
-        solutions.insert(solutions.end(), ws.begin(), ws.end());
-    }
-
-    delete [] workers;
+    for (const auto& chunk : vChunkSolutions)
+        solutions.insert(solutions.end(), chunk.begin(), chunk.end());
 
     if (solutions.size() == 0)
     {
@@ -0,0 +1,267 @@
+#include "kernel_scan.h"
+#include "kernel_worker.h"
+#include "util.h"
+#include "net.h"
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+namespace {
+
+// Timestamps per task of kernel search pool
+const uint32_t nKernelScanChunk = 16384;
+
+// Finished scans which are kept for status requests
+const size_t nMaxFinishedScans = 64;
+
+struct KernelScan
+{
+    vector<KernelScanInput> vInputs;
+    uint32_t nBits;
+    uint32_t nIntervalBegin;
+    uint32_t nIntervalEnd;
+
+    KernelScanStatus::State nState;
+    int64_t nStartTime;
+    int64_t nEndTime;
+    uint64_t nScanned;
+    vector<KernelScanSolution> vSolutions;
+
+    // The next chunk to hand out
+    size_t nNextInput;
+    uint32_t nNextTime;
+
+    uint64_t GetTotal() const { return (uint64_t)vInputs.size() * (nIntervalEnd - nIntervalBegin); }
+};
+
+// Chunk of timestamps of one input
+struct KernelScanChunk
+{
+    shared_ptr<KernelScan> pscan;
+    size_t nInput;
+    uint32_t nBegin;
+    uint32_t nEnd;
+    vector<pair<uint256, uint32_t> > solutions;
+};
+
+mutex mutexKernelScans;
+condition_variable condKernelScans;
+map<int64_t, shared_ptr<KernelScan> > mapKernelScans;
+int64_t nLastKernelScan = 0;
+bool fKernelScanQuit = false;
+
+void FinishKernelScan(KernelScan& scan, KernelScanStatus::State nState)
+{
+    scan.nState = nState;
+    scan.nEndTime = GetTime();
+}
+
+// Forget the oldest finished scans, must be called with lock held
+void PruneKernelScans()
+{
+    size_t nFinished = 0;
+    for (const auto& item : mapKernelScans)
+        nFinished += (item.second->nState != KernelScanStatus::RUNNING);
+
+    for (auto it = mapKernelScans.begin(); it != mapKernelScans.end() && nFinished > nMaxFinishedScans; )
+    {
+        if (it->second->nState != KernelScanStatus::RUNNING)
+        {
+            it = mapKernelScans.erase(it);
+            nFinished--;
+        }
+        else
+            it++;
+    }
+}
+
+// Take up to nChunks chunks of every running scan, must be called with lock held
+void GetKernelScanChunks(size_t nChunks, vector<KernelScanChunk>& vChunks)
+{
+    for (auto& item : mapKernelScans)
+    {
+        shared_ptr<KernelScan> pscan = item.second;
+        if (pscan->nState != KernelScanStatus::RUNNING)
+            continue;
+
+        for (size_t n = 0; n < nChunks && pscan->nNextInput < pscan->vInputs.size(); n++)
+        {
+            KernelScanChunk chunk;
+            chunk.pscan = pscan;
+            chunk.nInput = pscan->nNextInput;
+            chunk.nBegin = pscan->nNextTime;
+            chunk.nEnd = pscan->nIntervalEnd - chunk.nBegin > nKernelScanChunk ? chunk.nBegin + nKernelScanChunk : pscan->nIntervalEnd;
+            vChunks.push_back(chunk);
+
+            pscan->nNextTime = chunk.nEnd;
+            if (pscan->nNextTime == pscan->nIntervalEnd)
+            {
+                pscan->nNextInput++;
+                pscan->nNextTime = pscan->nIntervalBegin;
+            }
+        }
+    }
+}
+
+}
+
+int64_t StartKernelScan(const vector<KernelScanInput>& vInputs, uint32_t nBits, uint32_t nIntervalBegin, uint32_t nIntervalEnd)
+{
+    shared_ptr<KernelScan> pscan(new KernelScan);
+    pscan->vInputs = vInputs;
+    pscan->nBits = nBits;
+    pscan->nIntervalBegin = nIntervalBegin;
+    pscan->nIntervalEnd = max(nIntervalBegin, nIntervalEnd);
+    pscan->nState = KernelScanStatus::RUNNING;
+    pscan->nStartTime = GetTime();
+    pscan->nEndTime = 0;
+    pscan->nScanned = 0;
+    pscan->nNextInput = 0;
+    pscan->nNextTime = nIntervalBegin;
+
+    // Nothing to scan
+    if (pscan->GetTotal() == 0)
+        FinishKernelScan(*pscan, KernelScanStatus::DONE);
+
+    lock_guard<mutex> lock(mutexKernelScans);
+
+    int nRunning = 0;
+    for (const auto& item : mapKernelScans)
+        nRunning += (item.second->nState == KernelScanStatus::RUNNING);
+    if (nRunning >= MAX_KERNEL_SCANS)
+        return 0;
+
+    int64_t nScan = ++nLastKernelScan;
+    mapKernelScans[nScan] = pscan;
+    PruneKernelScans();
+    condKernelScans.notify_all();
+
+    return nScan;
+}
+
+bool GetKernelScanStatus(int64_t nScan, size_t nFirstSolution, KernelScanStatus& status)
+{
+    lock_guard<mutex> lock(mutexKernelScans);
+
+    auto it = mapKernelScans.find(nScan);
+    if (it == mapKernelScans.end())
+        return false;
+
+    const KernelScan& scan = *it->second;
+    status.nState = scan.nState;
+    status.nStartTime = scan.nStartTime;
+    status.nEndTime = scan.nEndTime;
+    status.nScanned = scan.nScanned;
+    status.nTotal = scan.GetTotal();
+    status.nSolutions = scan.vSolutions.size();
+    status.vSolutions.assign(scan.vSolutions.begin() + min(nFirstSolution, scan.vSolutions.size()), scan.vSolutions.end());
+
+    return true;
+}
+
+vector<int64_t> ListKernelScans()
+{
+    lock_guard<mutex> lock(mutexKernelScans);
+
+    vector<int64_t> vScans;
+    for (const auto& item : mapKernelScans)
+        vScans.push_back(item.first);
+
+    return vScans;
+}
+
+bool CancelKernelScan(int64_t nScan)
+{
+    lock_guard<mutex> lock(mutexKernelScans);
+
+    auto it = mapKernelScans.find(nScan);
+    if (it == mapKernelScans.end())
+        return false;
+
+    // Chunks in progress are dropped by the scan thread
+    if (it->second->nState == KernelScanStatus::RUNNING)
+        FinishKernelScan(*it->second, KernelScanStatus::CANCELLED);
+
+    return true;
+}
+
+void ThreadKernelScan(void*)
+{
+    vnThreadsRunning[THREAD_KERNELSCAN]++;
+    RenameThread("novacoin-kernelscan");
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+
+    // A few chunks per thread, so the stake miner doesn't wait for long behind the scans
+    const size_t nChunks = max(nKernelThreads, 1) * 4;
+
+    while (!fShutdown)
+    {
+        vector<KernelScanChunk> vChunks;
+        {
+            unique_lock<mutex> lock(mutexKernelScans);
+            GetKernelScanChunks(nChunks, vChunks);
+
+            if (vChunks.empty())
+            {
+                if (fKernelScanQuit)
+                    break;
+                condKernelScans.wait(lock);
+                continue;
+            }
+        }
+
+        bool fComplete = RunKernelSearch(vChunks.size(), [&](size_t nTask) {
+            KernelScanChunk& chunk = vChunks[nTask];
+            const KernelScan& scan = *chunk.pscan;
+
+            const KernelScanInput& input = scan.vInputs[chunk.nInput];
+            unsigned char kernel[8 + 16];
+            memcpy(kernel, input.kernel, sizeof(kernel));
+
+            KernelWorker worker(kernel, scan.nBits, input.nInputTxTime, input.nValueIn, chunk.nBegin, chunk.nEnd);
+            worker.Do();
+            chunk.solutions.swap(worker.GetSolutions());
+
+            return true;
+        });
+
+        // Kernel search pool is shutting down
+        if (!fComplete)
+            break;
+
+        // Solutions are reported in the order of chunks, cancelled scans are left as is
+        lock_guard<mutex> lock(mutexKernelScans);
+        for (const KernelScanChunk& chunk : vChunks)
+        {
+            KernelScan& scan = *chunk.pscan;
+            if (scan.nState != KernelScanStatus::RUNNING)
+                continue;
+
+            uint32_t nOut = scan.vInputs[chunk.nInput].nOut;
+            for (const auto& solution : chunk.solutions)
+                scan.vSolutions.push_back({ nOut, solution.first, solution.second });
+            scan.nScanned += chunk.nEnd - chunk.nBegin;
+
+            if (scan.nScanned == scan.GetTotal())
+                FinishKernelScan(scan, KernelScanStatus::DONE);
+        }
+    }
+
+    vnThreadsRunning[THREAD_KERNELSCAN]--;
+}
+
+void ThreadKernelScanQuit()
+{
+    lock_guard<mutex> lock(mutexKernelScans);
+    fKernelScanQuit = true;
+    for (auto& item : mapKernelScans)
+    {
+        if (item.second->nState == KernelScanStatus::RUNNING)
+            FinishKernelScan(*item.second, KernelScanStatus::CANCELLED);
+    }
+    condKernelScans.notify_all();
+}
@@ -0,0 +1,66 @@
+#ifndef NOVACOIN_KERNELSCAN_H
+#define NOVACOIN_KERNELSCAN_H
+
+#include "uint256.h"
+
+#include <cstdint>
+#include <vector>
+
+// Background forward scans of kernels, run on the kernel search pool.
+//
+// Scans are split into chunks of timestamps, and every pass of the scan
+// thread takes a few chunks of each running scan, so several scans make
+// progress at once without taking more than the kernel search threads.
+
+// Input to scan
+struct KernelScanInput
+{
+    unsigned char kernel[8 + 16];  // static part of kernel
+    uint32_t nInputTxTime;
+    int64_t nValueIn;
+    uint32_t nOut;
+};
+
+struct KernelScanSolution
+{
+    uint32_t nOut;
+    uint256 hashProofOfStake;
+    uint32_t nTime;
+};
+
+struct KernelScanStatus
+{
+    enum State { RUNNING, DONE, CANCELLED };
+
+    State nState;
+    int64_t nStartTime;
+    int64_t nEndTime;
+
+    // Number of kernels scanned so far and the total one
+    uint64_t nScanned;
+    uint64_t nTotal;
+
+    // Number of solutions found so far, and solutions starting from the requested one
+    size_t nSolutions;
+    std::vector<KernelScanSolution> vSolutions;
+};
+
+static const int MAX_KERNEL_SCANS = 16;
+
+// Start scan of the given inputs over [nIntervalBegin, nIntervalEnd)
+// Returns scan id, or 0 if there are too many running scans
+int64_t StartKernelScan(const std::vector<KernelScanInput>& vInputs, uint32_t nBits, uint32_t nIntervalBegin, uint32_t nIntervalEnd);
+
+// Get scan status with solutions starting from nFirstSolution
+bool GetKernelScanStatus(int64_t nScan, size_t nFirstSolution, KernelScanStatus& status);
+
+// Ids of the known scans, finished ones are kept for a while
+std::vector<int64_t> ListKernelScans();
+
+bool CancelKernelScan(int64_t nScan);
+
+// Kernel scan thread
+void ThreadKernelScan(void* parg);
+void ThreadKernelScanQuit();
+
+#endif // NOVACOIN_KERNELSCAN_H
@@ -1,33 +1,144 @@
-
 #include "uint256.h"
+#include "bignum.h"
 #include "kernel.h"
 #include "kernel_worker.h"
 #include "util.h"
+#include "net.h"
+#include "crypto/sha256/kernel-lanes.h"
+#include "crypto/sha256/sha256.h"
 
-#include <openssl/sha.h>
+#include <condition_variable>
+#include <list>
+#include <mutex>
 
 using namespace std;
 
-KernelWorker::KernelWorker(unsigned char *kernel, uint32_t nBits, uint32_t nInputTxTime, int64_t nValueIn, uint32_t nIntervalBegin, uint32_t nIntervalEnd) 
-        : kernel(kernel), nBits(nBits), nInputTxTime(nInputTxTime), bnValueIn(nValueIn), nIntervalBegin(nIntervalBegin), nIntervalEnd(nIntervalEnd)
+// Reference implementation of kernel hashing
+static uint256 KernelHashReference(const unsigned char *kernel, uint32_t nTimeTx)
+{
+    unsigned char data[8 + 16 + 4];
+    memcpy(data, kernel, 8 + 16);
+    memcpy(data + 8 + 16, &nTimeTx, 4);
+
+    uint256 hash1, hashProofOfStake;
+    CSHA256().Write(data, sizeof(data)).Finalize((unsigned char*)&hash1);
+    SHA256_32((unsigned char*)&hashProofOfStake, (unsigned char*)&hash1);
+    return hashProofOfStake;
+}
+
+// Cross-check lanes engine against the reference implementation
+static bool KernelEngineSelfTest(const KernelLanesEngine& engine)
+{
+    unsigned char kernel[8 + 16];
+    for (size_t i = 0; i < sizeof(kernel); i++)
+        kernel[i] = (unsigned char)(i * 0x3b + 0x11);
+
+    KernelMidstate midstate;
+    KernelMidstateInit(midstate, kernel);
+
+    alignas(64) uint32_t hashes[8 * MAX_KERNEL_LANES];
+    for (int32_t nStep = -1; nStep <= 1; nStep += 2)
     {
-        solutions = vector<std::pair<uint256,uint32_t> >();
+        uint32_t nTimeTx = 0x5bd9b0a5;
+        engine.fn(midstate, nTimeTx, nStep, hashes);
+        for (int i = 0; i < engine.nLanes; i++)
+        {
+            uint256 hashProofOfStake;
+            GetKernelLaneHash(hashes, engine.nLanes, i, (unsigned char*)&hashProofOfStake);
+            if (hashProofOfStake != KernelHashReference(kernel, nTimeTx + nStep * i))
+                return false;
+        }
     }
 
-void KernelWorker::Do_generic()
+    return true;
+}
+
+// Choose the widest engine which gives the same results as reference
+static const KernelLanesEngine* SelectKernelEngine()
 {
-    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+    const KernelLanesEngine* pEngines;
+    int nEngines = GetKernelLanesEngines(&pEngines);
+    for (int i = 0; i < nEngines; i++)
+    {
+        if (KernelEngineSelfTest(pEngines[i]))
+        {
+            printf("Using %s kernel hashing engine, %d lanes\n", pEngines[i].pszName, pEngines[i].nLanes);
+            return &pEngines[i];
+        }
+        printf("ERROR: %s kernel hashing engine failed self-test\n", pEngines[i].pszName);
+    }
+    printf("Using generic kernel hashing engine\n");
+    return nullptr;
+}
+
+static const KernelLanesEngine* GetKernelEngine()
+{
+    static const KernelLanesEngine* pengine = SelectKernelEngine();
+    return pengine;
+}
+
+const char* GetKernelEngineName()
+{
+    const KernelLanesEngine* pengine = GetKernelEngine();
+    return pengine ? pengine->pszName : "generic";
+}
+
+KernelTarget::KernelTarget(uint32_t nBits, uint32_t nInputTxTime, int64_t nValueIn)
+    : nBits(nBits), nInputTxTime(nInputTxTime), nValueIn(nValueIn)
+{
+    bool fNegative, fOverflow;
+    nTargetPerCoinDay.SetCompact(nBits, &fNegative, &fOverflow);
+
+    // Weight never exceeds nStakeMaxAge, so that remainder * weight fits into 64 bits
+    const uint64_t nDivisor = COIN * nOneDay;
+    fFixedWidth = !fNegative && !fOverflow && nValueIn >= 0 && nStakeMaxAge <= numeric_limits<uint64_t>::max() / nDivisor;
+    nValueDays = fFixedWidth ? nValueIn / nDivisor : 0;
+    nValueRemainder = fFixedWidth ? nValueIn % nDivisor : 0;
 
-    // Compute maximum possible target to filter out majority of obviously insufficient hashes
     CBigNum bnTargetPerCoinDay;
     bnTargetPerCoinDay.SetCompact(nBits);
-    uint256 nMaxTarget = (bnTargetPerCoinDay * bnValueIn * nStakeMaxAge / COIN / nOneDay).getuint256();
+    nMaxTarget = (bnTargetPerCoinDay * CBigNum(nValueIn) * nStakeMaxAge / COIN / nOneDay).getuint256();
+}
+
+bool KernelTarget::Check(const uint256& hashProofOfStake, uint32_t nTimeTx) const
+{
+    int64_t nWeight = GetWeight((int64_t)nInputTxTime, (int64_t)nTimeTx);
+    if (!fFixedWidth || nWeight <= 0)
+        return CheckBigNum(hashProofOfStake, nTimeTx);
+
+    // nValueIn * nWeight / COIN / nOneDay
+    uint64_t nCoinDayWeight = nValueDays * nWeight + nValueRemainder * nWeight / (COIN * nOneDay);
+
+    return uint320(nTargetPerCoinDay, nCoinDayWeight) >= hashProofOfStake;
+}
+
+bool KernelTarget::CheckBigNum(const uint256& hashProofOfStake, uint32_t nTimeTx) const
+{
+    CBigNum bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
 
-    SHA256_CTX ctx, workerCtx;
+    CBigNum bnCoinDayWeight = CBigNum(nValueIn) * GetWeight((int64_t)nInputTxTime, (int64_t)nTimeTx) / COIN / nOneDay;
+    CBigNum bnTargetProofOfStake = bnCoinDayWeight * bnTargetPerCoinDay;
+
+    return bnTargetProofOfStake >= CBigNum(hashProofOfStake);
+}
+
+KernelWorker::KernelWorker(unsigned char *kernel, uint32_t nBits, uint32_t nInputTxTime, int64_t nValueIn, uint32_t nIntervalBegin, uint32_t nIntervalEnd) 
+        : kernel(kernel), nBits(nBits), nInputTxTime(nInputTxTime), nValueIn(nValueIn), nIntervalBegin(nIntervalBegin), nIntervalEnd(nIntervalEnd)
+    {
+        solutions = vector<std::pair<uint256,uint32_t> >();
+    }
+
+void KernelWorker::Do_generic()
+{
+    // Maximum possible target is used to filter out majority of obviously insufficient hashes
+    KernelTarget target(nBits, nInputTxTime, nValueIn);
+    const uint256& nMaxTarget = target.GetMaxTarget();
+
+    CSHA256 ctx, workerCtx;
     // Init new sha256 context and update it
     //   with first 24 bytes of kernel
-    SHA256_Init(&ctx);
-    SHA256_Update(&ctx, kernel, 8 + 16);
+    ctx.Write(kernel, 8 + 16);
     workerCtx = ctx; // save context
 
     // Sha256 result buffer
@@ -40,30 +151,66 @@ void KernelWorker::Do_generic()
     {
         // Complete first hashing iteration
         uint256 hash1;
-        SHA256_Update(&ctx, (unsigned char*)&nTimeTx, 4);
-        SHA256_Final((unsigned char*)&hash1, &ctx);
+        ctx.Write((unsigned char*)&nTimeTx, 4).Finalize((unsigned char*)&hash1);
 
         // Restore context
         ctx = workerCtx;
 
         // Finally, calculate kernel hash
-        SHA256((unsigned char*)&hash1, sizeof(hashProofOfStake), (unsigned char*)&hashProofOfStake);
+        SHA256_32((unsigned char*)&hashProofOfStake, (unsigned char*)&hash1);
 
         // Skip if hash doesn't satisfy the maximum target
         if (hashProofOfStake[7] > nMaxTarget32)
             continue;
 
-        CBigNum bnCoinDayWeight = bnValueIn * GetWeight((int64_t)nInputTxTime, (int64_t)nTimeTx) / COIN / nOneDay;
-        CBigNum bnTargetProofOfStake = bnCoinDayWeight * bnTargetPerCoinDay;
-
-        if (bnTargetProofOfStake >= CBigNum(*pnHashProofOfStake))
+        if (target.Check(*pnHashProofOfStake, nTimeTx))
             solutions.push_back(std::pair<uint256,uint32_t>(*pnHashProofOfStake, nTimeTx));
     }
 }
 
+void KernelWorker::Do_lanes(const KernelLanesEngine& engine)
+{
+    // Maximum possible target is used to filter out majority of obviously insufficient hashes
+    KernelTarget target(nBits, nInputTxTime, nValueIn);
+    const uint256& nMaxTarget = target.GetMaxTarget();
+    uint32_t nMaxTarget32 = nMaxTarget.Get32(7);
+
+    KernelMidstate midstate;
+    KernelMidstateInit(midstate, kernel);
+
+    alignas(64) uint32_t hashes[8 * MAX_KERNEL_LANES];
+    const uint32_t nLanes = engine.nLanes;
+    const uint32_t nCount = nIntervalEnd > nIntervalBegin ? nIntervalEnd - nIntervalBegin : 0;
+
+    // Search forward in time from the given timestamp
+    // Stopping search in case of shutting down
+    for (uint32_t nOffset = 0; nOffset < nCount && !fShutdown; nOffset += nLanes)
+    {
+        engine.fn(midstate, nIntervalBegin + nOffset, 1, hashes);
+
+        for (uint32_t i = 0; i < nLanes && nOffset + i < nCount; i++)
+        {
+            // Skip if hash doesn't satisfy the maximum target
+            if (ByteReverse(hashes[7 * nLanes + i]) > nMaxTarget32)
+                continue;
+
+            // Candidates are rare enough to be rehashed by reference code
+            uint32_t nTimeTx = nIntervalBegin + nOffset + i;
+            uint256 hashProofOfStake = KernelHashReference(kernel, nTimeTx);
+
+            if (target.Check(hashProofOfStake, nTimeTx))
+                solutions.push_back(std::pair<uint256,uint32_t>(hashProofOfStake, nTimeTx));
+        }
+    }
+}
+
 void KernelWorker::Do()
 {
-    Do_generic();
+    const KernelLanesEngine* pengine = GetKernelEngine();
+    if (pengine)
+        Do_lanes(*pengine);
+    else
+        Do_generic();
 }
 
 vector<pair<uint256,uint32_t> >& KernelWorker::GetSolutions()
@@ -73,47 +220,37 @@ vector<pair<uint256,uint32_t> >& KernelWorker::GetSolutions()
 
 // Scan given kernel for solutions
 
-bool ScanKernelBackward(unsigned char *kernel, uint32_t nBits, uint32_t nInputTxTime, int64_t nValueIn, std::pair<uint32_t, uint32_t> &SearchInterval, std::pair<uint256, uint32_t> &solution)
+static bool ScanKernelBackward_generic(const unsigned char *kernel, const KernelTarget& target, uint32_t nTimeTx, uint32_t nCount, std::pair<uint256, uint32_t> &solution)
 {
-    CBigNum bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
-
-    CBigNum bnValueIn(nValueIn);
-
     // Get maximum possible target to filter out the majority of obviously insufficient hashes
-    uint256 nMaxTarget = (bnTargetPerCoinDay * bnValueIn * nStakeMaxAge / COIN / nOneDay).getuint256();
+    const uint256& nMaxTarget = target.GetMaxTarget();
 
-    SHA256_CTX ctx, workerCtx;
+    CSHA256 ctx, workerCtx;
     // Init new sha256 context and update it
     //   with first 24 bytes of kernel
-    SHA256_Init(&ctx);
-    SHA256_Update(&ctx, kernel, 8 + 16);
+    ctx.Write(kernel, 8 + 16);
     workerCtx = ctx; // save context
 
     // Search backward in time from the given timestamp
     // Stopping search in case of shutting down
-    for (uint32_t nTimeTx=SearchInterval.first; nTimeTx>SearchInterval.second && !fShutdown; nTimeTx--)
+    for (uint32_t nTimeEnd = nTimeTx - nCount; nTimeTx != nTimeEnd && !fShutdown; nTimeTx--)
     {
         // Complete first hashing iteration
         uint256 hash1;
-        SHA256_Update(&ctx, (unsigned char*)&nTimeTx, 4);
-        SHA256_Final((unsigned char*)&hash1, &ctx);
+        ctx.Write((unsigned char*)&nTimeTx, 4).Finalize((unsigned char*)&hash1);
 
         // Restore context
         ctx = workerCtx;
 
         // Finally, calculate kernel hash
         uint256 hashProofOfStake;
-        SHA256((unsigned char*)&hash1, sizeof(hashProofOfStake), (unsigned char*)&hashProofOfStake);
+        SHA256_32((unsigned char*)&hashProofOfStake, (unsigned char*)&hash1);
 
         // Skip if hash doesn't satisfy the maximum target
         if (hashProofOfStake > nMaxTarget)
             continue;
 
-        CBigNum bnCoinDayWeight = bnValueIn * GetWeight((int64_t)nInputTxTime, (int64_t)nTimeTx) / COIN / nOneDay;
-        CBigNum bnTargetProofOfStake = bnCoinDayWeight * bnTargetPerCoinDay;
-
-        if (bnTargetProofOfStake >= CBigNum(hashProofOfStake))
+        if (target.Check(hashProofOfStake, nTimeTx))
         {
             solution.first = hashProofOfStake;
             solution.second = nTimeTx;
@@ -124,3 +261,224 @@ bool ScanKernelBackward(unsigned char *kernel, uint32_t nBits, uint32_t nInputTx
 
     return false;
 }
+
+static bool ScanKernelBackward_lanes(const KernelLanesEngine& engine, const unsigned char *kernel, const KernelMidstate& midstate, const KernelTarget& target, uint32_t nTimeTx, uint32_t nCount, std::pair<uint256, uint32_t> &solution)
+{
+    // Get maximum possible target to filter out the majority of obviously insufficient hashes
+    const uint256& nMaxTarget = target.GetMaxTarget();
+    uint32_t nMaxTarget32 = nMaxTarget.Get32(7);
+
+    alignas(64) uint32_t hashes[8 * MAX_KERNEL_LANES];
+    const uint32_t nLanes = engine.nLanes;
+
+    // Search backward in time from the given timestamp
+    // Stopping search in case of shutting down
+    for (uint32_t nOffset = 0; nOffset < nCount && !fShutdown; nOffset += nLanes)
+    {
+        engine.fn(midstate, nTimeTx - nOffset, -1, hashes);
+
+        // Lanes are ordered by descending timestamp
+        for (uint32_t i = 0; i < nLanes && nOffset + i < nCount; i++)
+        {
+            // Skip if hash doesn't satisfy the maximum target
+            if (ByteReverse(hashes[7 * nLanes + i]) > nMaxTarget32)
+                continue;
+
+            // Candidates are rare enough to be rehashed by reference code
+            uint32_t nTimeCandidate = nTimeTx - nOffset - i;
+            uint256 hashProofOfStake = KernelHashReference(kernel, nTimeCandidate);
+            if (hashProofOfStake > nMaxTarget)
+                continue;
+
+            if (target.Check(hashProofOfStake, nTimeCandidate))
+            {
+                solution.first = hashProofOfStake;
+                solution.second = nTimeCandidate;
+
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool ScanKernelMidstate(const unsigned char *kernel, const KernelMidstate& midstate, const KernelTarget& target, uint32_t nTimeTx, uint32_t nCount, std::pair<uint256, uint32_t> &solution)
+{
+    const KernelLanesEngine* pengine = GetKernelEngine();
+    if (pengine)
+        return ScanKernelBackward_lanes(*pengine, kernel, midstate, target, nTimeTx, nCount, solution);
+
+    return ScanKernelBackward_generic(kernel, target, nTimeTx, nCount, solution);
+}
+
+bool ScanKernelBackward(unsigned char *kernel, uint32_t nBits, uint32_t nInputTxTime, int64_t nValueIn, std::pair<uint32_t, uint32_t> &SearchInterval, std::pair<uint256, uint32_t> &solution)
+{
+    KernelTarget target(nBits, nInputTxTime, nValueIn);
+
+    KernelMidstate midstate;
+    KernelMidstateInit(midstate, kernel);
+
+    const uint32_t nCount = SearchInterval.first > SearchInterval.second ? SearchInterval.first - SearchInterval.second : 0;
+    return ScanKernelMidstate(kernel, midstate, target, SearchInterval.first, nCount, solution);
+}
+
+int nKernelThreads = 0;
+
+namespace {
+
+struct KernelSearchJob
+{
+    const std::function<bool(size_t)>& fnTask;
+    size_t nTasks;
+
+    // Next task to be claimed
+    size_t nNext;
+
+    // Number of claimed tasks which are still running
+    int nActive;
+
+    bool fCancelled;
+};
+
+class KernelSearchPool
+{
+private:
+    // Mutex to protect the inner state
+    std::mutex mutex;
+
+    // Worker threads block on this when out of work
+    std::condition_variable condWorker;
+
+    // Job owners block on this until their tasks are done
+    std::condition_variable condMaster;
+
+    // Quit method blocks on this until all workers are gone
+    std::condition_variable condQuit;
+
+    // Jobs in progress, owned by the threads running them
+    std::list<KernelSearchJob*> jobs;
+
+    // The number of worker threads
+    int nTotal;
+
+    // Whether we're shutting down
+    bool fQuit;
+
+    // Run claimed task, must be called with lock held
+    void RunTask(std::unique_lock<std::mutex>& lock, KernelSearchJob& job, size_t nTask)
+    {
+        lock.unlock();
+        bool fContinue = false;
+        try
+        {
+            fContinue = !fShutdown && job.fnTask(nTask);
+        }
+        catch (std::exception& e) {
+            PrintExceptionContinue(&e, "KernelSearchPool::RunTask()");
+        } catch (...) {
+            PrintExceptionContinue(NULL, "KernelSearchPool::RunTask()");
+        }
+        lock.lock();
+
+        if (!fContinue)
+            job.fCancelled = true;
+        if (--job.nActive == 0 && (job.fCancelled || job.nNext == job.nTasks))
+            condMaster.notify_all();
+    }
+
+public:
+    KernelSearchPool() : nTotal(0), fQuit(false) {}
+
+    // Worker thread
+    void Thread()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        nTotal++;
+        while (!fQuit)
+        {
+            // Claim next task of the oldest job which has any
+            KernelSearchJob* pjob = NULL;
+            for (KernelSearchJob* pitem : jobs)
+            {
+                if (!pitem->fCancelled && pitem->nNext < pitem->nTasks)
+                {
+                    pjob = pitem;
+                    break;
+                }
+            }
+
+            if (pjob == NULL)
+            {
+                condWorker.wait(lock);
+                continue;
+            }
+
+            pjob->nActive++;
+            RunTask(lock, *pjob, pjob->nNext++);
+        }
+        if (--nTotal == 0)
+            condQuit.notify_all();
+    }
+
+    bool Run(size_t nTasks, const std::function<bool(size_t)>& fnTask)
+    {
+        KernelSearchJob job = { fnTask, nTasks, 0, 0, false };
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (fQuit)
+            return false;
+
+        jobs.push_back(&job);
+        condWorker.notify_all();
+
+        // Join the workers until all tasks are claimed
+        while (!job.fCancelled && job.nNext < job.nTasks)
+        {
+            job.nActive++;
+            RunTask(lock, job, job.nNext++);
+        }
+
+        while (job.nActive > 0)
+            condMaster.wait(lock);
+        jobs.remove(&job);
+
+        return !job.fCancelled;
+    }
+
+    // Cancel all jobs and shut the workers down
+    void Quit()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fQuit = true;
+        for (KernelSearchJob* pjob : jobs)
+            pjob->fCancelled = true;
+        condWorker.notify_all();
+
+        while (nTotal > 0)
+            condQuit.wait(lock);
+    }
+};
+
+}
+
+static KernelSearchPool kernelsearchpool;
+
+bool RunKernelSearch(size_t nTasks, const std::function<bool(size_t)>& fnTask)
+{
+    return kernelsearchpool.Run(nTasks, fnTask);
+}
+
+void ThreadKernelSearch(void*)
+{
+    vnThreadsRunning[THREAD_KERNELSEARCH]++;
+    RenameThread("novacoin-kernel");
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+    kernelsearchpool.Thread();
+    vnThreadsRunning[THREAD_KERNELSEARCH]--;
+}
+
+void ThreadKernelSearchQuit()
+{
+    kernelsearchpool.Quit();
+}
@@ -1,12 +1,42 @@
 #ifndef NOVACOIN_KERNELWORKER_H
 #define NOVACOIN_KERNELWORKER_H
 
-#include "bignum.h"
+#include "uint256.h"
+#include "crypto/sha256/kernel-lanes.h"
 
 #include <cstdint>
+#include <functional>
 #include <vector>
 
-class uint256;
+// Coin day weighted kernel target, checked with fixed-width integers
+class KernelTarget
+{
+public:
+    KernelTarget(uint32_t nBits, uint32_t nInputTxTime, int64_t nValueIn);
+
+    // Maximum possible target, to filter out obviously insufficient hashes
+    const uint256& GetMaxTarget() const { return nMaxTarget; }
+
+    // Check kernel hash against the target at given timestamp
+    bool Check(const uint256& hashProofOfStake, uint32_t nTimeTx) const;
+
+    // Reference implementation of the check, with bignums
+    bool CheckBigNum(const uint256& hashProofOfStake, uint32_t nTimeTx) const;
+
+private:
+    uint32_t nBits;
+    uint32_t nInputTxTime;
+    int64_t  nValueIn;
+
+    // Whether fixed-width arithmetics gives the same result as bignums
+    bool fFixedWidth;
+    uint256 nTargetPerCoinDay;
+    uint256 nMaxTarget;
+
+    // Coin value, split by COIN * nOneDay
+    uint64_t nValueDays;
+    uint64_t nValueRemainder;
+};
 
 class KernelWorker
 {
@@ -21,6 +51,9 @@ private:
     // One way hashing.
     void Do_generic();
 
+    // Hashing of several timestamps at once.
+    void Do_lanes(const KernelLanesEngine& engine);
+
     // Kernel solutions.
     std::vector<std::pair<uint256,uint32_t> > solutions;
 
@@ -28,14 +61,37 @@ private:
     uint8_t *kernel;
     uint32_t nBits;
     uint32_t nInputTxTime;
-    CBigNum  bnValueIn;
+    int64_t  nValueIn;
 
     // Interval boundaries.
     uint32_t nIntervalBegin;
     uint32_t nIntervalEnd;
 };
 
+// Scan nCount timestamps of given kernel backward from nTimeTx, with precomputed midstate
+bool ScanKernelMidstate(const unsigned char *kernel, const KernelMidstate& midstate, const KernelTarget& target, uint32_t nTimeTx, uint32_t nCount, std::pair<uint256, uint32_t> &solution);
+
 // Scan given kernel for solutions
 bool ScanKernelBackward(unsigned char *kernel, uint32_t nBits, uint32_t nInputTxTime, int64_t nValueIn, std::pair<uint32_t, uint32_t> &SearchInterval, std::pair<uint256, uint32_t> &solution);
 
+// Name of kernel hashing engine in use
+const char* GetKernelEngineName();
+
+static const int MAX_KERNEL_THREADS = 64;
+extern int nKernelThreads;
+
+// Run kernel search job on the long-lived pool of kernel search threads.
+//
+// Job is split into tasks 0..nTasks-1, which are claimed one at a time by
+// idle threads, the calling thread included, so threads which are done early
+// take over the rest of the work. Task may return false to cancel remaining
+// tasks of its job. All jobs are cancelled on shutdown.
+//
+// Returns false if the job has been cancelled.
+bool RunKernelSearch(size_t nTasks, const std::function<bool(size_t)>& fnTask);
+
+// Kernel search threads
+void ThreadKernelSearch(void* parg);
+void ThreadKernelSearchQuit();
+
 #endif // NOVACOIN_KERNELWORKER_H
@@ -10,6 +10,13 @@
 #include <openssl/ecdsa.h>
 #include <openssl/evp.h>
 
+#ifdef USE_SECP256K1
+#include "random.h"
+
+#include <secp256k1.h>
+#include <secp256k1_recovery.h>
+#endif
+
 
 // Generate a private key from just the secret parameter
 int EC_KEY_regenerate_key(EC_KEY *eckey, BIGNUM *priv_key)
@@ -154,6 +161,25 @@ int CompareBigEndian(const unsigned char *c1, size_t c1len, const unsigned char
     return 0;
 }
 
+#ifdef USE_SECP256K1
+// Shared libsecp256k1 context. It is never modified after randomization,
+// so concurrent script check threads can use it without locking.
+static const secp256k1_context* GetSecp256k1Context()
+{
+    static const secp256k1_context* ctx = []() {
+        secp256k1_context* c = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY | SECP256K1_CONTEXT_SIGN);
+        if (c == nullptr)
+            throw key_error("GetSecp256k1Context() : secp256k1_context_create failed");
+        unsigned char vchSeed[32];
+        GetRandBytes(vchSeed, sizeof(vchSeed));
+        if (!secp256k1_context_randomize(c, vchSeed))
+            throw key_error("GetSecp256k1Context() : secp256k1_context_randomize failed");
+        return c;
+    }();
+    return ctx;
+}
+#endif
+
 // Order of secp256k1's generator minus 1.
 const unsigned char vchMaxModOrder[32] = {
     0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
@@ -365,6 +391,30 @@ CPubKey CKey::GetPubKey() const
 
 bool CKey::Sign(uint256 hash, std::vector<unsigned char>& vchSig)
 {
+#ifdef USE_SECP256K1
+    vchSig.clear();
+    if (EC_KEY_get0_private_key(pkey) == nullptr)
+        return false;
+    const secp256k1_context* ctx = GetSecp256k1Context();
+    CSecret vchSecret = GetSecret();
+
+    // RFC6979 nonce, libsecp256k1 always produces low S values
+    secp256k1_ecdsa_signature sig;
+    if (!secp256k1_ecdsa_sign(ctx, &sig, hash.begin(), &vchSecret[0], secp256k1_nonce_function_rfc6979, nullptr))
+        return false;
+
+    size_t nSize = 72;
+    vchSig.resize(nSize);
+    secp256k1_ecdsa_signature_serialize_der(ctx, &vchSig[0], &nSize, &sig);
+    vchSig.resize(nSize);
+
+    // Testing our new signature
+    if (!GetPubKey().Verify(hash, vchSig)) {
+        vchSig.clear();
+        return false;
+    }
+    return true;
+#else
     vchSig.clear();
     ECDSA_SIG *sig = ECDSA_do_sign(hash.begin(), sizeof(hash), pkey);
     if (sig==nullptr)
@@ -402,6 +452,7 @@ bool CKey::Sign(uint256 hash, std::vector<unsigned char>& vchSig)
         return false;
     }
     return true;
+#endif
 }
 
 // create a compact signature (65 bytes), which allows reconstructing the used public key
@@ -410,6 +461,25 @@ bool CKey::Sign(uint256 hash, std::vector<unsigned char>& vchSig)
 //                  0x1D = second key with even y, 0x1E = second key with odd y
 bool CKey::SignCompact(uint256 hash, std::vector<unsigned char>& vchSig)
 {
+#ifdef USE_SECP256K1
+    if (EC_KEY_get0_private_key(pkey) == nullptr)
+        return false;
+    const secp256k1_context* ctx = GetSecp256k1Context();
+    CSecret vchSecret = GetSecret();
+
+    secp256k1_ecdsa_recoverable_signature sig;
+    if (!secp256k1_ecdsa_sign_recoverable(ctx, &sig, hash.begin(), &vchSecret[0], secp256k1_nonce_function_rfc6979, nullptr))
+        return false;
+
+    int nRecId = -1;
+    vchSig.clear();
+    vchSig.resize(65,0);
+    secp256k1_ecdsa_recoverable_signature_serialize_compact(ctx, &vchSig[1], &nRecId, &sig);
+    if (nRecId < 0 || nRecId > 3)
+        throw key_error("CKey::SignCompact() : unable to construct recoverable key");
+    vchSig[0] = nRecId+27+(IsCompressed() ? 4 : 0);
+    return true;
+#else
     bool fOk = false;
     ECDSA_SIG *sig = ECDSA_do_sign(hash.begin(), sizeof(hash), pkey);
     if (sig==nullptr)
@@ -469,6 +539,7 @@ bool CKey::SignCompact(uint256 hash, std::vector<unsigned char>& vchSig)
 
     ECDSA_SIG_free(sig);
     return fOk;
+#endif
 }
 
 // reconstruct public key from a compact signature
@@ -477,6 +548,35 @@ bool CKey::SignCompact(uint256 hash, std::vector<unsigned char>& vchSig)
 // (the signature is a valid signature of the given data for that key)
 bool CPubKey::SetCompactSignature(uint256 hash, const std::vector<unsigned char>& vchSig)
 {
+#ifdef USE_SECP256K1
+    if (vchSig.size() != 65)
+        return false;
+    int nV = vchSig[0];
+    if (nV<27 || nV>=35)
+        return false;
+    bool fCompressed = false;
+    if (nV >= 31)
+    {
+        nV -= 4;
+        fCompressed = true;
+    }
+
+    const secp256k1_context* ctx = GetSecp256k1Context();
+    secp256k1_ecdsa_recoverable_signature sig;
+    secp256k1_pubkey pubkey;
+    if (!secp256k1_ecdsa_recoverable_signature_parse_compact(ctx, &sig, &vchSig[1], nV - 27) ||
+        !secp256k1_ecdsa_recover(ctx, &pubkey, &sig, hash.begin()))
+    {
+        Invalidate();
+        return false;
+    }
+
+    unsigned char vchPubKey[65];
+    size_t nSize = sizeof(vchPubKey);
+    secp256k1_ec_pubkey_serialize(ctx, vchPubKey, &nSize, &pubkey, fCompressed ? SECP256K1_EC_COMPRESSED : SECP256K1_EC_UNCOMPRESSED);
+    Set(vchPubKey, vchPubKey + nSize);
+    return IsValid();
+#else
     if (vchSig.size() != 65)
         return false;
     int nV = vchSig[0];
@@ -514,6 +614,7 @@ bool CPubKey::SetCompactSignature(uint256 hash, const std::vector<unsigned char>
     if (!fSuccessful)
         Invalidate();
     return fSuccessful;
+#endif
 }
 
 CKeyID CPubKey::GetID() const
@@ -531,38 +632,111 @@ bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchS
     if (vchSig.empty() || !IsValid())
         return false;
 
-    EC_KEY *pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
-    ECDSA_SIG *norm_sig = ECDSA_SIG_new();
+    // Both back ends verify the signature as re-encoded by OpenSSL, so that
+    // they accept exactly the same set of non-canonical DER encodings.
+    std::vector<unsigned char> vchNorm(vchSig);
+    if (!ReserealizeSignature(vchNorm))
+        return false;
 
-    assert(norm_sig);
+#ifdef USE_SECP256K1
+    const secp256k1_context* ctx = GetSecp256k1Context();
+    secp256k1_pubkey pubkey;
+    secp256k1_ecdsa_signature sig;
+    if (!secp256k1_ec_pubkey_parse(ctx, &pubkey, vbytes, size()))
+        return false;
+    if (!secp256k1_ecdsa_signature_parse_der(ctx, &sig, &vchNorm[0], vchNorm.size()))
+        return false;
+
+    // OpenSSL accepts high S values, libsecp256k1 only verifies the lower form
+    secp256k1_ecdsa_signature_normalize(ctx, &sig, &sig);
+    return secp256k1_ecdsa_verify(ctx, &sig, hash.begin(), &pubkey) == 1;
+#else
+    EC_KEY *pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
     assert(pkey);
 
     bool ret = false;
-    do
-    {
-        int derlen;
-        uint8_t *norm_der = NULL;
-        const uint8_t* pbegin = &vbytes[0];
-        const uint8_t* sigptr = &vchSig[0];
-
-        // Trying to parse public key
-        if (!o2i_ECPublicKey(&pkey, &pbegin, size()))
-            break;
-        // New versions of OpenSSL are rejecting a non-canonical DER signatures, de/re-serialize first.
-        if (d2i_ECDSA_SIG(&norm_sig, &sigptr, vchSig.size()) == NULL)
-            break;
-        if ((derlen = i2d_ECDSA_SIG(norm_sig, &norm_der)) <= 0)
-            break;
+    const uint8_t* pbegin = &vbytes[0];
 
+    // Trying to parse public key
+    if (o2i_ECPublicKey(&pkey, &pbegin, size()))
+    {
         // -1 = error, 0 = bad sig, 1 = good
-        ret = ECDSA_verify(0, (const unsigned char*)&hash, sizeof(hash), norm_der, derlen, pkey) == 1;
-        OPENSSL_free(norm_der);
-    } while(false);
+        ret = ECDSA_verify(0, (const unsigned char*)&hash, sizeof(hash), &vchNorm[0], vchNorm.size(), pkey) == 1;
+    }
 
-    ECDSA_SIG_free(norm_sig);
     EC_KEY_free(pkey);
 
     return ret;
+#endif
+}
+
+// Signatures of Hash("DER") by the key with secret Hash("novacoin"), encoded
+// with each DER quirk found in historical blocks. Block validation doesn't
+// enforce strict encoding, so every back end has to agree on these.
+static const struct {
+    const char* pszName;
+    const char* pszSig;
+    bool fValid;
+} vDERTests[] = {
+    { "canonical",
+      "3044022057945cc5167c513f64c958786262ff60994660b2b4e86931e474c0a141742c9f02200694ae0bd77bd5d5ba35a5369f2a04af29fa728d3659ff6bb7221ad854364f3c", true },
+    { "high S",
+      "3045022057945cc5167c513f64c958786262ff60994660b2b4e86931e474c0a141742c9f022100f96b51f428842a2a45ca5ac960d5fb4f90b46a5978eea0d008b043b47bfff205", true },
+    { "long form sequence length",
+      "308144022057945cc5167c513f64c958786262ff60994660b2b4e86931e474c0a141742c9f02200694ae0bd77bd5d5ba35a5369f2a04af29fa728d3659ff6bb7221ad854364f3c", true },
+    { "long form integer length",
+      "304502812057945cc5167c513f64c958786262ff60994660b2b4e86931e474c0a141742c9f02200694ae0bd77bd5d5ba35a5369f2a04af29fa728d3659ff6bb7221ad854364f3c", true },
+    { "trailing garbage",
+      "3044022057945cc5167c513f64c958786262ff60994660b2b4e86931e474c0a141742c9f02200694ae0bd77bd5d5ba35a5369f2a04af29fa728d3659ff6bb7221ad854364f3c01", true },
+    { "padded R",
+      "304502210057945cc5167c513f64c958786262ff60994660b2b4e86931e474c0a141742c9f02200694ae0bd77bd5d5ba35a5369f2a04af29fa728d3659ff6bb7221ad854364f3c", false },
+    { "sequence length too long",
+      "3045022057945cc5167c513f64c958786262ff60994660b2b4e86931e474c0a141742c9f02200694ae0bd77bd5d5ba35a5369f2a04af29fa728d3659ff6bb7221ad854364f3c", false },
+    { "sequence length too short",
+      "3043022057945cc5167c513f64c958786262ff60994660b2b4e86931e474c0a141742c9f02200694ae0bd77bd5d5ba35a5369f2a04af29fa728d3659ff6bb7221ad854364f3c", false },
+    { "negative R",
+      "30440220d7945cc5167c513f64c958786262ff60994660b2b4e86931e474c0a141742c9f02200694ae0bd77bd5d5ba35a5369f2a04af29fa728d3659ff6bb7221ad854364f3c", false },
+    { "empty R",
+      "3024020002200694ae0bd77bd5d5ba35a5369f2a04af29fa728d3659ff6bb7221ad854364f3c", false },
+    { "zero R",
+      "302502010002200694ae0bd77bd5d5ba35a5369f2a04af29fa728d3659ff6bb7221ad854364f3c", false },
+    { "R above 32 bytes",
+      "3045022101010101010101010101010101010101010101010101010101010101010101010102200694ae0bd77bd5d5ba35a5369f2a04af29fa728d3659ff6bb7221ad854364f3c", false },
+    { "wrong integer tag",
+      "3044032057945cc5167c513f64c958786262ff60994660b2b4e86931e474c0a141742c9f02200694ae0bd77bd5d5ba35a5369f2a04af29fa728d3659ff6bb7221ad854364f3c", false },
+};
+
+bool ECDSASelfTest()
+{
+    CPubKey pubKey(ParseHex("031637f39feb3ccefa3f5b02fd9da7649d08ee740d3da99c8d44df15cedc510e75"));
+    uint256 hash("0xd3f6e0818d03d4502bee8e00a6a8734b56f5b1aa9bf4cfdc04cf032138f7fbe9");
+
+    bool fOk = true;
+    for (size_t i = 0; i < sizeof(vDERTests) / sizeof(vDERTests[0]); i++)
+    {
+        if (pubKey.Verify(hash, ParseHex(vDERTests[i].pszSig)) != vDERTests[i].fValid)
+        {
+            printf("ERROR: ECDSASelfTest() : %s signature %s\n", vDERTests[i].pszName, vDERTests[i].fValid ? "rejected" : "accepted");
+            fOk = false;
+        }
+    }
+    return fOk;
+}
+
+bool CPubKey::IsFullyValid() const
+{
+    if (!IsValid())
+        return false;
+#ifdef USE_SECP256K1
+    secp256k1_pubkey pubkey;
+    return secp256k1_ec_pubkey_parse(GetSecp256k1Context(), &pubkey, vbytes, size()) == 1;
+#else
+    const unsigned char* pbegin = &vbytes[0];
+    EC_KEY *pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
+    bool fValid = o2i_ECPublicKey(&pkey, &pbegin, size()) != NULL;
+    EC_KEY_free(pkey);
+    return fValid;
+#endif
 }
 
 bool CPubKey::VerifyCompact(uint256 hash, const std::vector<unsigned char>& vchSig)
@@ -174,17 +174,7 @@ public:
     }
 
     //! fully validate whether this is a valid public key (more expensive than IsValid())
-    bool IsFullyValid() const
-    {
-        const unsigned char* pbegin = &vbytes[0];
-        EC_KEY *pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
-        if (o2i_ECPublicKey(&pkey, &pbegin, size()))
-        {
-            EC_KEY_free(pkey);
-            return true;
-        }
-        return false;
-    }
+    bool IsFullyValid() const;
 
     //! Check whether this is a compressed public key.
     bool IsCompressed() const
@@ -419,4 +409,8 @@ public:
     bool operator <(const CMalleableKeyView& kv) const;
 };
 
+// Check that signatures with non-canonical DER encodings are accepted or
+// rejected in the same way as by the default OpenSSL back end
+bool ECDSASelfTest();
+
 #endif
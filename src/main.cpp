@@ -15,6 +15,7 @@
 #include "random.h"
 #include "wallet.h"
 #include "scrypt.h"
+#include "sigcache.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -135,6 +136,13 @@ void SyncWithWallets(const CTransaction& tx, const CBlock* pblock, bool fUpdate,
                 if (pwallet->IsFromMe(tx))
                     pwallet->DisableTransaction(tx);
         }
+
+        // once per block, as every block starts with a coinbase
+        if (tx.IsCoinBase())
+        {
+            for (CWallet* pwallet : setpwalletRegistered)
+                pwallet->NotifyBlockDisconnected(pwallet);
+        }
         return;
     }
 
@@ -385,7 +393,7 @@ bool CTransaction::AreInputsStandard(const MapPrevTx& mapInputs) const
         // be quick, because if there are any operations
         // beside "push data" in the scriptSig the
         // IsStandard() call returns false
-        std::vector<std::vector<unsigned char> > stack;
+        CScriptStack stack;
         if (!EvalScript(stack, vin[i].scriptSig, *this, i, false, 0))
             return false;
 
@@ -596,6 +604,22 @@ int64_t CTransaction::GetMinFee(unsigned int nBlockSize, bool fAllowFree, enum G
 }
 
 
+// Script verification flags ConnectBlock() uses for the transaction
+static unsigned int GetBlockScriptFlags(const CTransaction& tx)
+{
+    unsigned int nFlags = SCRIPT_VERIFY_P2SH;
+
+    if (tx.nTime >= CHECKLOCKTIMEVERIFY_SWITCH_TIME) {
+        nFlags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    }
+
+    if (tx.nTime >= CHECKSEQUENCEVERIFY_SWITCH_TIME) {
+        nFlags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    }
+
+    return nFlags;
+}
+
 bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx, bool fCheckInputs,
                         bool* pfMissingInputs)
 {
@@ -728,6 +752,16 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx, bool fCheckInputs,
         {
             return error("CTxMemPool::accept() : ConnectInputs failed %s", hash.ToString().substr(0,10).c_str());
         }
+
+        // Once more with the flags of ConnectBlock(), which is cheap with signatures
+        // in the cache by now. Only this result goes into the script execution
+        // cache, so the block including it doesn't verify its scripts again
+        unsigned int nBlockFlags = GetBlockScriptFlags(tx);
+        if (!tx.ConnectInputs(txdb, mapInputs, mapUnused, CDiskTxPos(1,1,1), pindexBest, false, false, true, nBlockFlags))
+        {
+            return error("CTxMemPool::accept() : ConnectInputs failed with block flags %s", hash.ToString().substr(0,10).c_str());
+        }
+        GetScriptExecutionCache().Insert(hash, nBlockFlags);
     }
 
     // Store transaction in memory
@@ -940,12 +974,19 @@ bool CBlock::ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions)
     if (!fReadTransactions)
     {
         *this = pindex->GetBlockHeader();
+        SetCachedHash(pindex->GetBlockHash());
         return true;
     }
-    if (!ReadFromDisk(pindex->nFile, pindex->nBlockPos, fReadTransactions))
+
+    // Indexed block has been verified already, so it's enough to make sure
+    // that the header on disk is the indexed one, without scrypt hashing
+    if (!ReadFromDisk(pindex->nFile, pindex->nBlockPos, fReadTransactions, false))
         return false;
-    if (GetHash() != pindex->GetBlockHash())
-        return error("CBlock::ReadFromDisk() : GetHash() doesn't match index");
+    uint256 hashPrevIndex = pindex->pprev ? pindex->pprev->GetBlockHash() : 0;
+    if (nVersion != pindex->nVersion || hashPrevBlock != hashPrevIndex || hashMerkleRoot != pindex->hashMerkleRoot ||
+        nTime != pindex->nTime || nBits != pindex->nBits || nNonce != pindex->nNonce)
+        return error("CBlock::ReadFromDisk() : block header doesn't match index");
+    SetCachedHash(pindex->GetBlockHash());
     return true;
 }
 
@@ -1237,7 +1278,28 @@ void static InvalidChainFound(CBlockIndex* pindexNew)
 
 uint256 CBlock::GetHash() const
 {
-    return scrypt_blockhash((const uint8_t*)&nVersion);
+    // Scrypt hash is recomputed only if some header field has changed since the last call
+    if (!HasCachedHash())
+        SetCachedHash(scrypt_blockhash((const uint8_t*)&nVersion));
+    return hashCached;
+}
+
+void CBlock::PrecomputeHashes(const std::vector<CBlock*>& vpblocks)
+{
+    std::vector<CBlock*> vpending;
+    std::vector<const uint8_t*> vinputs;
+    for (CBlock* pblock : vpblocks)
+    {
+        if (pblock->HasCachedHash())
+            continue;
+        vpending.push_back(pblock);
+        vinputs.push_back((const uint8_t*)&pblock->nVersion);
+    }
+
+    std::vector<uint256> vhashes(vpending.size());
+    scrypt_blockhash_n(vinputs.data(), vhashes.data(), vinputs.size());
+    for (size_t i = 0; i < vpending.size(); i++)
+        vpending[i]->SetCachedHash(vhashes[i]);
 }
 
 void CBlock::UpdateTime(const CBlockIndex* pindexPrev)
@@ -1410,7 +1472,7 @@ unsigned int CTransaction::GetP2SHSigOpCount(const MapPrevTx& inputs) const
 
 bool CScriptCheck::operator()() const {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, *ptxTo, nIn, nFlags, nHashType))
+    if (!VerifyScript(scriptSig, scriptPubKey, *ptxTo, nIn, nFlags, nHashType, pSighashContext.get()))
         return error("CScriptCheck() : %s VerifySignature failed", ptxTo->GetHash().ToString().substr(0,10).c_str());
     return true;
 }
@@ -1462,6 +1524,15 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, std::map<uint256
         if (pvChecks)
             pvChecks->reserve(vin.size());
 
+        // Scripts already passed with these flags, most likely in the memory pool
+        if (fScriptChecks && GetScriptExecutionCache().Contains(GetHash(), flags))
+            fScriptChecks = false;
+
+        // Signature hashes of all inputs share the serialization of this transaction
+        std::shared_ptr<const CSignatureHashContext> pSighashContext;
+        if (fScriptChecks && vin.size() > 1)
+            pSighashContext = std::make_shared<CSignatureHashContext>(*this);
+
         // The first loop above does all the inexpensive checks.
         // Only if ALL inputs pass do we perform expensive ECDSA signature checks.
         // Helps prevent CPU exhaustion attacks.
@@ -1484,7 +1555,7 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, std::map<uint256
             if (fScriptChecks)
             {
                 // Verify signature
-                CScriptCheck check(txPrev, *this, i, flags, 0);
+                CScriptCheck check(txPrev, *this, i, flags, 0, pSighashContext);
                 if (pvChecks)
                 {
                     pvChecks->push_back(CScriptCheck());
@@ -1495,7 +1566,7 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, std::map<uint256
                     if (flags & STRICT_FLAGS)
                     {
                         // Don't trigger DoS code in case of STRICT_FLAGS caused failure.
-                        CScriptCheck check(txPrev, *this, i, flags & ~STRICT_FLAGS, 0);
+                        CScriptCheck check(txPrev, *this, i, flags & ~STRICT_FLAGS, 0, pSighashContext);
                         if (check())
                             return error("ConnectInputs() : %s strict VerifySignature failed", GetHash().ToString().substr(0,10).c_str());
                     }
@@ -1718,15 +1789,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
             if (!tx.IsCoinStake())
                 nFees += nTxValueIn - nTxValueOut;
 
-            unsigned int nFlags = SCRIPT_VERIFY_NOCACHE | SCRIPT_VERIFY_P2SH;
-
-            if (tx.nTime >= CHECKLOCKTIMEVERIFY_SWITCH_TIME) {
-                nFlags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-            }
-
-            if (tx.nTime >= CHECKSEQUENCEVERIFY_SWITCH_TIME) {
-                nFlags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
-            }
+            unsigned int nFlags = SCRIPT_VERIFY_NOCACHE | GetBlockScriptFlags(tx);
 
             std::vector<CScriptCheck> vChecks;
             if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, fScriptChecks, nFlags, nScriptCheckThreads ? &vChecks : NULL))
@@ -1863,10 +1926,14 @@ bool static Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
     if (!txdb.TxnCommit())
         return error("Reorganize() : TxnCommit failed");
 
-    // Disconnect shorter branch
+    // Disconnect shorter branch. Kernel stake modifiers memoized for older
+    // blocks whose search stopped in this branch are dropped on lookup.
     for (CBlockIndex* pindex : vDisconnect)
+    {
+        pindex->pindexKernelStakeModifierEnd = NULL;
         if (pindex->pprev)
             pindex->pprev->pnext = NULL;
+    }
 
     // Connect longer branch
     for (CBlockIndex* pindex : vConnect)
@@ -2282,7 +2349,7 @@ bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig) c
         return DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"));
 
     // Check merkle root
-    if (fCheckMerkleRoot && hashMerkleRoot != BuildMerkleTree())
+    if (fCheckMerkleRoot && hashMerkleRoot != BuildMerkleRoot())
         return DoS(100, error("CheckBlock() : hashMerkleRoot mismatch"));
 
     return true;
@@ -2947,6 +3014,32 @@ void PrintBlockTree()
     }
 }
 
+// Number of blocks which are read from external file at once
+static const size_t nLoadBatchSize = 16;
+
+// Position right after the next message start bytes at or after nPos,
+// or the maximum value if there are none left in the file
+static unsigned int FindNextMessageStart(FILE* file, unsigned int nPos)
+{
+    unsigned char pchData[65536];
+    do {
+        fseek(file, nPos, SEEK_SET);
+        size_t nRead = fread(pchData, 1, sizeof(pchData), file);
+        if (nRead <= 8)
+            return std::numeric_limits<uint32_t>::max();
+        void* nFind = memchr(pchData, pchMessageStart[0], nRead+1-sizeof(pchMessageStart));
+        if (nFind)
+        {
+            if (memcmp(nFind, pchMessageStart, sizeof(pchMessageStart))==0)
+                return nPos + ((unsigned char*)nFind - pchData) + sizeof(pchMessageStart);
+            nPos += ((unsigned char*)nFind - pchData) + 1;
+        }
+        else
+            nPos += sizeof(pchData) - sizeof(pchMessageStart) + 1;
+    } while(!fRequestShutdown);
+    return nPos;
+}
+
 bool LoadExternalBlockFile(FILE* fileIn)
 {
     int64_t nStart = GetTimeMillis();
@@ -2957,44 +3050,65 @@ bool LoadExternalBlockFile(FILE* fileIn)
         try {
             CAutoFile blkdat(fileIn, SER_DISK, CLIENT_VERSION);
             unsigned int nPos = 0;
-            while (nPos != std::numeric_limits<uint32_t>::max() && blkdat.good() && !fRequestShutdown)
+            bool fEnd = false;
+            while (nPos != std::numeric_limits<uint32_t>::max() && blkdat.good() && !fRequestShutdown && !fEnd)
             {
-                unsigned char pchData[65536];
-                do {
-                    fseek(blkdat, nPos, SEEK_SET);
-                    size_t nRead = fread(pchData, 1, sizeof(pchData), blkdat);
-                    if (nRead <= 8)
-                    {
-                        nPos = std::numeric_limits<uint32_t>::max();
-                        break;
-                    }
-                    void* nFind = memchr(pchData, pchMessageStart[0], nRead+1-sizeof(pchMessageStart));
-                    if (nFind)
+                // Blocks are read in batches, to hash their headers at once
+                std::vector<CBlock> vblocks;
+                std::vector<unsigned int> vPos, vEnd;
+                vblocks.reserve(nLoadBatchSize);
+                try {
+                    while (vblocks.size() < nLoadBatchSize && nPos != std::numeric_limits<uint32_t>::max() && blkdat.good() && !fRequestShutdown)
                     {
-                        if (memcmp(nFind, pchMessageStart, sizeof(pchMessageStart))==0)
-                        {
-                            nPos += ((unsigned char*)nFind - pchData) + sizeof(pchMessageStart);
+                        nPos = FindNextMessageStart(blkdat, nPos);
+                        if (nPos == std::numeric_limits<uint32_t>::max())
                             break;
+                        fseek(blkdat, nPos, SEEK_SET);
+                        unsigned int nSize;
+                        blkdat >> nSize;
+                        if (nSize > 0 && nSize <= MAX_BLOCK_SIZE)
+                        {
+                            CBlock block;
+                            blkdat >> block;
+                            vblocks.push_back(block);
+                            vPos.push_back(nPos);
+                            nPos += 4 + nSize;
+                            vEnd.push_back(nPos);
                         }
-                        nPos += ((unsigned char*)nFind - pchData) + 1;
                     }
-                    else
-                        nPos += sizeof(pchData) - sizeof(pchMessageStart) + 1;
-                } while(!fRequestShutdown);
-                if (nPos == std::numeric_limits<uint32_t>::max())
-                    break;
-                fseek(blkdat, nPos, SEEK_SET);
-                unsigned int nSize;
-                blkdat >> nSize;
-                if (nSize > 0 && nSize <= MAX_BLOCK_SIZE)
+                }
+                catch (const std::exception&) {
+                    printf("%s() : Deserialize or I/O error caught during load\n",
+                           BOOST_CURRENT_FUNCTION);
+                    fEnd = true;
+                }
+
+                std::vector<CBlock*> vpblocks;
+                for (CBlock& block : vblocks)
+                    vpblocks.push_back(&block);
+                CBlock::PrecomputeHashes(vpblocks);
+
+                for (size_t i = 0; i < vblocks.size(); i++)
                 {
-                    CBlock block;
-                    blkdat >> block;
-                    if (ProcessBlock(NULL,&block))
+                    if (ProcessBlock(NULL, &vblocks[i]))
                     {
                         nLoaded++;
-                        nPos += 4 + nSize;
+                        continue;
                     }
+
+                    // The magic bytes may have been a false match, so the next block
+                    // is looked for right after them rather than after the size read
+                    // there. Usually both searches find the same block, which is
+                    // already read and hashed then. Otherwise the rest of the batch
+                    // is read again.
+                    unsigned int nNext = FindNextMessageStart(blkdat, vPos[i]);
+                    if (nNext == std::numeric_limits<uint32_t>::max() || nNext - sizeof(pchMessageStart) >= vEnd[i])
+                        continue;
+
+                    nPos = vPos[i];
+                    fEnd = false;
+                    blkdat.clear();
+                    break;
                 }
             }
         }
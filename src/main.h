@@ -9,11 +9,13 @@
 #include "sync.h"
 #include "net.h"
 #include "script.h"
+#include "merkle.h"
 
 #include <algorithm>
 #include <limits>
 #include <list>
 #include <map>
+#include <memory>
 
 class CWallet;
 class CBlock;
@@ -441,6 +443,12 @@ public:
     mutable int nDoS;
     bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
 
+private:
+    // memory only, txid of deserialized or finalized transaction
+    mutable bool fHashCached;
+    mutable uint256 hashCached;
+
+public:
     CTransaction()
     {
         SetNull();
@@ -454,6 +462,8 @@ public:
         READWRITE(vin);
         READWRITE(vout);
         READWRITE(nLockTime);
+        if (fRead)
+            UpdateHash();
     )
 
     void SetNull()
@@ -464,6 +474,7 @@ public:
         vout.clear();
         nLockTime = 0;
         nDoS = 0;  // Denial-of-service prevention
+        fHashCached = false;
     }
 
     bool IsNull() const
@@ -473,9 +484,25 @@ public:
 
     uint256 GetHash() const
     {
+        if (fHashCached)
+            return hashCached;
         return SerializeHash(*this);
     }
 
+    // Cache txid of the transaction in its final form. Deserialization does it
+    // automatically, so any change of a deserialized or finalized transaction
+    // must be followed by InvalidateHash() or UpdateHash().
+    void UpdateHash() const
+    {
+        hashCached = SerializeHash(*this);
+        fHashCached = true;
+    }
+
+    void InvalidateHash() const
+    {
+        fHashCached = false;
+    }
+
     bool IsFinal(int nBlockHeight=0, int64_t nBlockTime=0) const
     {
         // Time based nLockTime implemented in 0.1.6
@@ -724,12 +751,14 @@ private:
     unsigned int nIn;
     unsigned int nFlags;
     int nHashType;
+    std::shared_ptr<const CSignatureHashContext> pSighashContext;
 
 public:
     CScriptCheck() {}
-    CScriptCheck(const CTransaction& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, int nHashTypeIn) :
+    CScriptCheck(const CTransaction& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, int nHashTypeIn,
+                 const std::shared_ptr<const CSignatureHashContext>& pSighashContextIn = nullptr) :
         scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), nHashType(nHashTypeIn) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), nHashType(nHashTypeIn), pSighashContext(pSighashContextIn) { }
 
     bool operator()() const;
 
@@ -739,6 +768,7 @@ public:
         std::swap(nIn, check.nIn);
         std::swap(nFlags, check.nFlags);
         std::swap(nHashType, check.nHashType);
+        pSighashContext.swap(check.pSighashContext);
     }
 };
 
@@ -887,6 +917,26 @@ public:
     mutable int nDoS;
     bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
 
+private:
+    // memory only, the last computed hash and the header it was computed for
+    mutable bool fHashCached;
+    mutable uint256 hashCached;
+    mutable unsigned char pchHeaderCached[80];
+
+    // Remember the trusted hash of the current header
+    void SetCachedHash(const uint256& hash) const
+    {
+        hashCached = hash;
+        memcpy(pchHeaderCached, &nVersion, sizeof(pchHeaderCached));
+        fHashCached = true;
+    }
+
+    bool HasCachedHash() const
+    {
+        return fHashCached && memcmp(pchHeaderCached, &nVersion, sizeof(pchHeaderCached)) == 0;
+    }
+
+public:
     CBlock()
     {
         SetNull();
@@ -927,6 +977,7 @@ public:
         vchBlockSig.clear();
         vMerkleTree.clear();
         nDoS = 0;
+        fHashCached = false;
     }
 
     bool IsNull() const
@@ -936,6 +987,9 @@ public:
 
     uint256 GetHash() const;
 
+    // Hash headers of several blocks at once, hashes are cached by the blocks
+    static void PrecomputeHashes(const std::vector<CBlock*>& vpblocks);
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -991,25 +1045,31 @@ public:
         return maxTransactionTime;
     }
 
-    uint256 BuildMerkleTree() const
+    std::vector<uint256> GetTxHashes() const
     {
-        vMerkleTree.clear();
+        std::vector<uint256> vHashes;
+        vHashes.reserve(vtx.size());
         for (const CTransaction& tx : vtx)
-            vMerkleTree.push_back(tx.GetHash());
-        int j = 0;
-        for (int nSize = (int)vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
-        {
-            for (int i = 0; i < nSize; i += 2)
-            {
-                int i2 = std::min(i+1, nSize-1);
-                vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                           BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
-            }
-            j += nSize;
-        }
+            vHashes.push_back(tx.GetHash());
+        return vHashes;
+    }
+
+    // Full tree, kept for GetMerkleBranch()
+    uint256 BuildMerkleTree() const
+    {
+        vMerkleTree = GetTxHashes();
+        ComputeMerkleTree(vMerkleTree);
         return (vMerkleTree.empty() ? 0 : vMerkleTree.back());
     }
 
+    // Root only, without tree allocation. Any tree built before is dropped,
+    // since the transactions may have been changed since then.
+    uint256 BuildMerkleRoot() const
+    {
+        vMerkleTree.clear();
+        return ComputeMerkleRoot(GetTxHashes());
+    }
+
     std::vector<uint256> GetMerkleBranch(int nIndex) const
     {
         if (vMerkleTree.empty())
@@ -1068,7 +1128,8 @@ public:
         return true;
     }
 
-    bool ReadFromDisk(unsigned int nFile, unsigned int nBlockPos, bool fReadTransactions=true)
+    // Proof-of-work of the header is checked unless fCheckHeader is false
+    bool ReadFromDisk(unsigned int nFile, unsigned int nBlockPos, bool fReadTransactions=true, bool fCheckHeader=true)
     {
         SetNull();
 
@@ -1088,7 +1149,7 @@ public:
         }
 
         // Check the header
-        if (fReadTransactions && IsProofOfWork() && !CheckProofOfWork(GetHash(), nBits))
+        if (fCheckHeader && fReadTransactions && IsProofOfWork() && !CheckProofOfWork(GetHash(), nBits))
             return error("CBlock::ReadFromDisk() : errors in block header");
 
         return true;
@@ -1169,6 +1230,14 @@ public:
     uint64_t nStakeModifier; // hash modifier for proof-of-stake
     uint32_t nStakeModifierChecksum; // checksum of index; in-memeory only
 
+    // Stake modifier for kernels of coins from this block, memoized by
+    // GetKernelStakeModifier(); in-memory only, guarded by cs_main. Valid
+    // while the block where its search stopped is in the main chain.
+    uint64_t nKernelStakeModifier;
+    int32_t nKernelStakeModifierHeight;
+    int64_t nKernelStakeModifierTime;
+    const CBlockIndex* pindexKernelStakeModifierEnd;
+
     // proof-of-stake specific fields
     COutPoint prevoutStake;
     uint32_t nStakeTime;
@@ -1195,6 +1264,10 @@ public:
         nFlags = 0;
         nStakeModifier = 0;
         nStakeModifierChecksum = 0;
+        nKernelStakeModifier = 0;
+        nKernelStakeModifierHeight = 0;
+        nKernelStakeModifierTime = 0;
+        pindexKernelStakeModifierEnd = NULL;
         hashProofOfStake = 0;
         prevoutStake.SetNull();
         nStakeTime = 0;
@@ -1220,6 +1293,10 @@ public:
         nFlags = 0;
         nStakeModifier = 0;
         nStakeModifierChecksum = 0;
+        nKernelStakeModifier = 0;
+        nKernelStakeModifierHeight = 0;
+        nKernelStakeModifierTime = 0;
+        pindexKernelStakeModifierEnd = NULL;
         hashProofOfStake = 0;
         if (block.IsProofOfStake())
         {
@@ -0,0 +1,53 @@
+#include "merkle.h"
+#include "crypto/sha256/sha256.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void ComputeMerkleLevel(const uint256* pIn, size_t nSize, uint256* pOut)
+{
+    size_t nPairs = nSize / 2;
+    SHA256D64((unsigned char*)pOut, (const unsigned char*)pIn, nPairs);
+
+    if (nSize & 1)
+    {
+        uint256 pair[2] = { pIn[nSize - 1], pIn[nSize - 1] };
+        SHA256D64((unsigned char*)(pOut + nPairs), (const unsigned char*)pair, 1);
+    }
+}
+
+uint256 ComputeMerkleRoot(vector<uint256> vLeaves)
+{
+    if (vLeaves.empty())
+        return 0;
+
+    // Levels go back and forth between two buffers
+    vector<uint256> vLevel((vLeaves.size() + 1) / 2);
+    uint256* pIn = &vLeaves[0];
+    uint256* pOut = &vLevel[0];
+    for (size_t nSize = vLeaves.size(); nSize > 1; nSize = (nSize + 1) / 2)
+    {
+        ComputeMerkleLevel(pIn, nSize, pOut);
+        swap(pIn, pOut);
+    }
+
+    return pIn[0];
+}
+
+void ComputeMerkleTree(vector<uint256>& vTree)
+{
+    // Every level is at most half as long as the previous one, plus one
+    const size_t nLeaves = vTree.size();
+    size_t nTotal = 0;
+    for (size_t nSize = nLeaves; nSize > 1; nSize = (nSize + 1) / 2)
+        nTotal += nSize;
+    vTree.resize(nTotal + (nLeaves ? 1 : 0));
+
+    size_t j = 0;
+    for (size_t nSize = nLeaves; nSize > 1; nSize = (nSize + 1) / 2)
+    {
+        ComputeMerkleLevel(&vTree[j], nSize, &vTree[j + nSize]);
+        j += nSize;
+    }
+}
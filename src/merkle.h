@@ -0,0 +1,24 @@
+#ifndef NOVACOIN_MERKLE_H
+#define NOVACOIN_MERKLE_H
+
+#include "uint256.h"
+
+#include <vector>
+
+// Merkle tree hashing.
+//
+// Sibling pairs of a level are adjacent in memory, so the whole level
+// goes through multi-buffer SHA256D64() at once. The odd last node of a
+// level is paired with itself.
+
+// Hash nSize nodes into (nSize + 1) / 2 parents, pIn and pOut must not overlap
+void ComputeMerkleLevel(const uint256* pIn, size_t nSize, uint256* pOut);
+
+// Root of the tree, inner levels are not kept
+uint256 ComputeMerkleRoot(std::vector<uint256> vLeaves);
+
+// Full tree as stored in CBlock::vMerkleTree: leaves of vTree are followed by
+// every level up to the root
+void ComputeMerkleTree(std::vector<uint256>& vTree);
+
+#endif // NOVACOIN_MERKLE_H
@@ -0,0 +1,98 @@
+#include "midstatemap.h"
+
+#include <cstring>
+
+using namespace std;
+
+void MidstateMap::clear()
+{
+    mapIndex.clear();
+    vKeys.clear();
+    vKernels.clear();
+    vMidstates.clear();
+    vTargets.clear();
+    vTimes.clear();
+    vValues.clear();
+}
+
+void MidstateMap::insert(const key_type& key, const unsigned char *pKernel, uint32_t nTime, uint64_t nValue)
+{
+    if (count(key))
+        erase(key);
+
+    KernelPrefix kernel;
+    memcpy(kernel.data, pKernel, sizeof(kernel.data));
+
+    AlignedMidstate midstate;
+    KernelMidstateInit(midstate.midstate, pKernel);
+
+    mapIndex[key] = vKeys.size();
+    vKeys.push_back(key);
+    vKernels.push_back(kernel);
+    vMidstates.push_back(midstate);
+    vTargets.push_back(KernelTarget(nBits, nTime, nValue));
+    vTimes.push_back(nTime);
+    vValues.push_back(nValue);
+}
+
+void MidstateMap::erase(const key_type& key)
+{
+    map<key_type, size_t>::iterator mi = mapIndex.find(key);
+    if (mi == mapIndex.end())
+        return;
+
+    // Move the last input into the free slot
+    size_t n = mi->second, nLast = vKeys.size() - 1;
+    mapIndex.erase(mi);
+    if (n != nLast)
+    {
+        mapIndex[vKeys[nLast]] = n;
+        vKeys[n] = vKeys[nLast];
+        vKernels[n] = vKernels[nLast];
+        vMidstates[n] = vMidstates[nLast];
+        vTargets[n] = vTargets[nLast];
+        vTimes[n] = vTimes[nLast];
+        vValues[n] = vValues[nLast];
+    }
+
+    vKeys.pop_back();
+    vKernels.pop_back();
+    vMidstates.pop_back();
+    vTargets.pop_back();
+    vTimes.pop_back();
+    vValues.pop_back();
+}
+
+void MidstateMap::erase(const uint256& hashTx)
+{
+    map<key_type, size_t>::iterator mi = mapIndex.lower_bound(key_type(hashTx, 0));
+    while (mi != mapIndex.end() && mi->first.first == hashTx)
+    {
+        key_type key = (mi++)->first;
+        erase(key);
+    }
+}
+
+void MidstateMap::SetBits(uint32_t nBitsIn)
+{
+    if (nBits == nBitsIn)
+        return;
+
+    nBits = nBitsIn;
+    for (size_t n = 0; n < vKeys.size(); n++)
+        vTargets[n] = KernelTarget(nBits, vTimes[n], vValues[n]);
+}
+
+bool MidstateMap::Scan(size_t nBegin, size_t nEnd, uint32_t nTimeTx, uint32_t nCount, size_t &nInput, std::pair<uint256, uint32_t> &solution) const
+{
+    for (size_t n = nBegin; n < nEnd; n++)
+    {
+        if (ScanKernelMidstate(vKernels[n].data, vMidstates[n].midstate, vTargets[n], nTimeTx, nCount, solution))
+        {
+            nInput = n;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,77 @@
+#ifndef NOVACOIN_MIDSTATEMAP_H
+#define NOVACOIN_MIDSTATEMAP_H
+
+#include "uint256.h"
+#include "kernel_worker.h"
+#include "crypto/sha256/kernel-lanes.h"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Stake miner inputs, stored as structure of arrays.
+//
+// Static kernel parts, precomputed kernel midstates, targets, timestamps and
+// values are kept in contiguous arrays, so a scan of the same timestamps for
+// every input walks them sequentially.
+class MidstateMap
+{
+public:
+    // (txid, vout.n)
+    typedef std::pair<uint256, unsigned int> key_type;
+
+    // Timestamps are scanned in blocks of this size for every input,
+    // one call of the widest kernel hashing engine
+    static constexpr uint32_t nTimeBlock = MAX_KERNEL_LANES;
+
+    MidstateMap() : nBits(0) { }
+
+    size_t size() const { return vKeys.size(); }
+    bool empty() const { return vKeys.empty(); }
+    void clear();
+
+    bool count(const key_type& key) const { return mapIndex.count(key) != 0; }
+    const key_type& GetKey(size_t n) const { return vKeys[n]; }
+
+    // Static part of kernel of the input, it starts with the stake modifier
+    const unsigned char* GetKernel(const key_type& key) const { return vKernels[mapIndex.find(key)->second].data; }
+
+    // Add input with the given 24-byte static part of kernel
+    void insert(const key_type& key, const unsigned char *pKernel, uint32_t nTime, uint64_t nValue);
+
+    // Remove input, the last input takes its place
+    void erase(const key_type& key);
+
+    // Remove all inputs of the given transaction
+    void erase(const uint256& hashTx);
+
+    // Set target for the next scans
+    void SetBits(uint32_t nBitsIn);
+
+    // Scan nCount timestamps backward from nTimeTx for inputs [nBegin, nEnd)
+    bool Scan(size_t nBegin, size_t nEnd, uint32_t nTimeTx, uint32_t nCount, size_t &nInput, std::pair<uint256, uint32_t> &solution) const;
+
+private:
+    struct KernelPrefix
+    {
+        unsigned char data[8 + 16];
+    };
+
+    // One cache line per midstate
+    struct alignas(64) AlignedMidstate
+    {
+        KernelMidstate midstate;
+    };
+
+    uint32_t nBits;
+
+    std::map<key_type, size_t> mapIndex;
+    std::vector<key_type> vKeys;
+    std::vector<KernelPrefix> vKernels;
+    std::vector<AlignedMidstate> vMidstates;
+    std::vector<KernelTarget> vTargets;
+    std::vector<uint32_t> vTimes;
+    std::vector<uint64_t> vValues;
+};
+
+#endif // NOVACOIN_MIDSTATEMAP_H
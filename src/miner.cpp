@@ -8,6 +8,7 @@
 #include "miner.h"
 #include "kernel.h"
 #include "kernel_worker.h"
+#include "midstatemap.h"
 #include "wallet.h"
 
 
@@ -40,20 +41,15 @@ static const unsigned int pSHA256InitState[8] =
 
 void SHA256Transform(void* pstate, void* pinput, const void* pinit)
 {
-    SHA256_CTX ctx;
     unsigned char data[64];
-
-    SHA256_Init(&ctx);
+    uint32_t state[8];
 
     for (int i = 0; i < 16; i++)
         ((uint32_t*)data)[i] = ByteReverse(((uint32_t*)pinput)[i]);
 
-    for (int i = 0; i < 8; i++)
-        ctx.h[i] = ((uint32_t*)pinit)[i];
-
-    SHA256_Update(&ctx, data, sizeof(data));
-    for (int i = 0; i < 8; i++)
-        ((uint32_t*)pstate)[i] = ctx.h[i];
+    memcpy(state, pinit, sizeof(state));
+    SHA256Compress(state, data, 1);
+    memcpy(pstate, state, sizeof(state));
 }
 
 // Some explaining would be appreciated
@@ -397,9 +393,10 @@ void IncrementExtraNonce(std::shared_ptr<CBlock>& pblock, CBlockIndex* pindexPre
 
     unsigned int nHeight = pindexPrev->nHeight+1; // Height first in coinbase required for block.version=2
     pblock->vtx[0].vin[0].scriptSig = (CScript() << nHeight << CBigNum(nExtraNonce)) + COINBASE_FLAGS;
+    pblock->vtx[0].InvalidateHash();
     assert(pblock->vtx[0].vin[0].scriptSig.size() <= 100);
 
-    pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+    pblock->hashMerkleRoot = pblock->BuildMerkleRoot();
 }
 
 
@@ -525,9 +522,50 @@ bool CheckStake(const std::shared_ptr<CBlock>& pblock, CWallet& wallet)
     return true;
 }
 
-// Precalculated SHA256 contexts and metadata
-// (txid, vout.n) => (kernel, (tx.nTime, nAmount))
-typedef std::map<std::pair<uint256, unsigned int>, std::pair<std::vector<unsigned char>, std::pair<uint32_t, uint64_t> > > MidstateMap;
+// Build static part of kernel for the given wallet output
+// Returns false if output can't be used for staking yet, nWaitUntil is set for too young outputs
+static bool GetStakeKernel(CTxDB& txdb, const CWalletTx* pcoin, unsigned int nOut, uint32_t nTime, CDataStream& ssKernel, uint32_t& nWaitUntil)
+{
+    CBlock block;
+    CTxIndex txindex;
+
+    // Load transaction index item
+    if (!txdb.ReadTxIndex(pcoin->GetHash(), txindex))
+        return false;
+
+    // Read block header
+    if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
+        return false;
+
+    // Only load coins meeting min age requirement
+    if (nStakeMinAge + block.nTime > nTime - nMaxStakeSearchInterval)
+    {
+        nWaitUntil = nStakeMinAge + block.nTime + nMaxStakeSearchInterval;
+        return false;
+    }
+
+    // Get stake modifier
+    uint64_t nStakeModifier = 0;
+    if (!GetKernelStakeModifier(block.GetHash(), nStakeModifier))
+        return false;
+
+    ssKernel << nStakeModifier;
+    ssKernel << block.nTime << (txindex.pos.nTxPos - txindex.pos.nBlockPos) << pcoin->nTime << nOut;
+
+    return true;
+}
+
+// Only support pay to public key and pay to address
+static bool IsStakeScript(const CScript& scriptPubKey)
+{
+    // Trying to parse scriptPubKey
+    txnouttype whichType;
+    std::vector<valtype> vSolutions;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return false;
+
+    return whichType == TX_PUBKEY || whichType == TX_PUBKEYHASH;
+}
 
 // Fill the inputs map with precalculated contexts and metadata
 bool FillMap(CWallet *pwallet, uint32_t nUpperTime, MidstateMap &inputsMap)
@@ -552,90 +590,291 @@ bool FillMap(CWallet *pwallet, uint32_t nUpperTime, MidstateMap &inputsMap)
         if (setCoins.empty())
             return false;
 
-        CBlock block;
-        CTxIndex txindex;
-
         for(CoinsSet::const_iterator pcoin = setCoins.begin(); pcoin != setCoins.end(); pcoin++)
         {
             std::pair<uint256, uint32_t> key = {pcoin->first->GetHash(), pcoin->second};
 
             // Skip existent inputs
-            if (inputsMap.find(key) != inputsMap.end())
+            if (inputsMap.count(key))
                 continue;
 
-            // Trying to parse scriptPubKey
-            txnouttype whichType;
-            std::vector<valtype> vSolutions;
-            if (!Solver(pcoin->first->vout[pcoin->second].scriptPubKey, whichType, vSolutions))
+            if (!IsStakeScript(pcoin->first->vout[pcoin->second].scriptPubKey))
                 continue;
 
-            // Only support pay to public key and pay to address
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
+            CDataStream ssKernel(SER_GETHASH, 0);
+            uint32_t nWaitUntil;
+            if (!GetStakeKernel(txdb, pcoin->first, pcoin->second, nTime, ssKernel, nWaitUntil))
                 continue;
 
-            // Load transaction index item
-            if (!txdb.ReadTxIndex(pcoin->first->GetHash(), txindex))
-                continue;
+            // (txid, vout.n) => (kernel, tx.nTime, nAmount)
+            inputsMap.insert(key, (unsigned char *)&ssKernel.begin()[0], pcoin->first->nTime, pcoin->first->vout[pcoin->second].nValue);
+        }
 
-            // Read block header
-            if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
-                continue;
+        nStakeInputsMapSize = inputsMap.size();
+
+        if (fDebug)
+            printf("FillMap() : Map of %" PRIu64 " precalculated contexts has been created by stake miner\n", nStakeInputsMapSize);
+    }
 
-            // Only load coins meeting min age requirement
-            if (nStakeMinAge + block.nTime > nTime - nMaxStakeSearchInterval)
+    return true;
+}
+
+// Wallet transactions changed since the last update of inputs map
+static CCriticalSection cs_setStakeTxChanged;
+static std::set<uint256> setStakeTxChanged;
+
+// Wallet transactions with outputs which may become usable for staking later
+// hash => time to check them again, zero for the next block
+static std::map<uint256, uint32_t> mapStakeTxWaiting;
+
+// Whether blocks have been disconnected since the last update of inputs map
+static bool fStakeBlockDisconnected = false;
+
+static void NotifyStakeTxChanged(CWallet *wallet, const uint256 &hashTx, ChangeType status)
+{
+    LOCK(cs_setStakeTxChanged);
+    setStakeTxChanged.insert(hashTx);
+}
+
+static void NotifyStakeBlockDisconnected(CWallet *wallet)
+{
+    LOCK(cs_setStakeTxChanged);
+    fStakeBlockDisconnected = true;
+}
+
+// Add usable outputs of wallet transaction to the inputs map and remove the rest
+// Outputs already in the map are checked again if fDisconnected is set
+// Returns true if some outputs may become usable later, not earlier than nWaitUntil
+static bool UpdateMapTx(CWallet *pwallet, CTxDB& txdb, const uint256& hashTx, uint32_t nUpperTime, uint32_t nTime, bool fDisconnected, MidstateMap &inputsMap, uint32_t& nWaitUntil)
+{
+    std::map<uint256, CWalletTx>::const_iterator mi = pwallet->mapWallet.find(hashTx);
+    if (mi == pwallet->mapWallet.end())
+    {
+        inputsMap.erase(hashTx);
+        return false;
+    }
+
+    const CWalletTx& wtx = mi->second;
+    int nDepth = wtx.GetDepthInMainChain();
+    bool fWaiting = false;
+    nWaitUntil = std::numeric_limits<uint32_t>::max();
+
+    // Disconnected blocks may have provided the stake modifier for kernels in the map
+    CDataStream ssModifier(SER_GETHASH, 0);
+    if (fDisconnected)
+    {
+        uint64_t nStakeModifier;
+        if (nDepth > 0 && GetKernelStakeModifier(wtx.hashBlock, nStakeModifier))
+            ssModifier << nStakeModifier;
+    }
+
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+    {
+        MidstateMap::key_type key(hashTx, i);
+        const CTxOut& txout = wtx.vout[i];
+
+        // Same rules as for SelectCoinsSimple() in FillMap()
+        if (nDepth < 0 || wtx.IsSpent(i) || pwallet->IsMine(txout) != MINE_SPENDABLE || txout.nValue < MIN_TX_FEE || txout.nValue >= MAX_MONEY || !IsStakeScript(txout.scriptPubKey))
+        {
+            inputsMap.erase(key);
+            continue;
+        }
+
+        if (inputsMap.count(key))
+        {
+            if (!fDisconnected)
                 continue;
 
-            // Get stake modifier
-            uint64_t nStakeModifier = 0;
-            if (!GetKernelStakeModifier(block.GetHash(), nStakeModifier))
+            // Kept while still mature and with the same stake modifier
+            if (wtx.IsFinal() && nDepth >= nCoinbaseMaturity * 10 && wtx.GetBlocksToMaturity() == 0 &&
+                ssModifier.size() == sizeof(uint64_t) && memcmp(inputsMap.GetKernel(key), &ssModifier[0], sizeof(uint64_t)) == 0)
                 continue;
+        }
 
-            // Build static part of kernel
-            CDataStream ssKernel(SER_GETHASH, 0);
-            ssKernel << nStakeModifier;
-            ssKernel << block.nTime << (txindex.pos.nTxPos - txindex.pos.nBlockPos) << pcoin->first->nTime << pcoin->second;
+        // Immature, unconfirmed and too young outputs are checked again later
+        CDataStream ssKernel(SER_GETHASH, 0);
+        uint32_t nOutputWaitUntil = 0;
+        if (!wtx.IsFinal() || nDepth < nCoinbaseMaturity * 10 || wtx.GetBlocksToMaturity() > 0 || wtx.nTime > nUpperTime || !GetStakeKernel(txdb, &wtx, i, nTime, ssKernel, nOutputWaitUntil))
+        {
+            inputsMap.erase(key);
+            fWaiting = true;
+            nWaitUntil = std::min(nWaitUntil, nOutputWaitUntil);
+            continue;
+        }
+
+        // (txid, vout.n) => (kernel, tx.nTime, nAmount)
+        inputsMap.insert(key, (unsigned char *)&ssKernel.begin()[0], wtx.nTime, txout.nValue);
+    }
+
+    return fWaiting;
+}
 
-            // (txid, vout.n) => (kernel, (tx.nTime, nAmount))
-            inputsMap[key] = {std::vector<unsigned char>(ssKernel.begin(), ssKernel.end()), {pcoin->first->nTime, pcoin->first->vout[pcoin->second].nValue}};
+// Apply wallet changes to the inputs map and recheck waiting transactions
+void UpdateMap(CWallet *pwallet, uint32_t nUpperTime, MidstateMap &inputsMap, bool fNewBlock)
+{
+    std::set<uint256> setChanged;
+    bool fDisconnected;
+    {
+        LOCK(cs_setStakeTxChanged);
+        setChanged.swap(setStakeTxChanged);
+        fDisconnected = fStakeBlockDisconnected;
+        fStakeBlockDisconnected = false;
+    }
+
+    // Depth and stake modifiers of inputs in the map may have changed
+    if (fDisconnected)
+    {
+        for (size_t i = 0; i < inputsMap.size(); i++)
+            setChanged.insert(inputsMap.GetKey(i).first);
+    }
+
+    uint32_t nTime = GetAdjustedTime();
+
+    for (std::map<uint256, uint32_t>::iterator mi = mapStakeTxWaiting.begin(); mi != mapStakeTxWaiting.end(); )
+    {
+        if (mi->second > nTime || (mi->second == 0 && !fNewBlock))
+        {
+            mi++;
+            continue;
         }
+        setChanged.insert(mi->first);
+        mapStakeTxWaiting.erase(mi++);
+    }
 
-        nStakeInputsMapSize = inputsMap.size();
+    if (setChanged.empty())
+        return;
 
-        if (fDebug)
-            printf("FillMap() : Map of %" PRIu64 " precalculated contexts has been created by stake miner\n", nStakeInputsMapSize);
+    CTxDB txdb("r");
+
+    // Locks are released between batches to let other threads in
+    const size_t nBatchSize = 100;
+    std::set<uint256>::const_iterator it = setChanged.begin();
+    while (it != setChanged.end() && !fShutdown)
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        for (size_t n = 0; n < nBatchSize && it != setChanged.end(); n++, it++)
+        {
+            uint32_t nWaitUntil;
+            if (UpdateMapTx(pwallet, txdb, *it, nUpperTime, nTime, fDisconnected, inputsMap, nWaitUntil))
+                mapStakeTxWaiting[*it] = nWaitUntil;
+            else
+                mapStakeTxWaiting.erase(*it);
+        }
     }
 
+    nStakeInputsMapSize = inputsMap.size();
+
+    if (fDebug)
+        printf("UpdateMap() : %" PRIszu " wallet transactions checked, %" PRIu64 " inputs in map\n", setChanged.size(), nStakeInputsMapSize);
+}
+
+// Bring the inputs map up to date
+// Coins are selected by FillMap() while some balance is reserved,
+//   otherwise wallet changes are applied to the map as they come.
+static bool RefreshMap(CWallet *pwallet, MidstateMap &inputsMap, bool fNewBlock, bool &fIncremental)
+{
+    if (nReserveBalance > 0)
+    {
+        fIncremental = false;
+        if (!fNewBlock)
+            return true;
+
+        // Inputs are selected from scratch after reorganization
+        {
+            LOCK(cs_setStakeTxChanged);
+            if (fStakeBlockDisconnected)
+                inputsMap.clear();
+            fStakeBlockDisconnected = false;
+        }
+        return FillMap(pwallet, GetAdjustedTime(), inputsMap);
+    }
+
+    if (!fIncremental)
+    {
+        // Check the whole wallet once
+        LOCK2(pwallet->cs_wallet, cs_setStakeTxChanged);
+        for (std::map<uint256, CWalletTx>::const_iterator mi = pwallet->mapWallet.begin(); mi != pwallet->mapWallet.end(); mi++)
+            setStakeTxChanged.insert(mi->first);
+        fIncremental = true;
+    }
+
+    UpdateMap(pwallet, GetAdjustedTime(), inputsMap, fNewBlock);
     return true;
 }
 
+// Scan nSearchCount timestamps backward from nSearchTime for every input of the map
+bool ScanMapInterval(const MidstateMap &inputsMap, uint32_t nSearchTime, uint32_t nSearchCount, const CBlockIndex* pindexPrev, std::pair<uint256, unsigned int> &LuckyInput, std::pair<uint256, uint32_t> &solution, bool &fComplete)
+{
+    // Inputs are split into tasks for kernel search threads
+    const size_t nInputsPerTask = 64;
+    const size_t nTasks = (inputsMap.size() + nInputsPerTask - 1) / nInputsPerTask;
+
+    fComplete = true;
+
+    // The freshest timestamps are checked for every input first
+    for (uint32_t nOffset = 0; nOffset < nSearchCount; nOffset += MidstateMap::nTimeBlock)
+    {
+        uint32_t nTimeTx = nSearchTime - nOffset;
+        uint32_t nCount = std::min(nSearchCount - nOffset, MidstateMap::nTimeBlock);
+
+        std::mutex mutexSolution;
+        bool fFound = false;
+
+        fComplete = RunKernelSearch(nTasks, [&](size_t nTask) {
+            // New best block makes this search obsolete
+            if (pindexBest != pindexPrev)
+                return false;
+
+            size_t nBegin = nTask * nInputsPerTask;
+            size_t nEnd = std::min(nBegin + nInputsPerTask, inputsMap.size());
+
+            size_t nInput;
+            std::pair<uint256, uint32_t> inputSolution;
+            if (!inputsMap.Scan(nBegin, nEnd, nTimeTx, nCount, nInput, inputSolution))
+                return true;
+
+            // Solution found, cancel the rest of search
+            std::lock_guard<std::mutex> lock(mutexSolution);
+            if (!fFound || inputSolution.second > solution.second)
+            {
+                fFound = true;
+                LuckyInput = inputsMap.GetKey(nInput); // (txid, nout)
+                solution = inputSolution;
+            }
+
+            return false;
+        });
+
+        if (fFound)
+            return true;
+
+        if (!fComplete)
+            return false;
+    }
+
+    return false;
+}
+
 // Scan inputs map in order to find a solution
-bool ScanMap(const MidstateMap &inputsMap, uint32_t nBits, MidstateMap::key_type &LuckyInput, std::pair<uint256, uint32_t> &solution)
+bool ScanMap(MidstateMap &inputsMap, uint32_t nBits, MidstateMap::key_type &LuckyInput, std::pair<uint256, uint32_t> &solution)
 {
     static uint32_t nLastCoinStakeSearchTime = GetAdjustedTime(); // startup timestamp
     uint32_t nSearchTime = GetAdjustedTime();
 
     if (inputsMap.size() > 0 && nSearchTime > nLastCoinStakeSearchTime)
     {
-        // Scanning interval (begintime, endtime)
-        std::pair<uint32_t, uint32_t> interval;
-
-        interval.first = nSearchTime;
-        interval.second = nSearchTime - std::min(nSearchTime-nLastCoinStakeSearchTime, nMaxStakeSearchInterval);
+        // Scanning interval (begintime - count, begintime]
+        uint32_t nSearchCount = std::min(nSearchTime-nLastCoinStakeSearchTime, nMaxStakeSearchInterval);
 
-        // (txid, nout) => (kernel, (tx.nTime, nAmount))
-        for(MidstateMap::const_iterator input = inputsMap.begin(); input != inputsMap.end(); input++)
-        {
-            unsigned char *kernel = (unsigned char *) &input->second.first[0];
+        inputsMap.SetBits(nBits);
 
-            // scan(State, Bits, Time, Amount, ...)
-            if (ScanKernelBackward(kernel, nBits, input->second.second.first, input->second.second.second, interval, solution))
-            {
-                // Solution found
-                LuckyInput = input->first; // (txid, nout)
+        bool fComplete;
+        if (ScanMapInterval(inputsMap, nSearchTime, nSearchCount, pindexBest, LuckyInput, solution, fComplete))
+            return true;
 
-                return true;
-            }
-        }
+        // Cancelled search will be repeated for the same interval
+        if (!fComplete)
+            return false;
 
         // Inputs map iteration can be big enough to consume few seconds while scanning.
         // We're using dynamical calculation of scanning interval in order to compensate this delay.
@@ -656,8 +895,13 @@ void ThreadStakeMiner(void* parg)
     RenameThread("novacoin-miner");
     CWallet* pwallet = (CWallet*)parg;
 
+    // Wallet changes are collected for the inputs map from now on
+    boost::signals2::scoped_connection connTxChanged(pwallet->NotifyTransactionChanged.connect(&NotifyStakeTxChanged));
+    boost::signals2::scoped_connection connBlockDisconnected(pwallet->NotifyBlockDisconnected.connect(&NotifyStakeBlockDisconnected));
+
+    bool fIncremental = false;
     MidstateMap inputsMap;
-    if (!FillMap(pwallet, GetAdjustedTime(), inputsMap))
+    if (!RefreshMap(pwallet, inputsMap, true, fIncremental))
         return;
 
     bool fTrySync = true;
@@ -707,12 +951,14 @@ void ThreadStakeMiner(void* parg)
                 }
             }
 
+            RefreshMap(pwallet, inputsMap, false, fIncremental);
+
             if (ScanMap(inputsMap, nBits, LuckyInput, solution))
             {
                 SetThreadPriority(THREAD_PRIORITY_NORMAL);
 
                 // Remove lucky input from the map
-                inputsMap.erase(inputsMap.find(LuckyInput));
+                inputsMap.erase(LuckyInput);
 
                 CKey key;
                 CTransaction txCoinStake;
@@ -758,8 +1004,8 @@ void ThreadStakeMiner(void* parg)
 
             if (pindexPrev != pindexBest)
             {
-                // The best block has been changed, we need to refill the map
-                if (FillMap(pwallet, GetAdjustedTime(), inputsMap))
+                // The best block has been changed, we need to update the map
+                if (RefreshMap(pwallet, inputsMap, true, fIncremental))
                 {
                     pindexPrev = pindexBest;
                     nBits = GetNextTargetRequired(pindexPrev, true);
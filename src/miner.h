@@ -6,13 +6,17 @@
 #ifndef NOVACOIN_MINER_H
 #define NOVACOIN_MINER_H
 
+#include <cstdint>
 #include <memory>
+#include <utility>
 
 class CBlock;
 class CBlockIndex;
 class CTransaction;
 class CReserveKey;
 class CWallet;
+class MidstateMap;
+class uint256;
 
 /* Generate a new block, without valid proof-of-work/with provided proof-of-stake */
 std::shared_ptr<CBlock> CreateNewBlock(CWallet* pwallet, CTransaction *txAdd=nullptr);
@@ -32,6 +36,10 @@ bool CheckStake(const std::shared_ptr<CBlock>& pblock, CWallet& wallet);
 /** Base sha256 mining transform */
 void SHA256Transform(void* pstate, void* pinput, const void* pinit);
 
+/** Scan nSearchCount timestamps backward from nSearchTime for every input of the map.
+ *  Search is abandoned (fComplete is false) once the best block is not pindexPrev. */
+bool ScanMapInterval(const MidstateMap &inputsMap, uint32_t nSearchTime, uint32_t nSearchCount, const CBlockIndex* pindexPrev, std::pair<uint256, unsigned int> &LuckyInput, std::pair<uint256, uint32_t> &solution, bool &fComplete);
+
 /** Stake miner thread */
 void ThreadStakeMiner(void* parg);
 
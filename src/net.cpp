@@ -11,6 +11,8 @@
 #include "interface.h"
 #include "main.h"
 #include "miner.h"
+#include "kernel_worker.h"
+#include "kernel_scan.h"
 #include "ntp.h"
 #include "random.h"
 
@@ -1842,6 +1844,8 @@ bool StopNode()
         LOCK(cs_main);
         ThreadScriptCheckQuit();
     }
+    ThreadKernelScanQuit();
+    ThreadKernelSearchQuit();
     if (semOutbound)
         for (int i=0; i<MAX_OUTBOUND_CONNECTIONS; i++)
             semOutbound->post();
@@ -1866,6 +1870,8 @@ bool StopNode()
     if (vnThreadsRunning[THREAD_DUMPADDRESS] > 0) printf("ThreadDumpAddresses still running\n");
     if (vnThreadsRunning[THREAD_MINTER] > 0) printf("ThreadStakeMinter still running\n");
     if (vnThreadsRunning[THREAD_SCRIPTCHECK] > 0) printf("ThreadScriptCheck still running\n");
+    if (vnThreadsRunning[THREAD_KERNELSEARCH] > 0) printf("ThreadKernelSearch still running\n");
+    if (vnThreadsRunning[THREAD_KERNELSCAN] > 0) printf("ThreadKernelScan still running\n");
     while (vnThreadsRunning[THREAD_MESSAGEHANDLER] > 0 || vnThreadsRunning[THREAD_RPCHANDLER] > 0 || vnThreadsRunning[THREAD_SCRIPTCHECK] > 0)
         Sleep(20);
     Sleep(50);
@@ -94,6 +94,8 @@ enum threadId
     THREAD_SCRIPTCHECK,
     THREAD_NTP,
     THREAD_IPCOLLECTOR,
+    THREAD_KERNELSEARCH,
+    THREAD_KERNELSCAN,
 
     THREAD_MAX
 };
@@ -471,6 +471,7 @@ void MultisigDialog::on_signTransactionButton_clicked()
         }
         const CScript& prevPubKey = mapPrevOut[txin.prevout];
 
+        mergedTx.InvalidateHash();
         txin.scriptSig.clear();
         SignSignature(*wallet, prevPubKey, mergedTx, i, SIGHASH_ALL);
         txin.scriptSig = CombineSignatures(prevPubKey, mergedTx, i, txin.scriptSig, tx.vin[i].scriptSig);
@@ -8,6 +8,8 @@
 #include "init.h"
 #include "miner.h"
 #include "kernel.h"
+#include "kernel_worker.h"
+#include "kernel_scan.h"
 #include "bitcoinrpc.h"
 #include "wallet.h"
 
@@ -63,27 +65,16 @@ Value getmininginfo(const Array& params, bool fHelp)
     obj.push_back(Pair("pooledtx",      (uint64_t)mempool.size()));
 
     obj.push_back(Pair("stakeinputs",   (uint64_t)nStakeInputsMapSize));
+    obj.push_back(Pair("kernelengine",  GetKernelEngineName()));
     obj.push_back(Pair("stakeinterest", GetProofOfStakeReward(0, GetLastBlockIndex(pindexBest, true)->nBits, GetLastBlockIndex(pindexBest, true)->nTime, true)));
 
     obj.push_back(Pair("testnet",       fTestNet));
     return obj;
 }
 
-// scaninput '{"txid":"95d640426fe66de866a8cf2d0601d2c8cf3ec598109b4d4ffa7fd03dad6d35ce","difficulty":0.01, "days":10}'
-Value scaninput(const Array& params, bool fHelp)
+// Parse scaninput parameters and build static parts of kernels for the requested outputs
+static void GetScanInputs(const Object& scanParams, vector<KernelScanInput>& vInputs, uint32_t& nBits, std::pair<uint32_t, uint32_t>& interval)
 {
-    if (fHelp || params.size() != 1)
-        throw runtime_error(
-            "scaninput '{\"txid\":\"txid\", \"vout\":[vout1, vout2, ..., voutN], \"difficulty\":difficulty, \"days\":days}'\n"
-            "Scan specified transaction or input for suitable kernel solutions.\n"
-            "    difficulty - upper limit for difficulty, current difficulty by default;\n"
-            "    days - time window, 90 days by default.\n"
-        );
-
-    RPCTypeCheck(params, { obj_type });
-
-    Object scanParams = params[0].get_obj();
-
     const Value& txid_v = find_value(scanParams, "txid");
     if (txid_v.type() != str_type)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, missing txid key");
@@ -94,7 +85,7 @@ Value scaninput(const Array& params, bool fHelp)
 
     uint256 hash(txid);
     int32_t nDays = 90;
-    uint32_t nBits = GetNextTargetRequired(pindexBest, true);
+    nBits = GetNextTargetRequired(pindexBest, true);
 
     const Value& diff_v = find_value(scanParams, "difficulty");
     if (diff_v.type() == real_type || diff_v.type() == int_type)
@@ -120,32 +111,20 @@ Value scaninput(const Array& params, bool fHelp)
 
     CTransaction tx;
     uint256 hashBlock = 0;
-    if (GetTransaction(hash, tx, hashBlock))
-    {
-        if (hashBlock == 0)
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to find transaction in the blockchain");
+    if (!GetTransaction(hash, tx, hashBlock))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available about transaction");
 
-        vector<int> vInputs(0);
-        const Value& inputs_v = find_value(scanParams, "vout");
-        if (inputs_v.type() == array_type)
-        {
-            Array inputs = inputs_v.get_array();
-            for (const Value &v_out : inputs)
-            {
-                int nOut = v_out.get_int();
-                if (nOut < 0 || nOut > (int)tx.vout.size() - 1)
-                {
-                    stringstream strErrorMsg;
-                    strErrorMsg << "Invalid parameter, input number " << to_string(nOut) << " is out of range";
-                    throw JSONRPCError(RPC_INVALID_PARAMETER, strErrorMsg.str());
-                }
+    if (hashBlock == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to find transaction in the blockchain");
 
-                vInputs.push_back(nOut);
-            }
-        }
-        else if(inputs_v.type() == int_type)
+    vector<int> vOuts(0);
+    const Value& inputs_v = find_value(scanParams, "vout");
+    if (inputs_v.type() == array_type)
+    {
+        Array inputs = inputs_v.get_array();
+        for (const Value &v_out : inputs)
         {
-            int nOut = inputs_v.get_int();
+            int nOut = v_out.get_int();
             if (nOut < 0 || nOut > (int)tx.vout.size() - 1)
             {
                 stringstream strErrorMsg;
@@ -153,77 +132,214 @@ Value scaninput(const Array& params, bool fHelp)
                 throw JSONRPCError(RPC_INVALID_PARAMETER, strErrorMsg.str());
             }
 
-            vInputs.push_back(nOut);
+            vOuts.push_back(nOut);
         }
-        else
+    }
+    else if(inputs_v.type() == int_type)
+    {
+        int nOut = inputs_v.get_int();
+        if (nOut < 0 || nOut > (int)tx.vout.size() - 1)
         {
-            for (size_t i = 0; i != tx.vout.size(); ++i) vInputs.push_back(i);
+            stringstream strErrorMsg;
+            strErrorMsg << "Invalid parameter, input number " << to_string(nOut) << " is out of range";
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strErrorMsg.str());
         }
 
-        CTxDB txdb("r");
+        vOuts.push_back(nOut);
+    }
+    else
+    {
+        for (size_t i = 0; i != tx.vout.size(); ++i) vOuts.push_back(i);
+    }
+
+    CTxDB txdb("r");
+
+    CBlock block;
+    CTxIndex txindex;
+
+    // Load transaction index item
+    if (!txdb.ReadTxIndex(tx.GetHash(), txindex))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to read block index item");
 
-        CBlock block;
-        CTxIndex txindex;
+    // Read block header
+    if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "CBlock::ReadFromDisk() failed");
 
-        // Load transaction index item
-        if (!txdb.ReadTxIndex(tx.GetHash(), txindex))
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to read block index item");
+    uint64_t nStakeModifier = 0;
+    if (!GetKernelStakeModifier(block.GetHash(), nStakeModifier))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No kernel stake modifier generated yet");
 
-        // Read block header
-        if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "CBlock::ReadFromDisk() failed");
+    interval.first = GetTime();
+    // Only count coins meeting min age requirement
+    if (nStakeMinAge + block.nTime > interval.first)
+        interval.first += (nStakeMinAge + block.nTime - interval.first);
+    interval.second = interval.first + nDays * nOneDay;
 
-        uint64_t nStakeModifier = 0;
-        if (!GetKernelStakeModifier(block.GetHash(), nStakeModifier))
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No kernel stake modifier generated yet");
+    vInputs.clear();
+    for (const int &nOut : vOuts)
+    {
+        // Check for spent flag
+        // It doesn't make sense to scan spent inputs.
+        if (!txindex.vSpent[nOut].IsNull())
+            continue;
+
+        // Skip zero value outputs
+        if (tx.vout[nOut].nValue == 0)
+            continue;
 
-        std::pair<uint32_t, uint32_t> interval;
-        interval.first = GetTime();
-        // Only count coins meeting min age requirement
-        if (nStakeMinAge + block.nTime > interval.first)
-            interval.first += (nStakeMinAge + block.nTime - interval.first);
-        interval.second = interval.first + nDays * nOneDay;
+        // Build static part of kernel
+        CDataStream ssKernel(SER_GETHASH, 0);
+        ssKernel << nStakeModifier;
+        ssKernel << block.nTime << (txindex.pos.nTxPos - txindex.pos.nBlockPos) << tx.nTime << nOut;
+
+        KernelScanInput input;
+        memcpy(input.kernel, &ssKernel.begin()[0], sizeof(input.kernel));
+        input.nInputTxTime = tx.nTime;
+        input.nValueIn = tx.vout[nOut].nValue;
+        input.nOut = nOut;
+        vInputs.push_back(input);
+    }
+}
 
+static Object ScanSolutionToJSON(uint32_t nOut, const uint256& hashProofOfStake, uint32_t nTime)
+{
+    Object item;
+    item.push_back(Pair("nout", (int)nOut));
+    item.push_back(Pair("hash", hashProofOfStake.GetHex()));
+    item.push_back(Pair("time", DateTimeStrFormat(nTime)));
+    return item;
+}
+
+static Object ScanStatusToJSON(int64_t nScan, const KernelScanStatus& status, bool fSolutions)
+{
+    static const char* pszStates[] = { "running", "done", "cancelled" };
+
+    Object obj;
+    obj.push_back(Pair("scan", nScan));
+    obj.push_back(Pair("state", pszStates[status.nState]));
+    obj.push_back(Pair("progress", status.nTotal ? (double)status.nScanned / status.nTotal : 1.0));
+    obj.push_back(Pair("scanned", (uint64_t)status.nScanned));
+    obj.push_back(Pair("total", (uint64_t)status.nTotal));
+    obj.push_back(Pair("starttime", DateTimeStrFormat(status.nStartTime)));
+    if (status.nState != KernelScanStatus::RUNNING)
+        obj.push_back(Pair("endtime", DateTimeStrFormat(status.nEndTime)));
+    obj.push_back(Pair("solutions", (uint64_t)status.nSolutions));
+
+    if (fSolutions)
+    {
         Array results;
-        for (const int &nOut : vInputs)
+        for (const auto &solution : status.vSolutions)
+            results.push_back(ScanSolutionToJSON(solution.nOut, solution.hashProofOfStake, solution.nTime));
+        obj.push_back(Pair("results", results));
+    }
+
+    return obj;
+}
+
+// scaninput '{"txid":"95d640426fe66de866a8cf2d0601d2c8cf3ec598109b4d4ffa7fd03dad6d35ce","difficulty":0.01, "days":10}'
+// scaninput start '{"txid":"95d640426fe66de866a8cf2d0601d2c8cf3ec598109b4d4ffa7fd03dad6d35ce","days":365}'
+Value scaninput(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "scaninput '{\"txid\":\"txid\", \"vout\":[vout1, vout2, ..., voutN], \"difficulty\":difficulty, \"days\":days}'\n"
+            "Scan specified transaction or input for suitable kernel solutions.\n"
+            "    difficulty - upper limit for difficulty, current difficulty by default;\n"
+            "    days - time window, 90 days by default.\n"
+            "scaninput start '{...}'\n"
+            "Start the same scan in background, returns scan id.\n"
+            "scaninput status [scan] [from]\n"
+            "Progress of all scans, or progress and solutions of the given scan starting from solution number <from>.\n"
+            "scaninput cancel <scan>\n"
+            "Cancel the given scan.\n"
+        );
+
+    if (params[0].type() == str_type)
+    {
+        string strCommand = params[0].get_str();
+
+        if (strCommand == "start")
         {
-            // Check for spent flag
-            // It doesn't make sense to scan spent inputs.
-            if (!txindex.vSpent[nOut].IsNull())
-                continue;
-
-            // Skip zero value outputs
-            if (tx.vout[nOut].nValue == 0)
-                continue;
-
-            // Build static part of kernel
-            CDataStream ssKernel(SER_GETHASH, 0);
-            ssKernel << nStakeModifier;
-            ssKernel << block.nTime << (txindex.pos.nTxPos - txindex.pos.nBlockPos) << tx.nTime << nOut;
-            CDataStream::const_iterator itK = ssKernel.begin();
-
-            std::vector<std::pair<uint256, uint32_t> > result;
-            if (ScanKernelForward((unsigned char *)&itK[0], nBits, tx.nTime, tx.vout[nOut].nValue, interval, result))
+            if (params.size() != 2)
+                throw runtime_error("scaninput start '{...}'");
+            RPCTypeCheck(params, { str_type, obj_type });
+
+            vector<KernelScanInput> vInputs;
+            uint32_t nBits;
+            std::pair<uint32_t, uint32_t> interval;
+            GetScanInputs(params[1].get_obj(), vInputs, nBits, interval);
+
+            int64_t nScan = StartKernelScan(vInputs, nBits, interval.first, interval.second);
+            if (nScan == 0)
+                throw JSONRPCError(RPC_MISC_ERROR, strprintf("Too many running scans, the limit is %d", MAX_KERNEL_SCANS));
+
+            Object obj;
+            obj.push_back(Pair("scan", nScan));
+            return obj;
+        }
+
+        if (strCommand == "status")
+        {
+            if (params.size() == 1)
             {
-                for (const auto &solution : result)
+                Array scans;
+                for (int64_t nScan : ListKernelScans())
                 {
-                    Object item;
-                    item.push_back(Pair("nout", nOut));
-                    item.push_back(Pair("hash", solution.first.GetHex()));
-                    item.push_back(Pair("time", DateTimeStrFormat(solution.second)));
-
-                    results.push_back(item);
+                    KernelScanStatus status;
+                    if (GetKernelScanStatus(nScan, (size_t)-1, status))
+                        scans.push_back(ScanStatusToJSON(nScan, status, false));
                 }
+                return scans;
             }
+
+            int64_t nScan = params[1].get_int64();
+            int64_t nFrom = params.size() > 2 ? params[2].get_int64() : 0;
+            if (nFrom < 0)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, solution number must be non-negative");
+
+            KernelScanStatus status;
+            if (!GetKernelScanStatus(nScan, nFrom, status))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, unknown scan");
+
+            return ScanStatusToJSON(nScan, status, true);
         }
 
-        if (results.size() == 0)
-            return false;
+        if (strCommand == "cancel")
+        {
+            if (params.size() != 2)
+                throw runtime_error("scaninput cancel <scan>");
+
+            if (!CancelKernelScan(params[1].get_int64()))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, unknown scan");
 
-        return results;
+            return Value::null;
+        }
+
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, unknown command " + strCommand);
     }
-    else
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available about transaction");
+
+    RPCTypeCheck(params, { obj_type });
+
+    vector<KernelScanInput> vInputs;
+    uint32_t nBits;
+    std::pair<uint32_t, uint32_t> interval;
+    GetScanInputs(params[0].get_obj(), vInputs, nBits, interval);
+
+    Array results;
+    for (KernelScanInput &input : vInputs)
+    {
+        std::vector<std::pair<uint256, uint32_t> > result;
+        if (ScanKernelForward(input.kernel, nBits, input.nInputTxTime, input.nValueIn, interval, result))
+        {
+            for (const auto &solution : result)
+                results.push_back(ScanSolutionToJSON(input.nOut, solution.first, solution.second));
+        }
+    }
+
+    if (results.size() == 0)
+        return false;
+
+    return results;
 }
 
 Value getworkex(const Array& params, bool fHelp)
@@ -340,11 +456,14 @@ Value getworkex(const Array& params, bool fHelp)
         pblock->nNonce = pdata->nNonce;
 
         if(coinbase.size() == 0)
+        {
             pblock->vtx[0].vin[0].scriptSig = mapNewBlock[pdata->hashMerkleRoot].second;
+            pblock->vtx[0].InvalidateHash();
+        }
         else
             CDataStream(coinbase, SER_NETWORK, PROTOCOL_VERSION) >> pblock->vtx[0]; // FIXME - HACK!
 
-        pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+        pblock->hashMerkleRoot = pblock->BuildMerkleRoot();
 
         return CheckWork(pblock, *pwalletMain, reservekey);
     }
@@ -455,7 +574,8 @@ Value getwork(const Array& params, bool fHelp)
         pblock->nTime = pdata->nTime;
         pblock->nNonce = pdata->nNonce;
         pblock->vtx[0].vin[0].scriptSig = mapNewBlock[pdata->hashMerkleRoot].second;
-        pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+        pblock->vtx[0].InvalidateHash();
+        pblock->hashMerkleRoot = pblock->BuildMerkleRoot();
 
         return CheckWork(pblock, *pwalletMain, reservekey);
     }
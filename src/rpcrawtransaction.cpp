@@ -554,6 +554,7 @@ Value signrawtransaction(const Array& params, bool fHelp)
         }
         const CScript& prevPubKey = mapPrevOut[txin.prevout];
 
+        mergedTx.InvalidateHash();
         txin.scriptSig.clear();
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
         if (!fHashSingle || (i < mergedTx.vout.size()))
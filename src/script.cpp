@@ -10,14 +10,13 @@
 #include "random.h"
 #include "util.h"
 #include "base58.h"
+#include "sigcache.h"
 
-#include <shared_mutex>
+bool CheckSig(const CStackValue& vchSig, const CStackValue& vchPubKey, const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, int flags, const CSignatureHashContext* pSighashContext=nullptr);
 
-bool CheckSig(std::vector<unsigned char> vchSig, const std::vector<unsigned char> &vchPubKey, const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, int flags);
-
-static const valtype vchFalse(0);
-static const valtype vchZero(0);
-static const valtype vchTrue(1, 1);
+static const CStackValue vchFalse;
+static const CStackValue vchZero;
+static const CStackValue vchTrue(std::vector<uint8_t>(1, 1));
 static const CBigNum bnZero(0);
 static const CBigNum bnOne(1);
 static const CBigNum bnFalse(0);
@@ -25,15 +24,31 @@ static const CBigNum bnTrue(1);
 static const size_t nMaxNumSize = 4;
 
 
-CBigNum CastToBigNum(const valtype& vch)
+CBigNum CastToBigNum(const CStackValue& vch)
 {
     if (vch.size() > nMaxNumSize)
         throw std::runtime_error("CastToBigNum() : overflow");
     // Get rid of extra leading zeros
-    return CBigNum(CBigNum(vch).getvch());
+    uint8_t vchNum[nMaxNumSize + 1];
+    size_t nSize;
+    CBigNum bn, bnRet;
+    bn.setvch(vch.data(), vch.size());
+    if (!bn.getvch(vchNum, sizeof(vchNum), nSize))
+        throw std::runtime_error("CastToBigNum() : overflow");
+    bnRet.setvch(vchNum, nSize);
+    return bnRet;
 }
 
-bool CastToBool(const valtype& vch)
+static CStackValue StackValue(const CBigNum& bn)
+{
+    uint8_t vch[STACK_VALUE_INLINE_SIZE];
+    size_t nSize;
+    if (bn.getvch(vch, sizeof(vch), nSize))
+        return CStackValue(vch, vch + nSize);
+    return CStackValue(bn.getvch());
+}
+
+bool CastToBool(const CStackValue& vch)
 {
     for (unsigned int i = 0; i < vch.size(); i++)
     {
@@ -82,7 +97,7 @@ void MakeSameSize(valtype& vch1, valtype& vch2)
 //
 #define stacktop(i)  (stack.at(stack.size()+(i)))
 #define altstacktop(i)  (altstack.at(altstack.size()+(i)))
-static inline void popstack(std::vector<valtype>& stack)
+static inline void popstack(CScriptStack& stack)
 {
     if (stack.empty())
         throw std::runtime_error("popstack() : stack empty");
@@ -250,7 +265,7 @@ const char* GetOpName(opcodetype opcode)
     }
 }
 
-bool IsCanonicalPubKey(const valtype &vchPubKey, unsigned int flags) {
+bool IsCanonicalPubKey(const CStackValue &vchPubKey, unsigned int flags) {
     if (!(flags & SCRIPT_VERIFY_STRICTENC))
         return true;
 
@@ -268,7 +283,8 @@ bool IsCanonicalPubKey(const valtype &vchPubKey, unsigned int flags) {
     return true;
 }
 
-bool IsDERSignature(const valtype &vchSig, bool fWithHashType, bool fCheckLow) {
+template <typename T>
+static bool IsDERSignatureImpl(const T &vchSig, bool fWithHashType, bool fCheckLow) {
     // See https://bitcointalk.org/index.php?topic=8392.msg127623#msg127623
     // A canonical signature exists of: <30> <total len> <02> <len R> <R> <02> <len S> <S> <hashtype>
     // Where R and S are not negative (their first byte has its highest bit not set), and not
@@ -328,11 +344,15 @@ bool IsDERSignature(const valtype &vchSig, bool fWithHashType, bool fCheckLow) {
     return true;
 }
 
-bool IsCanonicalSignature(const valtype &vchSig, unsigned int flags) {
+bool IsDERSignature(const valtype &vchSig, bool fWithHashType, bool fCheckLow) {
+    return IsDERSignatureImpl(vchSig, fWithHashType, fCheckLow);
+}
+
+bool IsCanonicalSignature(const CStackValue &vchSig, unsigned int flags) {
     if (!(flags & SCRIPT_VERIFY_STRICTENC))
         return true;
 
-    return IsDERSignature(vchSig, true, (flags & SCRIPT_VERIFY_LOW_S) != 0);
+    return IsDERSignatureImpl(vchSig, true, (flags & SCRIPT_VERIFY_LOW_S) != 0);
 }
 
 bool CheckLockTime(const int64_t& nLockTime, const CTransaction &txTo, unsigned int nIn)
@@ -412,16 +432,15 @@ bool CheckSequence(const int64_t& nSequence, const CTransaction &txTo, unsigned
     return true;
 }
 
-bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType)
+bool EvalScript(CScriptStack& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType, const CSignatureHashContext* pSighashContext)
 {
-    CAutoBN_CTX pctx;
     CScript::const_iterator pc = script.begin();
     CScript::const_iterator pend = script.end();
     CScript::const_iterator pbegincodehash = script.begin();
     opcodetype opcode;
     valtype vchPushValue;
     std::vector<bool> vfExec;
-    std::vector<valtype> altstack;
+    CScriptStack altstack;
     if (script.size() > 10000)
         return false;
     int nOpCount = 0;
@@ -487,7 +506,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     // ( -- value)
                     CBigNum bn((int)opcode - (int)(OP_1 - 1));
-                    stack.push_back(bn.getvch());
+                    stack.push_back(StackValue(bn));
                 }
                 break;
 
@@ -509,7 +528,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     {
                         if (stack.size() < 1)
                             return false;
-                        valtype& vch = stacktop(-1);
+                        CStackValue& vch = stacktop(-1);
                         fValue = CastToBool(vch);
                         if (opcode == OP_NOTIF)
                             fValue = !fValue;
@@ -653,8 +672,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- x1 x2 x1 x2)
                     if (stack.size() < 2)
                         return false;
-                    valtype vch1 = stacktop(-2);
-                    valtype vch2 = stacktop(-1);
+                    CStackValue vch1 = stacktop(-2);
+                    CStackValue vch2 = stacktop(-1);
                     stack.push_back(vch1);
                     stack.push_back(vch2);
                 }
@@ -665,9 +684,9 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 x3 -- x1 x2 x3 x1 x2 x3)
                     if (stack.size() < 3)
                         return false;
-                    valtype vch1 = stacktop(-3);
-                    valtype vch2 = stacktop(-2);
-                    valtype vch3 = stacktop(-1);
+                    CStackValue vch1 = stacktop(-3);
+                    CStackValue vch2 = stacktop(-2);
+                    CStackValue vch3 = stacktop(-1);
                     stack.push_back(vch1);
                     stack.push_back(vch2);
                     stack.push_back(vch3);
@@ -679,8 +698,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 x3 x4 -- x1 x2 x3 x4 x1 x2)
                     if (stack.size() < 4)
                         return false;
-                    valtype vch1 = stacktop(-4);
-                    valtype vch2 = stacktop(-3);
+                    CStackValue vch1 = stacktop(-4);
+                    CStackValue vch2 = stacktop(-3);
                     stack.push_back(vch1);
                     stack.push_back(vch2);
                 }
@@ -691,8 +710,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 x3 x4 x5 x6 -- x3 x4 x5 x6 x1 x2)
                     if (stack.size() < 6)
                         return false;
-                    valtype vch1 = stacktop(-6);
-                    valtype vch2 = stacktop(-5);
+                    CStackValue vch1 = stacktop(-6);
+                    CStackValue vch2 = stacktop(-5);
                     stack.erase(stack.end()-6, stack.end()-4);
                     stack.push_back(vch1);
                     stack.push_back(vch2);
@@ -714,7 +733,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x - 0 | x x)
                     if (stack.size() < 1)
                         return false;
-                    valtype vch = stacktop(-1);
+                    CStackValue vch = stacktop(-1);
                     if (CastToBool(vch))
                         stack.push_back(vch);
                 }
@@ -724,7 +743,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     // -- stacksize
                     CBigNum bn((uint16_t) stack.size());
-                    stack.push_back(bn.getvch());
+                    stack.push_back(StackValue(bn));
                 }
                 break;
 
@@ -742,7 +761,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x -- x x)
                     if (stack.size() < 1)
                         return false;
-                    valtype vch = stacktop(-1);
+                    CStackValue vch = stacktop(-1);
                     stack.push_back(vch);
                 }
                 break;
@@ -761,7 +780,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- x1 x2 x1)
                     if (stack.size() < 2)
                         return false;
-                    valtype vch = stacktop(-2);
+                    CStackValue vch = stacktop(-2);
                     stack.push_back(vch);
                 }
                 break;
@@ -777,7 +796,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     popstack(stack);
                     if (n < 0 || n >= (int)stack.size())
                         return false;
-                    valtype vch = stacktop(-n-1);
+                    CStackValue vch = stacktop(-n-1);
                     if (opcode == OP_ROLL)
                         stack.erase(stack.end()-n-1);
                     stack.push_back(vch);
@@ -810,7 +829,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- x2 x1 x2)
                     if (stack.size() < 2)
                         return false;
-                    valtype vch = stacktop(-1);
+                    CStackValue vch = stacktop(-1);
                     stack.insert(stack.end()-2, vch);
                 }
                 break;
@@ -822,7 +841,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 1)
                         return false;
                     CBigNum bn((uint16_t) stacktop(-1).size());
-                    stack.push_back(bn.getvch());
+                    stack.push_back(StackValue(bn));
                 }
                 break;
 
@@ -837,8 +856,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 - bool)
                     if (stack.size() < 2)
                         return false;
-                    valtype& vch1 = stacktop(-2);
-                    valtype& vch2 = stacktop(-1);
+                    CStackValue& vch1 = stacktop(-2);
+                    CStackValue& vch2 = stacktop(-1);
                     bool fEqual = (vch1 == vch2);
                     // OP_NOTEQUAL is disabled because it would be too easy to say
                     // something like n != 1 and have some wiseguy pass in 1 with extra
@@ -884,7 +903,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     default:            assert(!"invalid opcode"); break;
                     }
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    stack.push_back(StackValue(bn));
                 }
                 break;
 
@@ -933,7 +952,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     }
                     popstack(stack);
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    stack.push_back(StackValue(bn));
 
                     if (opcode == OP_NUMEQUALVERIFY)
                     {
@@ -974,17 +993,17 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (in -- hash)
                     if (stack.size() < 1)
                         return false;
-                    valtype& vch = stacktop(-1);
-                    valtype vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
+                    CStackValue& vch = stacktop(-1);
+                    CStackValue vchHash((size_t)((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32));
                     if (opcode == OP_RIPEMD160)
                         RIPEMD160(&vch[0], vch.size(), &vchHash[0]);
                     else if (opcode == OP_SHA1)
                         SHA1(&vch[0], vch.size(), &vchHash[0]);
                     else if (opcode == OP_SHA256)
-                        SHA256(&vch[0], vch.size(), &vchHash[0]);
+                        CSHA256().Write(vch.data(), vch.size()).Finalize(&vchHash[0]);
                     else if (opcode == OP_HASH160)
                     {
-                        uint160 hash160 = Hash160(vch);
+                        uint160 hash160 = Hash160(vch.begin(), vch.end());
                         memcpy(&vchHash[0], &hash160, sizeof(hash160));
                     }
                     else if (opcode == OP_HASH256)
@@ -1011,8 +1030,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 2)
                         return false;
 
-                    valtype& vchSig    = stacktop(-2);
-                    valtype& vchPubKey = stacktop(-1);
+                    CStackValue& vchSig    = stacktop(-2);
+                    CStackValue& vchPubKey = stacktop(-1);
 
                     ////// debug print
                     //PrintHex(vchSig.begin(), vchSig.end(), "sig: %s\n");
@@ -1025,7 +1044,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     scriptCode.FindAndDelete(CScript(vchSig));
 
                     bool fSuccess = IsCanonicalSignature(vchSig, flags) && IsCanonicalPubKey(vchPubKey, flags) &&
-                        CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags);
+                        CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags, pSighashContext);
 
                     popstack(stack);
                     popstack(stack);
@@ -1074,19 +1093,19 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // Drop the signatures, since there's no way for a signature to sign itself
                     for (int k = 0; k < nSigsCount; k++)
                     {
-                        valtype& vchSig = stacktop(-isig-k);
+                        CStackValue& vchSig = stacktop(-isig-k);
                         scriptCode.FindAndDelete(CScript(vchSig));
                     }
 
                     bool fSuccess = true;
                     while (fSuccess && nSigsCount > 0)
                     {
-                        valtype& vchSig    = stacktop(-isig);
-                        valtype& vchPubKey = stacktop(-ikey);
+                        CStackValue& vchSig    = stacktop(-isig);
+                        CStackValue& vchPubKey = stacktop(-ikey);
 
                         // Check signature
                         bool fOk = IsCanonicalSignature(vchSig, flags) && IsCanonicalPubKey(vchPubKey, flags) &&
-                            CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags);
+                            CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags, pSighashContext);
 
                         if (fOk) {
                             isig++;
@@ -1157,19 +1176,61 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
 
 
 
-uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+CSignatureHashContext::CSignatureHashContext(const CTransaction& txTo)
+{
+    CTransaction txTmp(txTo);
+    for (CTxIn& txin : txTmp.vin)
+        txin.scriptSig.clear();
+
+    CDataStream ss(SER_GETHASH, 0);
+    ss << txTmp;
+    vchBlanked.assign(ss.begin(), ss.end());
+
+    // nVersion and nTime come before inputs
+    nInputsOffset = 8 + GetSizeOfCompactSize(txTo.vin.size());
+
+    CHashWriter hasher(SER_GETHASH, 0);
+    hasher.write((const char*)&vchBlanked[0], nInputsOffset);
+    vPrefixHashers.reserve(txTo.vin.size());
+    for (size_t i = 0; i < txTo.vin.size(); i++)
+    {
+        vPrefixHashers.push_back(hasher);
+        hasher.write((const char*)&vchBlanked[nInputsOffset + i * nBlankedInputSize], nBlankedInputSize);
+    }
+}
+
+uint256 CSignatureHashContext::SignatureHashAll(const CScript& scriptCode, unsigned int nIn, int nHashType) const
+{
+    assert(nIn < vPrefixHashers.size());
+    const char* pInput = (const char*)&vchBlanked[nInputsOffset + nIn * nBlankedInputSize];
+    const char* pEnd = (const char*)&vchBlanked[0] + vchBlanked.size();
+
+    // Input with scriptCode instead of empty script, then the rest as is
+    CHashWriter hasher(vPrefixHashers[nIn]);
+    hasher.write(pInput, 36);
+    hasher << scriptCode;
+    hasher.write(pInput + 37, pEnd - (pInput + 37));
+    hasher << nHashType;
+    return hasher.GetHash();
+}
+
+uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const CSignatureHashContext* pSighashContext)
 {
     if (nIn >= txTo.vin.size())
     {
         printf("ERROR: SignatureHash() : nIn=%d out of range\n", nIn);
         return 1;
     }
-    CTransaction txTmp(txTo);
 
     // In case concatenating two scripts ends up with two codeseparators,
     // or an extra one at the end, this prevents all those possible incompatibilities.
     scriptCode.FindAndDelete(CScript(OP_CODESEPARATOR));
 
+    if (pSighashContext && (nHashType & 0x1f) != SIGHASH_NONE && (nHashType & 0x1f) != SIGHASH_SINGLE && !(nHashType & SIGHASH_ANYONECANPAY))
+        return pSighashContext->SignatureHashAll(scriptCode, nIn, nHashType);
+
+    CTransaction txTmp(txTo);
+
     // Blank out other inputs' signatures
     for (unsigned int i = 0; i < txTmp.vin.size(); i++)
         txTmp.vin[i].scriptSig = CScript();
@@ -1220,81 +1281,25 @@ uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int
 }
 
 
-// Valid signature cache, to avoid doing expensive ECDSA signature checking
-// twice for every transaction (once when accepted into memory pool, and
-// again when accepted into the block chain)
-
-class CSignatureCache
+bool CheckSig(const CStackValue& vchSigIn, const CStackValue& vchPubKey, const CScript &scriptCode,
+              const CTransaction& txTo, unsigned int nIn, int nHashType, int flags, const CSignatureHashContext* pSighashContext)
 {
-private:
-     // sigdata_type is (signature hash, signature, public key):
-    using sigdata_type = std::tuple<uint256, std::vector<unsigned char>, CPubKey>;
-    std::set<sigdata_type> setValid;
-    std::shared_mutex cs_sigcache;
-
-public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        std::shared_lock<std::shared_mutex> lock(cs_sigcache);
-
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
-    }
-
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        std::shared_lock<std::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
+    CSignatureCache& signatureCache = GetSignatureCache();
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
-    }
-};
-
-bool CheckSig(std::vector<unsigned char> vchSig, const std::vector<unsigned char> &vchPubKey, const CScript &scriptCode,
-              const CTransaction& txTo, unsigned int nIn, int nHashType, int flags)
-{
-    static CSignatureCache signatureCache;
-
-    CPubKey pubkey(vchPubKey);
+    CPubKey pubkey(vchPubKey.begin(), vchPubKey.end());
     if (!pubkey.IsValid())
         return false;
 
     // Hash type is one byte tacked on to the end of the signature
-    if (vchSig.empty())
+    if (vchSigIn.empty())
         return false;
     if (nHashType == 0)
-        nHashType = vchSig.back();
-    else if (nHashType != vchSig.back())
+        nHashType = vchSigIn.back();
+    else if (nHashType != vchSigIn.back())
         return false;
-    vchSig.pop_back();
+    std::vector<unsigned char> vchSig(vchSigIn.begin(), vchSigIn.end() - 1);
 
-    uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType, pSighashContext);
 
     if (signatureCache.Get(sighash, vchSig, pubkey))
         return true;
@@ -1309,11 +1314,108 @@ bool CheckSig(std::vector<unsigned char> vchSig, const std::vector<unsigned char
 }
 
 
+// Direct push of a public key or an R value, 33 to 75 bytes
+static bool IsKeyPush(CScript::const_iterator pc, CScript::const_iterator pend)
+{
+    return pc < pend && *pc >= 33 && *pc <= 75 && pend - pc > *pc;
+}
+
+//
+// Recognize standard scripts by their length and opcode bytes. Only scripts
+// with keys and hashes given as direct pushes are matched, anything else is
+// left to the template search in Solver().
+//
+static bool MatchStandardScript(const CScript& script, CScriptSolution& solutionRet)
+{
+    solutionRet.SetNull();
+    const size_t nSize = script.size();
+    if (nSize == 0)
+        return false;
+    const uint8_t* pch = script.data();
+
+    // Provably prunable, data-carrying output
+    //
+    // So long as script passes the IsUnspendable() test and all but the first
+    // byte passes the IsPushOnly() test we don't care what exactly is in the
+    // script.
+    if (pch[0] == OP_RETURN && script.IsPushOnly(script.begin()+1))
+    {
+        solutionRet.type = TX_NULL_DATA;
+        return true;
+    }
+
+    // OP_DUP OP_HASH160 <20 byte hash> OP_EQUALVERIFY OP_CHECKSIG
+    if (nSize == 25 && pch[0] == OP_DUP && pch[1] == OP_HASH160 && pch[2] == 20 &&
+        pch[23] == OP_EQUALVERIFY && pch[24] == OP_CHECKSIG)
+    {
+        solutionRet.type = TX_PUBKEYHASH;
+        solutionRet.Add(&pch[3], 20);
+        return true;
+    }
+
+    // OP_HASH160 <20 byte hash> OP_EQUAL
+    if (script.IsPayToScriptHash())
+    {
+        solutionRet.type = TX_SCRIPTHASH;
+        solutionRet.Add(&pch[2], 20);
+        return true;
+    }
+
+    // <pubkey> OP_CHECKSIG
+    if (pch[nSize - 1] == OP_CHECKSIG && IsKeyPush(script.begin(), script.end()) && nSize == pch[0] + 2u)
+    {
+        solutionRet.type = TX_PUBKEY;
+        solutionRet.Add(&pch[1], pch[0]);
+        return true;
+    }
+
+    // <pubkey> <R> OP_DROP OP_CHECKSIG
+    if (nSize >= 70 && pch[nSize - 1] == OP_CHECKSIG && pch[nSize - 2] == OP_DROP && IsKeyPush(script.begin(), script.end()))
+    {
+        CScript::const_iterator pc = script.begin() + pch[0] + 1;
+        if (IsKeyPush(pc, script.end()) && pc + *pc + 3 == script.end())
+        {
+            solutionRet.type = TX_PUBKEY_DROP;
+            solutionRet.Add(&pch[1], pch[0]);
+            solutionRet.Add(&pc[1], *pc);
+            return true;
+        }
+        return false;
+    }
+
+    // OP_m <pubkey> ... <pubkey> OP_n OP_CHECKMULTISIG with 1 <= m <= n <= 16
+    if (nSize >= 37 && pch[nSize - 1] == OP_CHECKMULTISIG)
+    {
+        opcodetype opM = (opcodetype)pch[0], opN = (opcodetype)pch[nSize - 2];
+        if (opM < OP_1 || opM > OP_16 || opN < OP_1 || opN > OP_16 || opM > opN)
+            return false;
+
+        CScript::const_iterator pc = script.begin() + 1, pend = script.end() - 2;
+        while (pc != pend)
+        {
+            if (!IsKeyPush(pc, pend) || !solutionRet.Add(&pc[1], *pc))
+                return false;
+            pc += *pc + 1;
+        }
+        if (solutionRet.size() != CScript::DecodeOP_N(opN))
+            return false;
+
+        solutionRet.type = TX_MULTISIG;
+        solutionRet.nRequired = CScript::DecodeOP_N(opM);
+        return true;
+    }
+
+    return false;
+}
+
 //
 // Return public keys or hashes from scriptPubKey, for 'standard' transaction types.
 //
-bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::vector<unsigned char> >& vSolutionsRet)
+bool Solver(const CScript& scriptPubKey, CScriptSolution& solutionRet)
 {
+    if (MatchStandardScript(scriptPubKey, solutionRet))
+        return true;
+
     // Templates
     static std::map<txnouttype, CScript> mTemplates;
     if (mTemplates.empty())
@@ -1334,37 +1436,20 @@ bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::v
         mTemplates.insert(make_pair(TX_NULL_DATA, CScript() << OP_RETURN << OP_SMALLDATA));
     }
 
-    vSolutionsRet.clear();
-
-    // Shortcut for pay-to-script-hash, which are more constrained than the other types:
-    // it is always OP_HASH160 20 [20 byte hash] OP_EQUAL
-    if (scriptPubKey.IsPayToScriptHash())
-    {
-        typeRet = TX_SCRIPTHASH;
-        std::vector<unsigned char> hashBytes(scriptPubKey.begin()+2, scriptPubKey.begin()+22);
-        vSolutionsRet.push_back(hashBytes);
-        return true;
-    }
-
-    // Provably prunable, data-carrying output
-    //
-    // So long as script passes the IsUnspendable() test and all but the first
-    // byte passes the IsPushOnly() test we don't care what exactly is in the
-    // script.
-    if (scriptPubKey.size() >= 1 && scriptPubKey[0] == OP_RETURN && scriptPubKey.IsPushOnly(scriptPubKey.begin()+1)) {
-        typeRet = TX_NULL_DATA;
-        return true;
-    }
-
-    // Scan templates
+    // Scan templates, for scripts which push keys or hashes in unusual ways
     const CScript& script1 = scriptPubKey;
     for (const auto& tplate : mTemplates)
     {
         const CScript& script2 = tplate.second;
-        vSolutionsRet.clear();
+        solutionRet.SetNull();
 
         opcodetype opcode1, opcode2;
         std::vector<unsigned char> vch1, vch2;
+        int nSmallIntegers = 0, nKeys = 0;
+        int vnSmallInteger[2] = { 0, 0 };
+
+        // Pushed data ends where the next operation starts
+        auto PushedData = [&](CScript::const_iterator pc) { return script1.data() + (pc - script1.begin()) - vch1.size(); };
 
         // Compare
         CScript::const_iterator pc1 = script1.begin();
@@ -1374,14 +1459,15 @@ bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::v
             if (pc1 == script1.end() && pc2 == script2.end())
             {
                 // Found a match
-                typeRet = tplate.first;
-                if (typeRet == TX_MULTISIG)
+                solutionRet.type = tplate.first;
+                if (solutionRet.type == TX_MULTISIG)
                 {
                     // Additional checks for TX_MULTISIG:
-                    unsigned char m = vSolutionsRet.front()[0];
-                    unsigned char n = vSolutionsRet.back()[0];
-                    if (m < 1 || n < 1 || m > n || vSolutionsRet.size()-2 != n)
+                    int m = vnSmallInteger[0];
+                    int n = vnSmallInteger[1];
+                    if (m < 1 || n < 1 || m > n || nKeys != n)
                         return false;
+                    solutionRet.nRequired = m;
                 }
                 return true;
             }
@@ -1395,7 +1481,9 @@ bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::v
             {
                 while (vch1.size() >= 33 && vch1.size() <= 120)
                 {
-                    vSolutionsRet.push_back(vch1);
+                    // More than 16 keys is never a match, only count them
+                    solutionRet.Add(PushedData(pc1), vch1.size());
+                    nKeys++;
                     if (!script1.GetOp(pc1, opcode1, vch1))
                         break;
                 }
@@ -1409,33 +1497,33 @@ bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::v
             {
                 if (vch1.size() < 33 || vch1.size() > 120)
                     break;
-                vSolutionsRet.push_back(vch1);
+                solutionRet.Add(PushedData(pc1), vch1.size());
             }
             else if (opcode2 == OP_PUBKEYHASH)
             {
                 if (vch1.size() != sizeof(uint160))
                     break;
-                vSolutionsRet.push_back(vch1);
+                solutionRet.Add(PushedData(pc1), vch1.size());
             }
             else if (opcode2 == OP_SMALLINTEGER)
-            {   // Single-byte small integer pushed onto vSolutions
+            {   // Single-byte small integer, the only template with them is multisig
                 if (opcode1 == OP_0 ||
                     (opcode1 >= OP_1 && opcode1 <= OP_16))
                 {
-                    char n = (char)CScript::DecodeOP_N(opcode1);
-                    vSolutionsRet.push_back(valtype(1, n));
+                    if (nSmallIntegers < 2)
+                        vnSmallInteger[nSmallIntegers++] = CScript::DecodeOP_N(opcode1);
                 }
                 else
                     break;
             }
             else if (opcode2 == OP_INTEGER)
-            {   // Up to four-byte integer pushed onto vSolutions
+            {   // Up to four-byte integer
                 try
                 {
                     CBigNum bnVal = CastToBigNum(vch1);
                     if (bnVal <= 16)
                         break; // It's better to use OP_0 ... OP_16 for small integers.
-                    vSolutionsRet.push_back(vch1);
+                    solutionRet.Add(PushedData(pc1), vch1.size());
                 }
                 catch(...)
                 {
@@ -1456,11 +1544,28 @@ bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::v
         }
     }
 
-    vSolutionsRet.clear();
-    typeRet = TX_NONSTANDARD;
+    solutionRet.SetNull();
     return false;
 }
 
+bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::vector<unsigned char> >& vSolutionsRet)
+{
+    CScriptSolution solution;
+    bool fSolved = Solver(scriptPubKey, solution);
+    typeRet = solution.type;
+    vSolutionsRet.clear();
+    if (!fSolved)
+        return false;
+
+    if (typeRet == TX_MULTISIG)
+        vSolutionsRet.push_back(valtype(1, (unsigned char)solution.nRequired));
+    for (int i = 0; i < solution.size(); i++)
+        vSolutionsRet.push_back(solution.GetBytes(i));
+    if (typeRet == TX_MULTISIG)
+        vSolutionsRet.push_back(valtype(1, (unsigned char)solution.size()));
+    return true;
+}
+
 
 bool Sign1(const CKeyID& address, const CKeyStore& keystore, const uint256& hash, int nHashType, CScript& scriptSigRet)
 {
@@ -1582,14 +1687,16 @@ int ScriptSigArgsExpected(txnouttype t, const std::vector<std::vector<unsigned c
 
 bool IsStandard(const CScript& scriptPubKey, txnouttype& whichType)
 {
-    std::vector<valtype> vSolutions;
-    if (!Solver(scriptPubKey, whichType, vSolutions))
+    CScriptSolution solution;
+    bool fSolved = Solver(scriptPubKey, solution);
+    whichType = solution.type;
+    if (!fSolved)
         return false;
 
     if (whichType == TX_MULTISIG)
     {
-        unsigned char m = vSolutions.front()[0];
-        unsigned char n = vSolutions.back()[0];
+        int m = solution.nRequired;
+        int n = solution.size();
         // Support up to x-of-3 multisig txns as standard
         if (n < 1 || n > 3)
             return false;
@@ -1601,12 +1708,12 @@ bool IsStandard(const CScript& scriptPubKey, txnouttype& whichType)
 }
 
 
-unsigned int HaveKeys(const std::vector<valtype>& pubkeys, const CKeyStore& keystore)
+int HaveKeys(const CScriptSolution& pubkeys, const CKeyStore& keystore)
 {
-    unsigned int nResult = 0;
-    for (const valtype& pubkey : pubkeys)
+    int nResult = 0;
+    for (int i = 0; i < pubkeys.size(); i++)
     {
-        CKeyID keyID = CPubKey(pubkey).GetID();
+        CKeyID keyID = pubkeys.GetPubKey(i).GetID();
         if (keystore.HaveKey(keyID))
             ++nResult;
     }
@@ -1642,41 +1749,40 @@ isminetype IsMine(const CKeyStore &keystore, const CBitcoinAddress& dest)
 
 isminetype IsMine(const CKeyStore &keystore, const CScript& scriptPubKey)
 {
-    std::vector<valtype> vSolutions;
-    txnouttype whichType;
-    if (!Solver(scriptPubKey, whichType, vSolutions)) {
+    CScriptSolution solution;
+    if (!Solver(scriptPubKey, solution)) {
         if (keystore.HaveWatchOnly(scriptPubKey))
             return MINE_WATCH_ONLY;
         return MINE_NO;
     }
 
     CKeyID keyID;
-    switch (whichType)
+    switch (solution.type)
     {
     case TX_NONSTANDARD:
     case TX_NULL_DATA:
         break;
     case TX_PUBKEY:
-        keyID = CPubKey(vSolutions[0]).GetID();
+        keyID = solution.GetPubKey(0).GetID();
         if (keystore.HaveKey(keyID))
             return MINE_SPENDABLE;
         break;
     case TX_PUBKEY_DROP:
         {
-            CPubKey key = CPubKey(vSolutions[0]);
-            CPubKey R = CPubKey(vSolutions[1]);
+            CPubKey key = solution.GetPubKey(0);
+            CPubKey R = solution.GetPubKey(1);
             if (keystore.CheckOwnership(key, R))
                 return MINE_SPENDABLE;
         }
         break;
     case TX_PUBKEYHASH:
-        keyID = CKeyID(uint160(vSolutions[0]));
+        keyID = CKeyID(solution.GetHash160(0));
         if (keystore.HaveKey(keyID))
             return MINE_SPENDABLE;
         break;
     case TX_SCRIPTHASH:
     {
-        CScriptID scriptID = CScriptID(uint160(vSolutions[0]));
+        CScriptID scriptID = CScriptID(solution.GetHash160(0));
         CScript subscript;
         if (keystore.GetCScript(scriptID, subscript)) {
             isminetype ret = IsMine(keystore, subscript);
@@ -1692,8 +1798,7 @@ isminetype IsMine(const CKeyStore &keystore, const CScript& scriptPubKey)
         // partially owned (somebody else has a key that can spend
         // them) enable spend-out-from-under-you attacks, especially
         // in shared-wallet situations.
-        std::vector<valtype> keys(vSolutions.begin()+1, vSolutions.begin()+vSolutions.size()-1);
-        if (HaveKeys(keys, keystore) == keys.size())
+        if (HaveKeys(solution, keystore) == solution.size())
             return MINE_SPENDABLE;
         break;
     }
@@ -1706,24 +1811,23 @@ isminetype IsMine(const CKeyStore &keystore, const CScript& scriptPubKey)
 
 bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet)
 {
-    std::vector<valtype> vSolutions;
-    txnouttype whichType;
-    if (!Solver(scriptPubKey, whichType, vSolutions))
+    CScriptSolution solution;
+    if (!Solver(scriptPubKey, solution))
         return false;
 
-    if (whichType == TX_PUBKEY)
+    if (solution.type == TX_PUBKEY)
     {
-        addressRet = CPubKey(vSolutions[0]).GetID();
+        addressRet = solution.GetPubKey(0).GetID();
         return true;
     }
-    else if (whichType == TX_PUBKEYHASH)
+    else if (solution.type == TX_PUBKEYHASH)
     {
-        addressRet = CKeyID(uint160(vSolutions[0]));
+        addressRet = CKeyID(solution.GetHash160(0));
         return true;
     }
-    else if (whichType == TX_SCRIPTHASH)
+    else if (solution.type == TX_SCRIPTHASH)
     {
-        addressRet = CScriptID(uint160(vSolutions[0]));
+        addressRet = CScriptID(solution.GetHash160(0));
         return true;
     }
     // Multisig txns have more than one address...
@@ -1732,34 +1836,33 @@ bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet)
 
 bool ExtractAddress(const CKeyStore &keystore, const CScript& scriptPubKey, CBitcoinAddress& addressRet)
 {
-    std::vector<valtype> vSolutions;
-    txnouttype whichType;
-    if (!Solver(scriptPubKey, whichType, vSolutions))
+    CScriptSolution solution;
+    if (!Solver(scriptPubKey, solution))
         return false;
 
-    if (whichType == TX_PUBKEY)
+    if (solution.type == TX_PUBKEY)
     {
-        addressRet = CBitcoinAddress(CPubKey(vSolutions[0]).GetID());
+        addressRet = CBitcoinAddress(solution.GetPubKey(0).GetID());
         return true;
     }
-    if (whichType == TX_PUBKEY_DROP)
+    if (solution.type == TX_PUBKEY_DROP)
     {
         // Pay-to-Pubkey-R
         CMalleableKeyView view;
-        if (!keystore.CheckOwnership(CPubKey(vSolutions[0]), CPubKey(vSolutions[1]), view))
+        if (!keystore.CheckOwnership(solution.GetPubKey(0), solution.GetPubKey(1), view))
             return false;
 
         addressRet = CBitcoinAddress(view.GetMalleablePubKey());
         return true;
     }
-    else if (whichType == TX_PUBKEYHASH)
+    else if (solution.type == TX_PUBKEYHASH)
     {
-        addressRet = CBitcoinAddress(CKeyID(uint160(vSolutions[0])));
+        addressRet = CBitcoinAddress(CKeyID(solution.GetHash160(0)));
         return true;
     }
-    else if (whichType == TX_SCRIPTHASH)
+    else if (solution.type == TX_SCRIPTHASH)
     {
-        addressRet = CBitcoinAddress(CScriptID(uint160(vSolutions[0])));
+        addressRet = CBitcoinAddress(CScriptID(solution.GetHash160(0)));
         return true;
     }
     // Multisig txns have more than one address...
@@ -1807,9 +1910,10 @@ void ExtractAffectedKeys(const CKeyStore &keystore, const CScript& scriptPubKey,
 bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<CTxDestination>& addressRet, int& nRequiredRet)
 {
     addressRet.clear();
-    typeRet = TX_NONSTANDARD;
-    std::vector<valtype> vSolutions;
-    if (!Solver(scriptPubKey, typeRet, vSolutions))
+    CScriptSolution solution;
+    bool fSolved = Solver(scriptPubKey, solution);
+    typeRet = solution.type;
+    if (!fSolved)
         return false;
     if (typeRet == TX_NULL_DATA)
     {
@@ -1819,10 +1923,10 @@ bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, std::
 
     if (typeRet == TX_MULTISIG)
     {
-        nRequiredRet = vSolutions.front()[0];
-        for (unsigned int i = 1; i < vSolutions.size()-1; i++)
+        nRequiredRet = solution.nRequired;
+        for (int i = 0; i < solution.size(); i++)
         {
-            CTxDestination address = CPubKey(vSolutions[i]).GetID();
+            CTxDestination address = solution.GetPubKey(i).GetID();
             addressRet.push_back(address);
         }
     }
@@ -1840,15 +1944,151 @@ bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, std::
     return true;
 }
 
-bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
-                  unsigned int flags, int nHashType)
+bool fCheckScriptTemplates = false;
+
+// Evaluates a push-only script exactly like EvalScript() does. Returns false
+// if anything but pushes is found, fValid is the outcome of the evaluation.
+static bool EvalPushOnly(const CScript& script, CScriptStack& stack, bool& fValid)
 {
-    std::vector<std::vector<unsigned char> > stack, stackCopy;
-    if (!EvalScript(stack, scriptSig, txTo, nIn, flags, nHashType))
+    fValid = false;
+    if (script.size() > 10000)
+        return true;
+
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    valtype vchPushValue;
+    while (pc < script.end())
+    {
+        if (!script.GetOp(pc, opcode, vchPushValue))
+            return true;
+        if (vchPushValue.size() > MAX_SCRIPT_ELEMENT_SIZE)
+            return true;
+
+        if (0 <= opcode && opcode <= OP_PUSHDATA4)
+            stack.push_back(vchPushValue);
+        else if (opcode == OP_1NEGATE || (OP_1 <= opcode && opcode <= OP_16))
+            stack.push_back(StackValue(CBigNum((int)opcode - (int)(OP_1 - 1))));
+        else
+            return false;
+
+        if (stack.size() > 1000)
+            return true;
+    }
+    fValid = true;
+    return true;
+}
+
+// Verifies pay-to-pubkey, pay-to-pubkey-hash and bare multisig outputs spent by
+// a push-only scriptSig without running the interpreter on scriptPubKey. Returns
+// false if the scripts don't fit, otherwise fResult is what VerifyScript() would
+// have returned. Stack limits, FindAndDelete() on the script code and the order
+// of multisig checks all follow EvalScript().
+static bool VerifyScriptTemplate(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
+                                 unsigned int flags, int nHashType, const CSignatureHashContext* pSighashContext, bool& fResult)
+{
+    CScriptSolution solution;
+    if (!MatchStandardScript(scriptPubKey, solution))
+        return false;
+    if (solution.type != TX_PUBKEY && solution.type != TX_PUBKEYHASH && solution.type != TX_MULTISIG)
+        return false;
+
+    CScriptArenaScope arenaScope;
+    CScriptStack stack;
+    bool fValid;
+    if (!EvalPushOnly(scriptSig, stack, fValid))
+        return false;
+
+    fResult = false;
+    if (!fValid)
+        return true;
+
+    // No OP_CODESEPARATOR in any of the templates
+    CScript scriptCode(scriptPubKey);
+
+    switch (solution.type)
+    {
+    case TX_PUBKEY:
+    {
+        if (stack.size() < 1 || stack.size() + 1 > 1000)
+            return true;
+        const CStackValue& vchSig = stack.back();
+        CStackValue vchPubKey(solution.begin(0), solution.end(0));
+        scriptCode.FindAndDelete(CScript(vchSig));
+        fResult = IsCanonicalSignature(vchSig, flags) && IsCanonicalPubKey(vchPubKey, flags) &&
+            CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags, pSighashContext);
+        return true;
+    }
+
+    case TX_PUBKEYHASH:
+    {
+        if (stack.size() < 1 || stack.size() + 2 > 1000)
+            return true;
+        const CStackValue& vchPubKey = stack.back();
+        uint160 hash160 = Hash160(vchPubKey.begin(), vchPubKey.end());
+        if (hash160 != solution.GetHash160(0) || stack.size() < 2)
+            return true;
+        const CStackValue& vchSig = stack[stack.size() - 2];
+        scriptCode.FindAndDelete(CScript(vchSig));
+        fResult = IsCanonicalSignature(vchSig, flags) && IsCanonicalPubKey(vchPubKey, flags) &&
+            CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags, pSighashContext);
+        return true;
+    }
+
+    case TX_MULTISIG:
+    {
+        const int nRequired = solution.nRequired, nKeys = solution.size();
+
+        // Signatures on top of the stack and the extra dummy argument below them
+        if ((int)stack.size() < nRequired + 1 || stack.size() + nKeys + 2 > 1000)
+            return true;
+
+        for (int k = 0; k < nRequired; k++)
+            scriptCode.FindAndDelete(CScript(stack[stack.size() - 1 - k]));
+
+        // Signatures from the top of the stack down, keys from the last one
+        int nSigsCount = nRequired, nKeysCount = nKeys;
+        int isig = stack.size() - 1, ikey = nKeys - 1;
+        bool fSuccess = true;
+        while (fSuccess && nSigsCount > 0)
+        {
+            const CStackValue& vchSig = stack[isig];
+            CStackValue vchPubKey(solution.begin(ikey), solution.end(ikey));
+
+            bool fOk = IsCanonicalSignature(vchSig, flags) && IsCanonicalPubKey(vchPubKey, flags) &&
+                CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags, pSighashContext);
+
+            if (fOk) {
+                isig--;
+                nSigsCount--;
+            }
+            ikey--;
+            nKeysCount--;
+
+            if (nSigsCount > nKeysCount)
+                fSuccess = false;
+        }
+
+        if ((flags & SCRIPT_VERIFY_NULLDUMMY) && stack[stack.size() - 1 - nRequired].size())
+            return true;
+        fResult = fSuccess;
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+static bool VerifyScriptInterpreted(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
+                                    unsigned int flags, int nHashType, const CSignatureHashContext* pSighashContext)
+{
+    CScriptArenaScope arenaScope;
+    CScriptStack stack, stackCopy;
+    if (!EvalScript(stack, scriptSig, txTo, nIn, flags, nHashType, pSighashContext))
         return false;
     if (flags & SCRIPT_VERIFY_P2SH)
         stackCopy = stack;
-    if (!EvalScript(stack, scriptPubKey, txTo, nIn, flags, nHashType))
+    if (!EvalScript(stack, scriptPubKey, txTo, nIn, flags, nHashType, pSighashContext))
         return false;
     if (stack.empty())
         return false;
@@ -1867,11 +2107,11 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         // an empty stack and the EvalScript above would return false.
         assert(!stackCopy.empty());
 
-        const valtype& pubKeySerialized = stackCopy.back();
+        const CStackValue& pubKeySerialized = stackCopy.back();
         CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
         popstack(stackCopy);
 
-        if (!EvalScript(stackCopy, pubKey2, txTo, nIn, flags, nHashType))
+        if (!EvalScript(stackCopy, pubKey2, txTo, nIn, flags, nHashType, pSighashContext))
             return false;
         if (stackCopy.empty())
             return false;
@@ -1881,14 +2121,36 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
     return true;
 }
 
-bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTransaction& txTo, unsigned int nIn, int nHashType)
+bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
+                  unsigned int flags, int nHashType, const CSignatureHashContext* pSighashContext)
+{
+    bool fTemplateResult;
+    if (!VerifyScriptTemplate(scriptSig, scriptPubKey, txTo, nIn, flags, nHashType, pSighashContext, fTemplateResult))
+        return VerifyScriptInterpreted(scriptSig, scriptPubKey, txTo, nIn, flags, nHashType, pSighashContext);
+
+    if (fCheckScriptTemplates)
+    {
+        bool fResult = VerifyScriptInterpreted(scriptSig, scriptPubKey, txTo, nIn, flags, nHashType, pSighashContext);
+        if (fResult != fTemplateResult)
+        {
+            printf("ERROR: VerifyScript() : template path returned %d, interpreter %d for %s input %u\n",
+                fTemplateResult, fResult, txTo.GetHash().ToString().c_str(), nIn);
+            return fResult;
+        }
+    }
+
+    return fTemplateResult;
+}
+
+bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTransaction& txTo, unsigned int nIn, int nHashType, const CSignatureHashContext* pSighashContext)
 {
     assert(nIn < txTo.vin.size());
     CTxIn& txin = txTo.vin[nIn];
+    txTo.InvalidateHash();
 
     // Leave out the signature from the hash, since a signature can't sign itself.
     // The checksig op will also drop the signatures from its hash.
-    uint256 hash = SignatureHash(fromPubKey, txTo, nIn, nHashType);
+    uint256 hash = SignatureHash(fromPubKey, txTo, nIn, nHashType, pSighashContext);
 
     txnouttype whichType;
     if (!Solver(keystore, fromPubKey, hash, nHashType, txin.scriptSig, whichType))
@@ -1902,7 +2164,7 @@ bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTransa
         CScript subscript = txin.scriptSig;
 
         // Recompute txn hash using subscript in place of scriptPubKey:
-        uint256 hash2 = SignatureHash(subscript, txTo, nIn, nHashType);
+        uint256 hash2 = SignatureHash(subscript, txTo, nIn, nHashType, pSighashContext);
 
         txnouttype subType;
         bool fSolved =
@@ -1913,10 +2175,10 @@ bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTransa
     }
 
     // Test solution
-    return VerifyScript(txin.scriptSig, fromPubKey, txTo, nIn, STRICT_FLAGS, 0);
+    return VerifyScript(txin.scriptSig, fromPubKey, txTo, nIn, STRICT_FLAGS, 0, pSighashContext);
 }
 
-bool SignSignature(const CKeyStore &keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType)
+bool SignSignature(const CKeyStore &keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType, const CSignatureHashContext* pSighashContext)
 {
     assert(nIn < txTo.vin.size());
     CTxIn& txin = txTo.vin[nIn];
@@ -1924,7 +2186,7 @@ bool SignSignature(const CKeyStore &keystore, const CTransaction& txFrom, CTrans
     assert(txin.prevout.hash == txFrom.GetHash());
     const CTxOut& txout = txFrom.vout[txin.prevout.n];
 
-    return SignSignature(keystore, txout.scriptPubKey, txTo, nIn, nHashType);
+    return SignSignature(keystore, txout.scriptPubKey, txTo, nIn, nHashType, pSighashContext);
 }
 
 static CScript PushAll(const std::vector<valtype>& values)
@@ -2043,12 +2305,18 @@ CScript CombineSignatures(const CScript& scriptPubKey, const CTransaction& txTo,
     std::vector<std::vector<unsigned char> > vSolutions;
     Solver(scriptPubKey, txType, vSolutions);
 
-    std::vector<valtype> stack1;
+    CScriptStack stack1;
     EvalScript(stack1, scriptSig1, CTransaction(), 0, SCRIPT_VERIFY_STRICTENC, 0);
-    std::vector<valtype> stack2;
+    CScriptStack stack2;
     EvalScript(stack2, scriptSig2, CTransaction(), 0, SCRIPT_VERIFY_STRICTENC, 0);
 
-    return CombineSignatures(scriptPubKey, txTo, nIn, txType, vSolutions, stack1, stack2);
+    std::vector<valtype> sigs1, sigs2;
+    for (const CStackValue& vch : stack1)
+        sigs1.push_back(valtype(vch.begin(), vch.end()));
+    for (const CStackValue& vch : stack2)
+        sigs2.push_back(valtype(vch.begin(), vch.end()));
+
+    return CombineSignatures(scriptPubKey, txTo, nIn, txType, vSolutions, sigs1, sigs2);
 }
 
 unsigned int CScript::GetSigOpCount(bool fAccurate) const
@@ -7,6 +7,8 @@
 
 #include "keystore.h"
 #include "bignum.h"
+#include "hash.h"
+#include "scriptstack.h"
 #include "util.h"
 
 #include <string>
@@ -309,6 +311,33 @@ protected:
         return *this;
     }
 
+    CScript& push_data(const uint8_t* pch, size_t nSize)
+    {
+        if (nSize < OP_PUSHDATA1)
+        {
+            insert(end(), (uint8_t)nSize);
+        }
+        else if (nSize <= 0xff)
+        {
+            insert(end(), OP_PUSHDATA1);
+            insert(end(), (uint8_t)nSize);
+        }
+        else if (nSize <= 0xffff)
+        {
+            insert(end(), OP_PUSHDATA2);
+            uint16_t nSize16 = (uint16_t) nSize;
+            insert(end(), (uint8_t*)&nSize16, (uint8_t*)&nSize16 + sizeof(nSize16));
+        }
+        else
+        {
+            insert(end(), OP_PUSHDATA4);
+            uint32_t nSize32 = (uint32_t) nSize;
+            insert(end(), (uint8_t*)&nSize32, (uint8_t*)&nSize32 + sizeof(nSize32));
+        }
+        insert(end(), pch, pch + nSize);
+        return *this;
+    }
+
 public:
     CScript() { }
     CScript(const CScript& b) : std::vector<uint8_t>(b.begin(), b.end()) { }
@@ -346,6 +375,7 @@ public:
     explicit CScript(const uint256& b) { operator<<(b); }
     explicit CScript(const CBigNum& b) { operator<<(b); }
     explicit CScript(const std::vector<uint8_t>& b) { operator<<(b); }
+    explicit CScript(const CStackValue& b) { operator<<(b); }
 
     CScript& operator<<(int8_t  b) { return push_int64(b); }
     CScript& operator<<(int16_t b) { return push_int64(b); }
@@ -393,29 +423,12 @@ public:
 
     CScript& operator<<(const std::vector<uint8_t>& b)
     {
-        if (b.size() < OP_PUSHDATA1)
-        {
-            insert(end(), (uint8_t)b.size());
-        }
-        else if (b.size() <= 0xff)
-        {
-            insert(end(), OP_PUSHDATA1);
-            insert(end(), (uint8_t)b.size());
-        }
-        else if (b.size() <= 0xffff)
-        {
-            insert(end(), OP_PUSHDATA2);
-            uint16_t nSize = (uint16_t) b.size();
-            insert(end(), (uint8_t*)&nSize, (uint8_t*)&nSize + sizeof(nSize));
-        }
-        else
-        {
-            insert(end(), OP_PUSHDATA4);
-            uint32_t nSize = (uint32_t) b.size();
-            insert(end(), (uint8_t*)&nSize, (uint8_t*)&nSize + sizeof(nSize));
-        }
-        insert(end(), b.begin(), b.end());
-        return *this;
+        return push_data(b.data(), b.size());
+    }
+
+    CScript& operator<<(const CStackValue& b)
+    {
+        return push_data(b.data(), b.size());
     }
 
     CScript& operator<<(const CScript& b)
@@ -626,11 +639,91 @@ public:
     CScriptID GetID() const;
 };
 
-bool IsCanonicalPubKey(const std::vector<unsigned char> &vchPubKey, unsigned int flags);
+// Type of a standard scriptPubKey with its keys or hashes. Solutions are not
+// copied, they point into the script, which has to outlive this object.
+class CScriptSolution
+{
+public:
+    static const int MAX_SOLUTIONS = 16;
+
+    txnouttype type;
+    int nRequired; // signatures needed by TX_MULTISIG
+
+    CScriptSolution()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        type = TX_NONSTANDARD;
+        nRequired = 0;
+        nSolutions = 0;
+    }
+
+    bool Add(const uint8_t* pch, size_t nSize)
+    {
+        if (nSolutions == MAX_SOLUTIONS)
+            return false;
+        vpchSolution[nSolutions] = pch;
+        vnSolutionSize[nSolutions] = (unsigned int)nSize;
+        nSolutions++;
+        return true;
+    }
+
+    int size() const { return nSolutions; }
+    const uint8_t* begin(int i) const { return vpchSolution[i]; }
+    const uint8_t* end(int i) const { return vpchSolution[i] + vnSolutionSize[i]; }
+
+    std::vector<uint8_t> GetBytes(int i) const { return std::vector<uint8_t>(begin(i), end(i)); }
+    CPubKey GetPubKey(int i) const { return CPubKey(begin(i), end(i)); }
+
+    uint160 GetHash160(int i) const
+    {
+        uint160 hash;
+        if (vnSolutionSize[i] == sizeof(hash))
+            memcpy(hash.begin(), begin(i), sizeof(hash));
+        return hash;
+    }
+
+private:
+    int nSolutions;
+    const uint8_t* vpchSolution[MAX_SOLUTIONS];
+    unsigned int vnSolutionSize[MAX_SOLUTIONS];
+};
+
+bool IsCanonicalPubKey(const CStackValue &vchPubKey, unsigned int flags);
 bool IsDERSignature(const valtype &vchSig, bool fWithHashType=false, bool fCheckLow=false);
-bool IsCanonicalSignature(const std::vector<unsigned char> &vchSig, unsigned int flags);
+bool IsCanonicalSignature(const CStackValue &vchSig, unsigned int flags);
+
+// Signature hashing state shared by all inputs of a transaction.
+//
+// The transaction is serialized once with all scriptSigs blanked, which is
+// how SignatureHash() sees every input but the signed one. Hash states of
+// the serialization up to each input are kept, so hashing an input only
+// goes through the signed input and the rest of the transaction.
+// Used for SIGHASH_ALL, scriptSigs of the transaction may change freely
+// while the context is in use, anything else may not.
+class CSignatureHashContext
+{
+public:
+    explicit CSignatureHashContext(const CTransaction& txTo);
+
+    // Same as SignatureHash() for SIGHASH_ALL, scriptCode without OP_CODESEPARATOR
+    uint256 SignatureHashAll(const CScript& scriptCode, unsigned int nIn, int nHashType) const;
 
-bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType);
+private:
+    // Size of a blanked input: prevout, empty script and sequence
+    static const size_t nBlankedInputSize = 36 + 1 + 4;
+
+    std::vector<unsigned char> vchBlanked;
+    size_t nInputsOffset;
+    std::vector<CHashWriter> vPrefixHashers;
+};
+
+uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const CSignatureHashContext* pSighashContext=nullptr);
+bool EvalScript(CScriptStack& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType, const CSignatureHashContext* pSighashContext=nullptr);
+bool Solver(const CScript& scriptPubKey, CScriptSolution& solutionRet);
 bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::vector<unsigned char> >& vSolutionsRet);
 int ScriptSigArgsExpected(txnouttype t, const std::vector<std::vector<unsigned char> >& vSolutions);
 bool IsStandard(const CScript& scriptPubKey, txnouttype& whichType);
@@ -641,9 +734,13 @@ void ExtractAffectedKeys(const CKeyStore &keystore, const CScript& scriptPubKey,
 bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet);
 bool ExtractAddress(const CKeyStore &keystore, const CScript& scriptPubKey, CBitcoinAddress& addressRet);
 bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<CTxDestination>& addressRet, int& nRequiredRet);
-bool SignSignature(const CKeyStore& keystore, const CScript& fromPubKey, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
-bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
-bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType);
+bool SignSignature(const CKeyStore& keystore, const CScript& fromPubKey, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL, const CSignatureHashContext* pSighashContext=nullptr);
+bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL, const CSignatureHashContext* pSighashContext=nullptr);
+// Run standard scripts through the interpreter as well and log any difference
+// from the template fast path (-checkscripttemplates)
+extern bool fCheckScriptTemplates;
+
+bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType, const CSignatureHashContext* pSighashContext=nullptr);
 
 // Given two sets of signatures for scriptPubKey, possibly with OP_0 placeholders,
 // combine them intelligently and return the result.
@@ -0,0 +1,59 @@
+#include "scriptstack.h"
+
+#include <memory>
+#include <new>
+
+using namespace std;
+
+namespace
+{
+    struct ArenaState
+    {
+        unique_ptr<uint8_t[]> pchBuffer;
+        size_t nOffset = 0;
+        unsigned int nDepth = 0;
+    };
+
+    thread_local ArenaState arena;
+
+    const size_t nAlignment = alignof(max_align_t);
+}
+
+void* CScriptArena::Allocate(size_t nBytes)
+{
+    if (arena.nDepth > 0)
+    {
+        if (!arena.pchBuffer)
+            arena.pchBuffer.reset(new uint8_t[ARENA_SIZE]);
+
+        size_t nRounded = (nBytes + nAlignment - 1) & ~(nAlignment - 1);
+        if (nRounded <= ARENA_SIZE - arena.nOffset)
+        {
+            void* p = arena.pchBuffer.get() + arena.nOffset;
+            arena.nOffset += nRounded;
+            return p;
+        }
+    }
+    return ::operator new(nBytes);
+}
+
+void CScriptArena::Deallocate(void* p)
+{
+    // Arena memory is given back when the scope it came from ends
+    const uint8_t* pch = static_cast<const uint8_t*>(p);
+    if (arena.pchBuffer && pch >= arena.pchBuffer.get() && pch < arena.pchBuffer.get() + ARENA_SIZE)
+        return;
+    ::operator delete(p);
+}
+
+CScriptArenaScope::CScriptArenaScope()
+{
+    nSavedOffset = arena.nOffset;
+    arena.nDepth++;
+}
+
+CScriptArenaScope::~CScriptArenaScope()
+{
+    arena.nOffset = nSavedOffset;
+    arena.nDepth--;
+}
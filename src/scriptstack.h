@@ -0,0 +1,176 @@
+#ifndef NOVACOIN_SCRIPTSTACK_H
+#define NOVACOIN_SCRIPTSTACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Values up to this size are stored inside of the stack element itself,
+// which covers signatures, public keys, hashes and numbers.
+static const size_t STACK_VALUE_INLINE_SIZE = 80;
+
+// Per-thread scratch memory for the script interpreter. While a
+// CScriptArenaScope is alive on a thread, interpreter stacks and values
+// which don't fit inline are carved from the arena and released all at
+// once when the scope ends. Outside of a scope, or when the arena is
+// exhausted, memory comes from the heap as usual.
+class CScriptArena
+{
+public:
+    static const size_t ARENA_SIZE = 256 * 1024;
+
+    static void* Allocate(size_t nBytes);
+    static void Deallocate(void* p);
+};
+
+// Everything allocated from the arena within the scope must be destroyed
+// before the scope ends, so declare it ahead of the stacks it serves.
+class CScriptArenaScope
+{
+private:
+    size_t nSavedOffset;
+
+public:
+    CScriptArenaScope();
+    ~CScriptArenaScope();
+
+    CScriptArenaScope(const CScriptArenaScope&) = delete;
+    CScriptArenaScope& operator=(const CScriptArenaScope&) = delete;
+};
+
+template <typename T>
+class CScriptArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    CScriptArenaAllocator() noexcept { }
+    template <typename U>
+    CScriptArenaAllocator(const CScriptArenaAllocator<U>&) noexcept { }
+
+    T* allocate(size_t n) { return static_cast<T*>(CScriptArena::Allocate(n * sizeof(T))); }
+    void deallocate(T* p, size_t) noexcept { CScriptArena::Deallocate(p); }
+
+    template <typename U>
+    bool operator==(const CScriptArenaAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const CScriptArenaAllocator<U>&) const noexcept { return false; }
+};
+
+// Fixed-length byte string used as a script interpreter stack element
+class CStackValue
+{
+private:
+    uint32_t nSize;
+    union
+    {
+        uint8_t chInline[STACK_VALUE_INLINE_SIZE];
+        uint8_t* pchData;
+    };
+
+    bool IsInline() const { return nSize <= STACK_VALUE_INLINE_SIZE; }
+
+    void Init(const uint8_t* pch, size_t n)
+    {
+        nSize = (uint32_t)n;
+        uint8_t* pchDst = chInline;
+        if (!IsInline())
+            pchDst = pchData = static_cast<uint8_t*>(CScriptArena::Allocate(n));
+        if (n)
+            memcpy(pchDst, pch, n);
+    }
+
+    void Steal(CStackValue& b)
+    {
+        nSize = b.nSize;
+        if (IsInline())
+            memcpy(chInline, b.chInline, nSize);
+        else
+            pchData = b.pchData;
+        b.nSize = 0;
+    }
+
+    void Free()
+    {
+        if (!IsInline())
+            CScriptArena::Deallocate(pchData);
+        nSize = 0;
+    }
+
+public:
+    typedef uint8_t value_type;
+    typedef uint8_t* iterator;
+    typedef const uint8_t* const_iterator;
+
+    CStackValue() : nSize(0) { }
+    explicit CStackValue(size_t n)
+    {
+        nSize = (uint32_t)n;
+        if (!IsInline())
+            pchData = static_cast<uint8_t*>(CScriptArena::Allocate(n));
+        memset(data(), 0, n);
+    }
+    CStackValue(const uint8_t* pbegin, const uint8_t* pend) { Init(pbegin, pend - pbegin); }
+    CStackValue(const std::vector<uint8_t>& vch) { Init(vch.data(), vch.size()); }
+    CStackValue(const CStackValue& b) { Init(b.data(), b.size()); }
+    CStackValue(CStackValue&& b) noexcept { Steal(b); }
+    ~CStackValue() { Free(); }
+
+    CStackValue& operator=(const CStackValue& b)
+    {
+        if (this != &b)
+        {
+            Free();
+            Init(b.data(), b.size());
+        }
+        return *this;
+    }
+
+    CStackValue& operator=(CStackValue&& b) noexcept
+    {
+        if (this != &b)
+        {
+            Free();
+            Steal(b);
+        }
+        return *this;
+    }
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    uint8_t* data() { return IsInline() ? chInline : pchData; }
+    const uint8_t* data() const { return IsInline() ? chInline : pchData; }
+
+    iterator begin() { return data(); }
+    iterator end() { return data() + nSize; }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + nSize; }
+
+    uint8_t& operator[](size_t i) { return data()[i]; }
+    const uint8_t& operator[](size_t i) const { return data()[i]; }
+    const uint8_t& back() const { return data()[nSize - 1]; }
+
+    friend void swap(CStackValue& a, CStackValue& b) noexcept
+    {
+        CStackValue tmp(std::move(a));
+        a = std::move(b);
+        b = std::move(tmp);
+    }
+
+    friend bool operator==(const CStackValue& a, const CStackValue& b)
+    {
+        return a.nSize == b.nSize && (a.nSize == 0 || memcmp(a.data(), b.data(), a.nSize) == 0);
+    }
+
+    friend bool operator!=(const CStackValue& a, const CStackValue& b)
+    {
+        return !(a == b);
+    }
+};
+
+typedef std::vector<CStackValue, CScriptArenaAllocator<CStackValue> > CScriptStack;
+
+#endif
@@ -0,0 +1,204 @@
+#include "scrypt.h"
+#include "util.h"
+#include "crypto/cpuid.h"
+
+#include <atomic>
+
+using namespace std;
+
+uint256 scrypt_blockhash_generic(const uint8_t* input);
+#ifdef USE_INTRIN
+uint256 scrypt_blockhash_sse2(const uint8_t* input);
+void scrypt_blockhash_lanes_sse2(const uint8_t* const* inputs, uint256* outputs, void* scratchpad);
+#endif
+#ifdef USE_AVX2
+void scrypt_blockhash_lanes_avx2(const uint8_t* const* inputs, uint256* outputs, void* scratchpad);
+#endif
+#ifdef USE_AVX512
+void scrypt_blockhash_lanes_avx512(const uint8_t* const* inputs, uint256* outputs, void* scratchpad);
+#endif
+
+namespace {
+
+typedef uint256 (*ScryptHashFn)(const uint8_t* input);
+
+// Hash nLanes headers at once, scratchpad is 64-byte aligned and nLanes * 128 KiB long
+typedef void (*ScryptLanesFn)(const uint8_t* const* inputs, uint256* outputs, void* scratchpad);
+
+struct ScryptImpl
+{
+    const char *pszName;
+    int nLanes;
+    ScryptHashFn fnHash;
+    ScryptLanesFn fnLanes;
+};
+
+// Implementations supported by this CPU, ordered from the fastest one
+int GetScryptImpls(const ScryptImpl** ppImpls)
+{
+    static ScryptImpl impls[4];
+    static const int nImpls = [] {
+        int n = 0;
+        const CPUFeatures& cpu = GetCPUFeatures();
+        (void)cpu;
+
+        // Single headers are hashed by SSE2 code in all x86 back ends
+#ifdef USE_AVX512
+        if (cpu.fAVX512F)
+            impls[n++] = { "avx512", 8, scrypt_blockhash_sse2, scrypt_blockhash_lanes_avx512 };
+#endif
+#ifdef USE_AVX2
+        if (cpu.fAVX2)
+            impls[n++] = { "avx2", 4, scrypt_blockhash_sse2, scrypt_blockhash_lanes_avx2 };
+#endif
+#ifdef USE_INTRIN
+        if (cpu.fSSE2 || cpu.fNEON)
+            impls[n++] = { cpu.fNEON ? "neon" : "sse2", 2, scrypt_blockhash_sse2, scrypt_blockhash_lanes_sse2 };
+#endif
+        impls[n++] = { "generic", 1, scrypt_blockhash_generic, nullptr };
+        return n;
+    }();
+    *ppImpls = impls;
+    return nImpls;
+}
+
+// Known headers and their hashes
+const struct
+{
+    const char* pszHeader;
+    const char* pszHash;
+} vScryptTests[] = {
+    { "020000004c1271c211717198227392b029a64a7971931d351b387bb80db027f270411e398a07046f7d4a08dd815412a8712f874a7ebf0507e3878bd24e20a3b73fd750a667d2f451eac7471b00de6659",
+      "00000000002bef4107f882f6115e0b01f348d21195dacd3582aa2dabd7985806" },
+    { "0200000011503ee6a855e900c00cfdd98f5f55fffeaee9b6bf55bea9b852d9de2ce35828e204eef76acfd36949ae56d1fbe81c1ac9c0209e6331ad56414f9072506a77f8c6faf551eac7471b00389d01",
+      "00000000003a0d11bdd5eb634e08b7feddcfbbf228ed35d250daf19f1c88fc94" },
+    { "02000000a72c8a177f523946f42f22c3e86b8023221b4105e8007e59e81f6beb013e29aaf635295cb9ac966213fb56e046dc71df5b3f7f67ceaeab24038e743f883aff1aaafaf551eac7471b0166249b",
+      "00000000000b40f895f288e13244728a6c2d9d59d8aff29c65f8dd5114a8ca81" },
+};
+
+// Check single and multi-buffer hashing against the known hashes
+bool ScryptSelfTest(const ScryptImpl& impl)
+{
+    const size_t nTests = sizeof(vScryptTests) / sizeof(vScryptTests[0]);
+    vector<vector<unsigned char> > vHeaders;
+    vector<uint256> vExpected;
+    for (size_t i = 0; i < nTests; i++)
+    {
+        vHeaders.push_back(ParseHex(vScryptTests[i].pszHeader));
+        vExpected.push_back(uint256(vScryptTests[i].pszHash));
+        if (impl.fnHash(&vHeaders[i][0]) != vExpected[i])
+            return false;
+    }
+
+    if (!impl.fnLanes)
+        return true;
+
+    // Neighbouring lanes get different headers
+    vector<const uint8_t*> vInputs;
+    for (int i = 0; i < impl.nLanes; i++)
+        vInputs.push_back(&vHeaders[i % nTests][0]);
+    vector<uint256> vOutputs(impl.nLanes);
+
+    vector<uint8_t> scratchpad(impl.nLanes * (SCRYPT_BUFFER_SIZE - 63) + 63);
+    impl.fnLanes(&vInputs[0], &vOutputs[0], (void*)(((uintptr_t)(&scratchpad[0]) + 63) & ~ (uintptr_t)(63)));
+    for (int i = 0; i < impl.nLanes; i++)
+    {
+        if (vOutputs[i] != vExpected[i % nTests])
+            return false;
+    }
+
+    return true;
+}
+
+atomic<const ScryptImpl*> pScryptImpl(nullptr);
+
+const ScryptImpl* GetScryptImpl()
+{
+    const ScryptImpl* pimpl = pScryptImpl.load(memory_order_acquire);
+    if (!pimpl)
+    {
+        SelectScryptImpl("auto");
+        pimpl = pScryptImpl.load(memory_order_acquire);
+    }
+    return pimpl;
+}
+
+} // namespace
+
+bool SelectScryptImpl(const string& strName)
+{
+    const ScryptImpl* pImpls;
+    int nImpls = GetScryptImpls(&pImpls);
+    for (int i = 0; i < nImpls; i++)
+    {
+        if (strName != "auto" && strName != pImpls[i].pszName)
+            continue;
+
+        if (ScryptSelfTest(pImpls[i]))
+        {
+            pScryptImpl.store(&pImpls[i], memory_order_release);
+            return true;
+        }
+        printf("ERROR: %s scrypt implementation failed self-test\n", pImpls[i].pszName);
+
+        // The generic one is the last resort of automatic selection
+        if (strName == "auto" && i == nImpls - 1)
+            pScryptImpl.store(&pImpls[i], memory_order_release);
+    }
+
+    return false;
+}
+
+const char* GetScryptImplName()
+{
+    return GetScryptImpl()->pszName;
+}
+
+vector<string> GetScryptImplNames()
+{
+    const ScryptImpl* pImpls;
+    int nImpls = GetScryptImpls(&pImpls);
+
+    vector<string> vNames;
+    for (int i = 0; i < nImpls; i++)
+        vNames.push_back(pImpls[i].pszName);
+    return vNames;
+}
+
+uint256 scrypt_blockhash(const uint8_t* input)
+{
+    return GetScryptImpl()->fnHash(input);
+}
+
+void scrypt_blockhash_n(const uint8_t* const* inputs, uint256* outputs, size_t nCount)
+{
+    const ScryptImpl* pimpl = GetScryptImpl();
+    const size_t nLanes = pimpl->nLanes;
+
+    // A lone header is hashed by single-buffer code, and the last group
+    // of several ones is padded with copies of the last header
+    if (!pimpl->fnLanes || nCount == 1)
+    {
+        for (size_t i = 0; i < nCount; i++)
+            outputs[i] = pimpl->fnHash(inputs[i]);
+        return;
+    }
+
+    vector<uint8_t> scratchpad(nLanes * (SCRYPT_BUFFER_SIZE - 63) + 63);
+    void* V = (void*)(((uintptr_t)(&scratchpad[0]) + 63) & ~ (uintptr_t)(63));
+
+    size_t i = 0;
+    for (; i + nLanes <= nCount; i += nLanes)
+        pimpl->fnLanes(inputs + i, outputs + i, V);
+
+    if (i == nCount - 1)
+        outputs[i] = pimpl->fnHash(inputs[i]);
+    else if (i < nCount)
+    {
+        vector<const uint8_t*> vInputs(inputs + i, inputs + nCount);
+        vInputs.resize(nLanes, inputs[nCount - 1]);
+        vector<uint256> vOutputs(nLanes);
+        pimpl->fnLanes(&vInputs[0], &vOutputs[0], V);
+        copy(vOutputs.begin(), vOutputs.begin() + (nCount - i), outputs + i);
+    }
+}
@@ -1,11 +1,32 @@
 #ifndef SCRYPT_H
 #define SCRYPT_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string>
+#include <vector>
 #include "uint256.h"
 
 #define SCRYPT_BUFFER_SIZE (131072 + 63)
 
 uint256 scrypt_blockhash(const uint8_t* input);
 
+// Hash nCount 80-byte headers, several of them are processed at once
+void scrypt_blockhash_n(const uint8_t* const* inputs, uint256* outputs, size_t nCount);
+
+// All implementations are built in, the fastest one supported by CPU
+// is used unless another one is selected by name. Implementations are
+// checked against known hashes before they are used.
+
+// Select implementation, "auto" picks the fastest one which passes self-test.
+// Returns false if implementation is unknown, not supported by this CPU or
+// failed self-test, the current one is kept then.
+bool SelectScryptImpl(const std::string& strName);
+
+// Name of the current implementation
+const char* GetScryptImplName();
+
+// Names of implementations supported by this CPU, from the fastest one
+std::vector<std::string> GetScryptImplNames();
+
 #endif // SCRYPT_H
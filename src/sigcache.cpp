@@ -0,0 +1,123 @@
+#include "sigcache.h"
+#include "key.h"
+#include "random.h"
+#include "script.h"
+#include "util.h"
+
+using namespace std;
+
+CBoundedHashSet::CBoundedHashSet(size_t nMaxBytes)
+    : pShards(new Shard[nShards])
+{
+    nBuckets = nMaxBytes / (nShards * nWays * sizeof(uint256));
+    for (size_t i = 0; i < nShards; i++)
+        pShards[i].vEntries.resize(nBuckets * nWays);
+}
+
+bool CBoundedHashSet::Contains(const uint256& key) const
+{
+    if (nBuckets == 0)
+        return false;
+
+    Shard& shard = GetShard(key);
+    const size_t nBucket = GetBucket(key);
+
+    lock_guard<mutex> lock(shard.mutex);
+    for (size_t i = 0; i < nWays; i++)
+    {
+        if (shard.vEntries[nBucket + i] == key)
+            return true;
+    }
+    return false;
+}
+
+void CBoundedHashSet::Insert(const uint256& key)
+{
+    if (nBuckets == 0)
+        return;
+
+    Shard& shard = GetShard(key);
+    const size_t nBucket = GetBucket(key);
+
+    lock_guard<mutex> lock(shard.mutex);
+    for (size_t i = 0; i < nWays; i++)
+    {
+        uint256& entry = shard.vEntries[nBucket + i];
+        if (entry == key)
+            return;
+        if (entry == 0)
+        {
+            entry = key;
+            return;
+        }
+    }
+
+    // Full bucket, the victim depends on the salted key only
+    shard.vEntries[nBucket + key.Get32(2) % nWays] = key;
+}
+
+CSignatureCache::CSignatureCache(size_t nMaxBytes)
+    : setValid(nMaxBytes)
+{
+    // One block of salt, so the copies of the hasher start from a midstate
+    unsigned char pchSalt[64];
+    GetRandBytes(pchSalt, sizeof(pchSalt));
+    hasherSalted.Write(pchSalt, sizeof(pchSalt));
+}
+
+uint256 CSignatureCache::GetKey(const uint256& sighash, const vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+{
+    uint256 key;
+    CSHA256(hasherSalted).Write(sighash.begin(), 32).Write(vchSig.data(), vchSig.size()).Write(pubkey.begin(), pubkey.size()).Finalize(key.begin());
+    return key;
+}
+
+bool CSignatureCache::Get(const uint256& sighash, const vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+{
+    return setValid.Contains(GetKey(sighash, vchSig, pubkey));
+}
+
+void CSignatureCache::Set(const uint256& sighash, const vector<unsigned char>& vchSig, const CPubKey& pubkey)
+{
+    setValid.Insert(GetKey(sighash, vchSig, pubkey));
+}
+
+CSignatureCache& GetSignatureCache()
+{
+    static CSignatureCache signatureCache((size_t)min<int64_t>(max<int64_t>(GetArg("-sigcachemb", DEFAULT_MAX_SIG_CACHE_SIZE), 0), MAX_MAX_SIG_CACHE_SIZE) << 20);
+    return signatureCache;
+}
+
+CScriptExecutionCache::CScriptExecutionCache(size_t nMaxBytes)
+    : setValid(nMaxBytes)
+{
+    unsigned char pchSalt[64];
+    GetRandBytes(pchSalt, sizeof(pchSalt));
+    hasherSalted.Write(pchSalt, sizeof(pchSalt));
+}
+
+uint256 CScriptExecutionCache::GetKey(const uint256& hashTx, unsigned int flags) const
+{
+    // Whether the signature cache may be filled doesn't change the outcome
+    flags &= ~SCRIPT_VERIFY_NOCACHE;
+
+    uint256 key;
+    CSHA256(hasherSalted).Write(hashTx.begin(), 32).Write((const unsigned char*)&flags, sizeof(flags)).Finalize(key.begin());
+    return key;
+}
+
+bool CScriptExecutionCache::Contains(const uint256& hashTx, unsigned int flags) const
+{
+    return setValid.Contains(GetKey(hashTx, flags));
+}
+
+void CScriptExecutionCache::Insert(const uint256& hashTx, unsigned int flags)
+{
+    setValid.Insert(GetKey(hashTx, flags));
+}
+
+CScriptExecutionCache& GetScriptExecutionCache()
+{
+    static CScriptExecutionCache scriptCache((size_t)min<int64_t>(max<int64_t>(GetArg("-maxscriptcachesize", DEFAULT_MAX_SCRIPT_CACHE_SIZE), 0), MAX_MAX_SIG_CACHE_SIZE) << 20);
+    return scriptCache;
+}
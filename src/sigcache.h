@@ -0,0 +1,107 @@
+#ifndef NOVACOIN_SIGCACHE_H
+#define NOVACOIN_SIGCACHE_H
+
+#include "uint256.h"
+#include "crypto/sha256/sha256.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class CPubKey;
+
+// Default and maximum size of the signature cache, in megabytes
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+static const unsigned int MAX_MAX_SIG_CACHE_SIZE = 1024;
+
+// Fixed-size set of 32-byte keys.
+//
+// Memory is allocated once and split into shards with their own locks,
+// so script check threads rarely wait for each other. Keys must be salted
+// hashes: their words select the shard, the bucket and the entry evicted
+// from a full bucket, and an attacker can't aim at any of them.
+class CBoundedHashSet
+{
+public:
+    explicit CBoundedHashSet(size_t nMaxBytes);
+
+    bool Contains(const uint256& key) const;
+    void Insert(const uint256& key);
+
+    // Number of keys which fit into the set
+    size_t GetCapacity() const { return nShards * nBuckets * nWays; }
+
+private:
+    static const size_t nShards = 64;
+    static const size_t nWays = 4;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::vector<uint256> vEntries;
+    };
+
+    size_t nBuckets;
+    std::unique_ptr<Shard[]> pShards;
+
+    Shard& GetShard(const uint256& key) const { return pShards[key.Get32(0) % nShards]; }
+    size_t GetBucket(const uint256& key) const { return (key.Get32(1) % nBuckets) * nWays; }
+};
+
+// Valid signature cache, to avoid doing expensive ECDSA signature checking
+// twice for every transaction (once when accepted into memory pool, and
+// again when accepted into the block chain).
+//
+// Entries are salted SHA-256 digests of (signature hash, signature, public key).
+class CSignatureCache
+{
+public:
+    explicit CSignatureCache(size_t nMaxBytes);
+
+    bool Get(const uint256& sighash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const;
+    void Set(const uint256& sighash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey);
+
+    size_t GetCapacity() const { return setValid.GetCapacity(); }
+
+private:
+    // Hasher which has already consumed the random salt
+    CSHA256 hasherSalted;
+    CBoundedHashSet setValid;
+
+    uint256 GetKey(const uint256& sighash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const;
+};
+
+// Signature cache of the process, sized by -sigcachemb on the first use
+CSignatureCache& GetSignatureCache();
+
+// Default size of the script execution cache, in megabytes
+static const unsigned int DEFAULT_MAX_SCRIPT_CACHE_SIZE = 8;
+
+// Transactions whose input scripts all passed verification, so blocks
+// don't check them again after the memory pool did.
+//
+// Entries are salted SHA-256 digests of (txid, script verification flags).
+// The txid commits to the spent outputs, and therefore to the scripts
+// being run, while the flags have to match exactly: a script may succeed
+// with some flag and fail without it.
+class CScriptExecutionCache
+{
+public:
+    explicit CScriptExecutionCache(size_t nMaxBytes);
+
+    bool Contains(const uint256& hashTx, unsigned int flags) const;
+    void Insert(const uint256& hashTx, unsigned int flags);
+
+    size_t GetCapacity() const { return setValid.GetCapacity(); }
+
+private:
+    CSHA256 hasherSalted;
+    CBoundedHashSet setValid;
+
+    uint256 GetKey(const uint256& hashTx, unsigned int flags) const;
+};
+
+// Script execution cache of the process, sized by -maxscriptcachesize on the first use
+CScriptExecutionCache& GetScriptExecutionCache();
+
+#endif // NOVACOIN_SIGCACHE_H
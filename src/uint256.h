@@ -407,10 +407,12 @@ public:
 
     friend class uint160;
     friend class uint256;
+    friend class uint320;
 };
 
 typedef base_uint<160> base_uint160;
 typedef base_uint<256> base_uint256;
+typedef base_uint<320> base_uint320;
 
 //
 // uint160 and uint256 could be implemented as templates, but to keep
@@ -584,4 +586,64 @@ inline const uint256 operator|(const uint256& a, const uint256& b)      { return
 inline const uint256 operator+(const uint256& a, const uint256& b)      { return (base_uint256)a +  (base_uint256)b; }
 inline const uint256 operator-(const uint256& a, const uint256& b)      { return (base_uint256)a -  (base_uint256)b; }
 
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// uint320
+//
+
+/** 320-bit unsigned integer, wide enough for a product of 256-bit and 64-bit
+ * integers. Lets the kernel target be compared without bignum allocations.
+ */
+class uint320 : public base_uint320
+{
+public:
+    typedef base_uint320 basetype;
+
+    uint320()
+    {
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] = 0;
+    }
+
+    // Full product a * b, can't overflow
+    uint320(const base_uint256& a, uint64_t b)
+    {
+        const uint64_t b0 = (uint32_t)b, b1 = b >> 32;
+        uint64_t carry = 0;
+        for (int i = 0; i < base_uint256::WIDTH; i++)
+        {
+            uint64_t n = carry + a.pn[i] * b0;
+            pn[i] = (uint32_t)n;
+            carry = n >> 32;
+        }
+        pn[8] = (uint32_t)carry;
+        pn[9] = 0;
+
+        carry = 0;
+        for (int i = 0; i < base_uint256::WIDTH; i++)
+        {
+            uint64_t n = carry + pn[i + 1] + a.pn[i] * b1;
+            pn[i + 1] = (uint32_t)n;
+            carry = n >> 32;
+        }
+        pn[9] = (uint32_t)carry;
+    }
+
+    bool operator>=(const base_uint256& b) const
+    {
+        if (pn[9] != 0 || pn[8] != 0)
+            return true;
+        for (int i = base_uint256::WIDTH-1; i >= 0; i--)
+        {
+            if (pn[i] > b.pn[i])
+                return true;
+            else if (pn[i] < b.pn[i])
+                return false;
+        }
+        return true;
+    }
+};
+
 #endif
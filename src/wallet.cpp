@@ -2138,10 +2138,11 @@ bool CWallet::CreateTransaction(const std::vector<std::pair<CScript, int64_t> >&
                 for (const auto& coin : setCoins)
                     wtxNew.vin.push_back(CTxIn(coin.first->GetHash(),coin.second));
 
-                // Sign
+                // Sign, all inputs share one signature hashing context
+                CSignatureHashContext sighashContext(wtxNew);
                 int nIn = 0;
                 for (const auto& coin : setCoins)
-                    if (!SignSignature(*this, *coin.first, wtxNew, nIn++))
+                    if (!SignSignature(*this, *coin.first, wtxNew, nIn++, SIGHASH_ALL, &sighashContext))
                         return false;
 
                 // Limit size
@@ -2161,6 +2162,8 @@ bool CWallet::CreateTransaction(const std::vector<std::pair<CScript, int64_t> >&
                     continue;
                 }
 
+                wtxNew.UpdateHash();
+
                 // Fill vtxPrev by copying from previous transactions vtxPrev
                 wtxNew.AddSupportingTransactions(txdb);
                 wtxNew.fTimeReceivedIsTxTime = true;
@@ -2263,11 +2266,12 @@ bool CWallet::MergeCoins(const int64_t& nAmount, const int64_t& nMinValue, const
         {
             wtxNew.vout[0].nValue -= nMinFee; // Set actual fee
 
+            CSignatureHashContext sighashContext(wtxNew);
             for (unsigned int i = 0; i < wtxNew.vin.size(); i++) {
                 const CWalletTx *txin = vwtxPrev[i];
 
                 // Sign all scripts
-                if (!SignSignature(*this, *txin, wtxNew, i))
+                if (!SignSignature(*this, *txin, wtxNew, i, SIGHASH_ALL, &sighashContext))
                     return false;
             }
 
@@ -2299,11 +2303,12 @@ bool CWallet::MergeCoins(const int64_t& nAmount, const int64_t& nMinValue, const
         if (wtxNew.vout[0].nValue <= 0)
             return false;
 
+        CSignatureHashContext sighashContext(wtxNew);
         for (unsigned int i = 0; i < wtxNew.vin.size(); i++) {
             const CWalletTx *txin = vwtxPrev[i];
 
             // Sign all scripts again
-            if (!SignSignature(*this, *txin, wtxNew, i))
+            if (!SignSignature(*this, *txin, wtxNew, i, SIGHASH_ALL, &sighashContext))
                 return false;
         }
 
@@ -2476,10 +2481,11 @@ bool CWallet::CreateCoinStake(uint256 &hashTx, uint32_t nOut, uint32_t nGenerati
         }
 
         // Sign
+        CSignatureHashContext sighashContext(txNew);
         int nIn = 0;
         for (const CWalletTx* pcoin : vwtxPrev)
         {
-            if (!SignSignature(*this, *pcoin, txNew, nIn++))
+            if (!SignSignature(*this, *pcoin, txNew, nIn++, SIGHASH_ALL, &sighashContext))
                 return error("CreateCoinStake : failed to sign coinstake\n");
         }
 
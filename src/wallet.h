@@ -269,6 +269,11 @@ public:
      */
     boost::signals2::signal<void (CWallet *wallet, const uint256 &hashTx, ChangeType status)> NotifyTransactionChanged;
 
+    /** Block disconnected from the main chain.
+     * @note called with lock cs_main held.
+     */
+    boost::signals2::signal<void (CWallet *wallet)> NotifyBlockDisconnected;
+
     /** Watch-only address added */
     boost::signals2::signal<void (bool fHaveWatchOnly)> NotifyWatchonlyChanged;
 };